@@ -0,0 +1,26 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+// Seconds taken by the fastest of runs calls to fn (after one warm-up call)
+template<typename Fn>
+double TimeBest(Fn&& fn, int runs = 5) {
+    fn();
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+// Suites, each printing its own table
+void RunPixelOpsBench();
+void RunCompositeBench();
+void RunModesBench();
+void RunLayersBench();
+void RunLinearBench();
+void RunFormatsBench();
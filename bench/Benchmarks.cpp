@@ -0,0 +1,44 @@
+// PhotoEditorBench [suite...]: runs the named benchmark suites, or all of
+// them. Build in Release; numbers are per thread unless a suite says so.
+#include "BenchUtil.h"
+#include "Core/Math/PixelOps.h"
+#include "Utils/Threading.h"
+#include <cstring>
+
+struct Suite {
+    const char* name;
+    void (*run)();
+};
+
+static const Suite SUITES[] = {
+    {"pixelops", RunPixelOpsBench},
+    {"composite", RunCompositeBench},
+    {"modes", RunModesBench},
+    {"layers", RunLayersBench},
+    {"linear", RunLinearBench},
+    {"formats", RunFormatsBench},
+};
+
+int main(int argc, char** argv) {
+    std::printf("CPU level %s, %zu pool threads\n", PixelOps::GetLevelName(PixelOps::GetSupportedLevel()),
+                ThreadPool::GetInstance().GetThreadCount());
+    int unknown = 0;
+    for (int i = 1; i < argc; i++) {
+        bool found = false;
+        for (const Suite& suite : SUITES) found |= std::strcmp(argv[i], suite.name) == 0;
+        if (!found) {
+            std::printf("Unknown suite %s\n", argv[i]);
+            unknown++;
+        }
+    }
+    if (unknown) return 1;
+
+    for (const Suite& suite : SUITES) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; i++) selected |= std::strcmp(argv[i], suite.name) == 0;
+        if (!selected) continue;
+        std::printf("\n== %s ==\n", suite.name);
+        suite.run();
+    }
+    return 0;
+}
@@ -0,0 +1,238 @@
+// LayerManager::CompositeLayers on synthetic documents. Every timed call
+// recomposites the whole canvas (the top layer's opacity changes between
+// calls, which dirties every tile) and includes the copy the call returns.
+#include "BenchUtil.h"
+#include "Core/Engine/LayerManager.h"
+#include "Core/Math/PixelOps.h"
+#include <cstring>
+#include <vector>
+
+// Layer pixels from a xorshift generator: noise with alpha in 64..255, so no
+// tile is opaque (nothing gets culled) or transparent
+static void FillNoise(BufferManager::Buffer& buffer, uint64_t seed) {
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    for (uint32_t y = 0; y < buffer.height; y++) {
+        uint8_t* row = BufferManager::GetRow(buffer, y);
+        for (uint32_t x = 0; x < buffer.width; x += 2) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            uint64_t bits = state | 0x4000000040000000ull; // Alpha >= 64
+            std::memcpy(row + x * 4, &bits, std::min<size_t>(8, (buffer.width - x) * 4));
+        }
+    }
+}
+
+// Adds count full-canvas noise layers, blending in mode above an opaque
+// bottom layer. Layers are filled one tile row at a time, so building a
+// large document needs no full-size staging buffer.
+static void AddNoiseLayers(LayerManager& layers, uint32_t width, uint32_t height, size_t count, BlendMode mode) {
+    PixelFormat format = layers.GetPixelFormat();
+    BufferManager::Buffer band = BufferManager::Create(width, TiledImage::TILE_SIZE);
+    BufferManager::Buffer converted = BufferManager::Create(width, TiledImage::TILE_SIZE, format);
+    for (size_t i = 0; i < count; i++) {
+        Layer* layer = layers.CreateLayer(width, height);
+        for (uint32_t y = 0; y < height; y += TiledImage::TILE_SIZE) {
+            FillNoise(band, i * 100003 + y);
+            if (i == 0) {
+                for (uint32_t row = 0; row < band.height; row++) {
+                    uint8_t* pixels = BufferManager::GetRow(band, row);
+                    for (uint32_t x = 0; x < width; x++) pixels[x * 4 + 3] = 255;
+                }
+            }
+            BufferManager::Convert(band, converted);
+            uint32_t rows = std::min(TiledImage::TILE_SIZE, height - y);
+            layer->GetPixels().Write(0, static_cast<int>(y), BufferManager::GetView(converted, 0, 0, width, rows));
+        }
+        layer->SetOpacity(i == 0 ? 1.0f : 0.9f);
+        layer->SetBlendMode(i == 0 ? BlendMode::Normal : mode);
+    }
+    BufferManager::Destroy(converted);
+    BufferManager::Destroy(band);
+    layers.SetActiveLayer(nullptr); // Measure the plain composite, not the stack caches
+}
+
+// Seconds per full recomposite (best of runs)
+static double TimeComposite(LayerManager& layers, uint32_t width, uint32_t height, int runs) {
+    Layer* top = layers.GetLayer(layers.GetLayerCount() - 1);
+    bool flip = false;
+    return TimeBest([&] {
+        flip = !flip;
+        top->SetOpacity(flip ? 0.9f : 0.8f);
+        BufferManager::Buffer composite = layers.CompositeLayers(width, height);
+        BufferManager::Destroy(composite);
+    }, runs);
+}
+
+// Two layers at 4K, 8K and 16K (16K needs about 3 GB), at every
+// dispatch level
+void RunCompositeBench() {
+    struct Size {
+        const char* name;
+        uint32_t width, height;
+        int runs;
+    };
+    const Size sizes[] = {{"4K", 3840, 2160, 5}, {"8K", 7680, 4320, 3}, {"16K", 15360, 8640, 1}};
+    SimdLevel supported = PixelOps::GetSupportedLevel();
+
+    std::printf("Mpixels/s of canvas, RGBA8 Normal, 2 layers (ms per composite in brackets)\n%-6s", "");
+    for (int level = 0; level <= static_cast<int>(supported); level++) {
+        std::printf("%20s", PixelOps::GetLevelName(static_cast<SimdLevel>(level)));
+    }
+    std::printf("\n");
+
+    for (const Size& size : sizes) {
+        LayerManager layers;
+        AddNoiseLayers(layers, size.width, size.height, 2, BlendMode::Normal);
+        std::printf("%-6s", size.name);
+        for (int level = 0; level <= static_cast<int>(supported); level++) {
+            PixelOps::SetLevel(static_cast<SimdLevel>(level));
+            double seconds = TimeComposite(layers, size.width, size.height, size.runs);
+            std::printf("%11.0f (%5.0f)", static_cast<double>(size.width) * size.height / seconds / 1e6, seconds * 1e3);
+            std::fflush(stdout);
+        }
+        std::printf("\n");
+        PixelOps::SetLevel(supported);
+    }
+}
+
+static const BlendMode ALL_MODES[] = {
+    BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen, BlendMode::Overlay,
+    BlendMode::SoftLight, BlendMode::HardLight, BlendMode::ColorDodge, BlendMode::ColorBurn,
+    BlendMode::Darken, BlendMode::Lighten, BlendMode::Difference, BlendMode::Exclusion};
+
+static const char* const MODE_NAMES[] = {"Normal", "Multiply", "Screen", "Overlay", "SoftLight", "HardLight",
+                                         "ColorDodge", "ColorBurn", "Darken", "Lighten", "Difference", "Exclusion"};
+
+// Each blend mode at 4K, two layers in the mode over an opaque
+// bottom layer
+void RunModesBench() {
+    const uint32_t width = 3840, height = 2160;
+    std::printf("RGBA8 at 4K, 2 layers in the mode over a Normal one\n%-12s%14s%10s%14s\n", "", "Mpixels/s", "ms",
+                "vs Normal");
+    double normal = 0.0;
+    for (BlendMode mode : ALL_MODES) {
+        LayerManager layers;
+        AddNoiseLayers(layers, width, height, 3, mode);
+        double seconds = TimeComposite(layers, width, height, 5);
+        if (mode == BlendMode::Normal) normal = seconds;
+        std::printf("%-12s%14.0f%10.1f%13.2fx\n", MODE_NAMES[static_cast<int>(mode)],
+                    static_cast<double>(width) * height / seconds / 1e6, seconds * 1e3, seconds / normal);
+        std::fflush(stdout);
+    }
+}
+
+// The layer-major order CompositeLayers used to have: each layer is blended
+// over the whole canvas before the next, so every layer streams the full
+// output through the cache again. Same kernels as CompositeLayers: blends
+// straight from the layers' tiles onto a cleared canvas and unpremultiplies
+// at the end.
+static double TimeLayerMajor(const LayerManager& layers, uint32_t width, uint32_t height, int runs) {
+    const uint32_t tile = TiledImage::TILE_SIZE;
+    return TimeBest([&] {
+        BufferManager::Buffer composite = BufferManager::Create(width, height);
+        BufferManager::Clear(composite, 0, 0, 0, 0);
+        for (size_t i = 0; i < layers.GetLayerCount(); i++) {
+            const Layer* layer = layers.GetLayer(i);
+            const TiledImage& pixels = layer->GetPixels();
+            uint8_t opacity = static_cast<uint8_t>(layer->GetOpacity() * 255.0f + 0.5f);
+            for (uint32_t tileY = 0; tileY * tile < height; tileY++) {
+                for (uint32_t tileX = 0; tileX * tile < width; tileX++) {
+                    const BufferManager::Buffer* source = pixels.GetTile(tileX, tileY);
+                    for (uint32_t y = 0; y < source->height; y++) {
+                        uint8_t* dst = BufferManager::GetRow(composite, tileY * tile + y) + tileX * tile * 4;
+                        const uint8_t* src = BufferManager::GetRow(*source, y);
+                        PixelOps::AlphaOverStraight(dst, src, source->width, opacity);
+                    }
+                }
+            }
+        }
+        for (uint32_t y = 0; y < height; y++) {
+            uint8_t* row = BufferManager::GetRow(composite, y);
+            PixelOps::Unpremultiply(row, row, width);
+        }
+        BufferManager::Destroy(composite);
+    }, runs);
+}
+
+// Tile-major CompositeLayers against the layer-major loop above, on 5, 20
+// and 100 Normal layers. The output only stops fitting in cache once it is
+// larger than the last-level cache, so 5 and 20 layers run at 8K (a 130 MB
+// canvas); 100 layers at 8K would need 13 GB and run at 2K instead.
+// CompositeLayers also returns a copy of the composite it keeps for
+// incremental updates, which the loop does not; that copy is shown on its
+// own.
+void RunLayersBench() {
+    struct Document {
+        size_t layers;
+        uint32_t width, height;
+        int runs;
+    };
+    const Document documents[] = {{5, 7680, 4320, 3}, {20, 7680, 4320, 2}, {100, 2048, 2048, 2}};
+    std::printf("RGBA8 Normal, ms per composite\n%-8s%-12s%14s%14s%14s%10s\n", "layers", "canvas", "tile-major",
+                "of which copy", "layer-major", "speed-up");
+    for (const Document& document : documents) {
+        LayerManager layers;
+        AddNoiseLayers(layers, document.width, document.height, document.layers, BlendMode::Normal);
+        double tileMajor = TimeComposite(layers, document.width, document.height, document.runs);
+        double layerMajor = TimeLayerMajor(layers, document.width, document.height, document.runs);
+        BufferManager::Buffer canvas = BufferManager::Create(document.width, document.height);
+        FillNoise(canvas, 1);
+        double copy = TimeBest([&] {
+            BufferManager::Buffer clone = BufferManager::Clone(canvas);
+            BufferManager::Destroy(clone);
+        }, document.runs);
+        BufferManager::Destroy(canvas);
+
+        char size[32];
+        std::snprintf(size, sizeof(size), "%ux%u", document.width, document.height);
+        std::printf("%-8zu%-12s%14.1f%14.1f%14.1f%9.2fx\n", document.layers, size, tileMajor * 1e3, copy * 1e3,
+                    layerMajor * 1e3, layerMajor / tileMajor);
+        std::fflush(stdout);
+    }
+}
+
+// Linear-light compositing against sRGB, RGBA8 Normal at 4K over 3 layers
+void RunLinearBench() {
+    const uint32_t width = 3840, height = 2160;
+    const BlendSpace spaces[] = {BlendSpace::SRGB, BlendSpace::Linear};
+    const char* const names[] = {"sRGB", "Linear"};
+    std::printf("RGBA8 Normal at 4K, 3 layers\n%-12s%14s%10s%14s\n", "", "Mpixels/s", "ms", "vs sRGB");
+    double srgb = 0.0;
+    for (int i = 0; i < 2; i++) {
+        LayerManager layers;
+        layers.SetBlendSpace(spaces[i]);
+        AddNoiseLayers(layers, width, height, 3, BlendMode::Normal);
+        double seconds = TimeComposite(layers, width, height, 5);
+        if (i == 0) srgb = seconds;
+        std::printf("%-12s%14.0f%10.1f%13.2fx\n", names[i], static_cast<double>(width) * height / seconds / 1e6,
+                    seconds * 1e3, seconds / srgb);
+        std::fflush(stdout);
+    }
+}
+
+// Every storage format against RGBA8, sRGB at 4K over 3 layers, for Normal
+// and a mode without a fixed-point path
+void RunFormatsBench() {
+    const uint32_t width = 3840, height = 2160;
+    const PixelFormat formats[] = {PixelFormat::RGBA8, PixelFormat::RGBA16, PixelFormat::RGBA16F,
+                                   PixelFormat::RGBA32F};
+    const char* const names[] = {"RGBA8", "RGBA16", "RGBA16F", "RGBA32F"};
+    std::printf("ms per composite at 4K, 3 layers (vs RGBA8 in brackets)\n%-10s%20s%20s\n", "", "Normal",
+                "Multiply");
+    double baseline[2] = {};
+    for (int i = 0; i < 4; i++) {
+        std::printf("%-10s", names[i]);
+        const BlendMode modes[] = {BlendMode::Normal, BlendMode::Multiply};
+        for (int m = 0; m < 2; m++) {
+            LayerManager layers;
+            layers.SetPixelFormat(formats[i]);
+            AddNoiseLayers(layers, width, height, 3, modes[m]);
+            double seconds = TimeComposite(layers, width, height, 5);
+            if (i == 0) baseline[m] = seconds;
+            std::printf("%12.1f (%4.2fx)", seconds * 1e3, seconds / baseline[m]);
+            std::fflush(stdout);
+        }
+        std::printf("\n");
+    }
+}
@@ -0,0 +1,92 @@
+// PixelOps primitives at every dispatch level, on a row that stays in L1 so
+// the kernels are measured rather than memory
+#include "BenchUtil.h"
+#include "Core/Math/PixelOps.h"
+#include "Core/Memory/PixelFormat.h"
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+
+static constexpr size_t ROW_PIXELS = 2048;
+static constexpr int REPEATS = 512;
+
+void RunPixelOpsBench() {
+    std::mt19937 rng(7);
+    std::vector<uint8_t> src(ROW_PIXELS * 4), dst(ROW_PIXELS * 4), mask(ROW_PIXELS);
+    for (uint8_t& v : src) v = static_cast<uint8_t>(rng());
+    for (uint8_t& v : mask) v = static_cast<uint8_t>(rng());
+    for (size_t i = 0; i < ROW_PIXELS; i++) {
+        for (int c = 0; c < 3; c++) dst[i * 4 + c] = std::min(dst[i * 4 + c], src[i * 4 + 3]);
+    }
+    std::vector<uint8_t> premultiplied(src.size());
+    std::vector<float> floats(ROW_PIXELS * 4), floatsOut(ROW_PIXELS * 4), planeData(ROW_PIXELS * 4);
+    for (float& v : floats) v = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+    std::vector<Half> halves(ROW_PIXELS * 4);
+    std::vector<float> table(258);
+    for (size_t i = 0; i < table.size(); i++) table[i] = std::sqrt(std::min(i, size_t(256)) / 256.0f);
+    float* const planes[4] = {planeData.data(), planeData.data() + ROW_PIXELS, planeData.data() + ROW_PIXELS * 2,
+                              planeData.data() + ROW_PIXELS * 3};
+    const float* const constPlanes[4] = {planes[0], planes[1], planes[2], planes[3]};
+    PixelOps::Premultiply(premultiplied.data(), src.data(), ROW_PIXELS);
+    std::vector<uint16_t> wide(ROW_PIXELS * 4), wideDst(ROW_PIXELS * 4), wideTable(256);
+    for (size_t i = 0; i < 256; i++) wideTable[i] = static_cast<uint16_t>(i * 257);
+    PixelOps::LookupRGBA8ToU16(wide.data(), premultiplied.data(), ROW_PIXELS, wideTable.data());
+    std::vector<uint8_t> encodeTable(4096 + 3);
+    for (size_t i = 0; i < 4096; i++) encodeTable[i] = static_cast<uint8_t>(i / 16);
+
+    struct Primitive {
+        const char* name;
+        std::function<void()> run;
+    };
+    const size_t n = ROW_PIXELS;
+    const Primitive primitives[] = {
+        {"Fill", [&] { PixelOps::Fill(dst.data(), n, 1, 2, 3, 4); }},
+        {"SwizzleRB", [&] { PixelOps::SwizzleRB(dst.data(), src.data(), n); }},
+        {"Premultiply", [&] { PixelOps::Premultiply(dst.data(), src.data(), n); }},
+        {"Unpremultiply", [&] { PixelOps::Unpremultiply(dst.data(), premultiplied.data(), n); }},
+        {"AlphaOver", [&] { PixelOps::AlphaOver(dst.data(), premultiplied.data(), n); }},
+        {"AlphaOverStraight", [&] { PixelOps::AlphaOverStraight(dst.data(), src.data(), n, 230); }},
+        {"AlphaOverStraightMasked", [&] { PixelOps::AlphaOverStraightMasked(dst.data(), src.data(), mask.data(), n, 230); }},
+        {"AlphaOverStraight16", [&] { PixelOps::AlphaOverStraight16(wideDst.data(), wide.data(), n, 51400); }},
+        {"EncodeLinear16", [&] { PixelOps::EncodeLinear16(dst.data(), wide.data(), n, encodeTable.data(), 4096); }},
+        {"ConvertU8ToF32", [&] { PixelOps::ConvertU8ToF32(floatsOut.data(), src.data(), n * 4); }},
+        {"ConvertF32ToU8", [&] { PixelOps::ConvertF32ToU8(dst.data(), floats.data(), n * 4); }},
+        {"ConvertU16ToF32", [&] { PixelOps::ConvertU16ToF32(floatsOut.data(), wide.data(), n * 4); }},
+        {"ConvertF32ToU16", [&] { PixelOps::ConvertF32ToU16(wideDst.data(), floats.data(), n * 4); }},
+        {"ConvertF32ToF16", [&] { PixelOps::ConvertF32ToF16(halves.data(), floats.data(), n * 4); }},
+        {"ConvertF16ToF32", [&] { PixelOps::ConvertF16ToF32(floatsOut.data(), halves.data(), n * 4); }},
+        {"Deinterleave", [&] { PixelOps::Deinterleave(planes, floats.data(), n); }},
+        {"Interleave", [&] { PixelOps::Interleave(floatsOut.data(), constPlanes, n); }},
+        {"LookupRGBA8ToF32", [&] { PixelOps::LookupRGBA8ToF32(floatsOut.data(), src.data(), n, table.data()); }},
+        {"LookupRGBA8ToU16", [&] { PixelOps::LookupRGBA8ToU16(wide.data(), src.data(), n, wideTable.data()); }},
+        {"InterpolateF32", [&] { PixelOps::InterpolateF32(floatsOut.data(), floats.data(), n * 4, table.data(), 256); }},
+    };
+
+    SimdLevel supported = PixelOps::GetSupportedLevel();
+    std::printf("Mpixels/s over a %zu-pixel row (speed-up over Scalar in brackets)\n%-24s", ROW_PIXELS, "");
+    for (int level = 0; level <= static_cast<int>(supported); level++) {
+        std::printf("%16s", PixelOps::GetLevelName(static_cast<SimdLevel>(level)));
+    }
+    std::printf("\n");
+
+    for (const Primitive& primitive : primitives) {
+        std::printf("%-24s", primitive.name);
+        double scalar = 0.0;
+        for (int level = 0; level <= static_cast<int>(supported); level++) {
+            PixelOps::SetLevel(static_cast<SimdLevel>(level));
+            double seconds = TimeBest([&] {
+                for (int r = 0; r < REPEATS; r++) primitive.run();
+            });
+            double rate = ROW_PIXELS * REPEATS / seconds / 1e6;
+            if (level == 0) {
+                scalar = rate;
+                std::printf("%16.0f", rate);
+            } else {
+                std::printf("%9.0f (%4.1fx)", rate, rate / scalar);
+            }
+        }
+        std::printf("\n");
+    }
+    PixelOps::SetLevel(supported);
+}
@@ -0,0 +1,247 @@
+#pragma once
+#include "LayerManager.h"
+#include "../Memory/PixelFormat.h"
+#include "../Math/ColorSpace.h"
+#include "../Math/PixelOps.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+// Compositing row kernels specialized per BlendMode. The mode is a template
+// argument, so the per-pixel loop has no switch; DispatchBlendMode picks the
+// instantiation once per layer.
+//
+// Separable blend model (W3C Compositing): with source alpha as, backdrop
+// alpha ab, straight colors Cs/Cb and blend function B,
+//   co = (1 - ab) * as * Cs + as * ab * B(Cb, Cs) + (1 - as) * ab * Cb
+//   ao = as + ab * (1 - as)
+// where co is premultiplied. Normal (B = Cs) reduces to plain source-over.
+
+// The helpers below keep blend math free of branches so span loops
+// vectorize: compilers won't if-convert a select between results of float
+// math (it may trap), so selects only ever pick between constants.
+
+// Makes a non-negative divisor safe: 0 becomes a tiny positive value
+inline float BlendDivisor(float x) {
+    return x + (x > 0.0f ? 0.0f : 1.0f / 65536.0f);
+}
+
+// Picks a side of a piecewise function by weight
+inline float BlendSelect(bool condition, float ifTrue, float ifFalse) {
+    float weight = condition ? 1.0f : 0.0f;
+    return ifFalse + weight * (ifTrue - ifFalse);
+}
+
+// Pixels per span: the float planes of a span stay in L1
+constexpr uint32_t BLEND_CHUNK = 64;
+
+template<BlendMode Mode>
+inline float BlendChannel(float cb, float cs) {
+    if constexpr (Mode == BlendMode::Normal) {
+        return cs;
+    } else if constexpr (Mode == BlendMode::Multiply) {
+        return cb * cs;
+    } else if constexpr (Mode == BlendMode::Screen) {
+        return cb + cs - cb * cs;
+    } else if constexpr (Mode == BlendMode::Overlay) {
+        // HardLight with the layers swapped
+        return BlendChannel<BlendMode::HardLight>(cs, cb);
+    } else if constexpr (Mode == BlendMode::HardLight) {
+        float multiply = cb * 2.0f * cs;
+        float screen = BlendChannel<BlendMode::Screen>(cb, 2.0f * cs - 1.0f);
+        return BlendSelect(cs <= 0.5f, multiply, screen);
+    } else if constexpr (Mode == BlendMode::SoftLight) {
+        float d = BlendSelect(cb <= 0.25f, ((16.0f * cb - 12.0f) * cb + 4.0f) * cb, std::sqrt(cb));
+        float darken = cb - (1.0f - 2.0f * cs) * cb * (1.0f - cb);
+        float lighten = cb + (2.0f * cs - 1.0f) * (d - cb);
+        return BlendSelect(cs <= 0.5f, darken, lighten);
+    } else if constexpr (Mode == BlendMode::ColorDodge) {
+        // cb = 0 gives 0 and cs = 1 gives 1, as in the reference definition
+        // (min(cb / divisor, 1) with the clamp ahead of the division)
+        float divisor = BlendDivisor(1.0f - cs);
+        return std::min(cb, divisor) / divisor;
+    } else if constexpr (Mode == BlendMode::ColorBurn) {
+        // cb = 1 gives 1 and cs = 0 gives 0
+        float divisor = BlendDivisor(cs);
+        return 1.0f - std::min(1.0f - cb, divisor) / divisor;
+    } else if constexpr (Mode == BlendMode::Darken) {
+        return std::min(cb, cs);
+    } else if constexpr (Mode == BlendMode::Lighten) {
+        return std::max(cb, cs);
+    } else if constexpr (Mode == BlendMode::Difference) {
+        return std::fabs(cb - cs);
+    } else {
+        static_assert(Mode == BlendMode::Exclusion, "unhandled blend mode");
+        return cb + cs - 2.0f * cb * cs;
+    }
+}
+
+// Calls fn with a std::integral_constant<BlendMode, mode>
+template<typename Fn>
+decltype(auto) DispatchBlendMode(BlendMode mode, Fn&& fn) {
+    switch (mode) {
+        case BlendMode::Multiply:   return fn(std::integral_constant<BlendMode, BlendMode::Multiply>{});
+        case BlendMode::Screen:     return fn(std::integral_constant<BlendMode, BlendMode::Screen>{});
+        case BlendMode::Overlay:    return fn(std::integral_constant<BlendMode, BlendMode::Overlay>{});
+        case BlendMode::SoftLight:  return fn(std::integral_constant<BlendMode, BlendMode::SoftLight>{});
+        case BlendMode::HardLight:  return fn(std::integral_constant<BlendMode, BlendMode::HardLight>{});
+        case BlendMode::ColorDodge: return fn(std::integral_constant<BlendMode, BlendMode::ColorDodge>{});
+        case BlendMode::ColorBurn:  return fn(std::integral_constant<BlendMode, BlendMode::ColorBurn>{});
+        case BlendMode::Darken:     return fn(std::integral_constant<BlendMode, BlendMode::Darken>{});
+        case BlendMode::Lighten:    return fn(std::integral_constant<BlendMode, BlendMode::Lighten>{});
+        case BlendMode::Difference: return fn(std::integral_constant<BlendMode, BlendMode::Difference>{});
+        case BlendMode::Exclusion:  return fn(std::integral_constant<BlendMode, BlendMode::Exclusion>{});
+        case BlendMode::Normal:
+        default:                    return fn(std::integral_constant<BlendMode, BlendMode::Normal>{});
+    }
+}
+
+// Blends a span of planar floats: straight source s onto premultiplied
+// backdrop d, in place. The source alpha is scaled by opacity and, if there
+// is one, the 8-bit mask. One channel per loop, so each loop vectorizes.
+template<BlendMode Mode>
+void BlendSpanPremultiplied(float* const d[4], const float* const s[4], const uint8_t* mask, uint32_t count,
+                            float opacity) {
+    float as[BLEND_CHUNK];
+    float unpremultiply[BLEND_CHUNK];
+    const float* srcAlpha = s[3];
+    float* dstAlpha = d[3];
+    for (uint32_t i = 0; i < count; i++) {
+        as[i] = srcAlpha[i] * opacity;
+    }
+    if constexpr (Mode != BlendMode::Normal) {
+        for (uint32_t i = 0; i < count; i++) {
+            // Premultiplied color is 0 wherever alpha is, so this only avoids 0/0
+            unpremultiply[i] = 1.0f / BlendDivisor(dstAlpha[i]);
+        }
+    }
+    if (mask) {
+        for (uint32_t i = 0; i < count; i++) {
+            as[i] *= static_cast<float>(mask[i]) * (1.0f / 255.0f);
+        }
+    }
+
+    for (int c = 0; c < 3; c++) {
+        const float* srcColor = s[c];
+        float* dstColor = d[c];
+        for (uint32_t i = 0; i < count; i++) {
+            float ab = dstAlpha[i];
+            float cs = srcColor[i];
+            float blended = cs;
+            if constexpr (Mode != BlendMode::Normal) {
+                blended = BlendChannel<Mode>(dstColor[i] * unpremultiply[i], cs);
+            }
+            dstColor[i] = (1.0f - ab) * as[i] * cs + as[i] * ab * blended + (1.0f - as[i]) * dstColor[i];
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        dstAlpha[i] = as[i] + dstAlpha[i] - as[i] * dstAlpha[i];
+    }
+}
+
+// Channels of a format to floats 0..1 and back (count in pixels), through
+// the PixelOps kernels where the format has them
+template<typename Traits>
+inline void DecodeSpan(float* dst, const typename Traits::Channel* src, uint32_t count) {
+    if constexpr (Traits::FORMAT == PixelFormat::RGBA8) {
+        PixelOps::ConvertU8ToF32(dst, src, count * 4);
+    } else if constexpr (Traits::FORMAT == PixelFormat::RGBA16) {
+        PixelOps::ConvertU16ToF32(dst, src, count * 4);
+    } else if constexpr (Traits::FORMAT == PixelFormat::RGBA16F) {
+        PixelOps::ConvertF16ToF32(dst, src, count * 4);
+    } else {
+        for (uint32_t i = 0; i < count * 4; i++) dst[i] = Traits::ToFloat(src[i]);
+    }
+}
+
+template<typename Traits>
+inline void EncodeSpan(typename Traits::Channel* dst, const float* src, uint32_t count) {
+    if constexpr (Traits::FORMAT == PixelFormat::RGBA8) {
+        PixelOps::ConvertF32ToU8(dst, src, count * 4);
+    } else if constexpr (Traits::FORMAT == PixelFormat::RGBA16) {
+        PixelOps::ConvertF32ToU16(dst, src, count * 4);
+    } else if constexpr (Traits::FORMAT == PixelFormat::RGBA16F) {
+        PixelOps::ConvertF32ToF16(dst, src, count * 4);
+    } else {
+        for (uint32_t i = 0; i < count * 4; i++) dst[i] = Traits::FromFloat(src[i]);
+    }
+}
+
+// Straight-alpha source row of any format onto a premultiplied accumulator
+// (RGBA8, RGBA16 or RGBA32F, per Accumulator; Normal on the integer ones
+// mostly goes through the fixed-point PixelOps kernels instead). Spans are
+// widened and transposed to planes with the PixelOps kernels. In linear
+// light (LINEAR) source color is decoded per span as well: 8-bit codes
+// through SRGB8_TO_LINEAR, other formats through the interpolated tables;
+// alpha is linear already.
+template<BlendMode Mode, typename Traits, typename Accumulator, bool LINEAR>
+void BlendRowPremultiplied(uint8_t* dstRow, const uint8_t* srcRow, const uint8_t* mask, uint32_t count,
+                           float opacity) {
+    using Channel = typename Traits::Channel;
+    using AccumulatorChannel = typename Accumulator::Channel;
+    constexpr bool FLOAT_ACCUMULATOR = Accumulator::FORMAT == PixelFormat::RGBA32F;
+    alignas(64) float staging[BLEND_CHUNK * 4];
+    alignas(64) float srcPlanes[4][BLEND_CHUNK];
+    alignas(64) float dstPlanes[4][BLEND_CHUNK];
+    float* const s[4] = {srcPlanes[0], srcPlanes[1], srcPlanes[2], srcPlanes[3]};
+    float* const d[4] = {dstPlanes[0], dstPlanes[1], dstPlanes[2], dstPlanes[3]};
+    AccumulatorChannel* dst = reinterpret_cast<AccumulatorChannel*>(dstRow);
+    const Channel* src = reinterpret_cast<const Channel*>(srcRow);
+
+    for (uint32_t x = 0; x < count; x += BLEND_CHUNK) {
+        uint32_t n = std::min(BLEND_CHUNK, count - x);
+        AccumulatorChannel* span = dst + x * 4;
+        if constexpr (LINEAR && Traits::FORMAT == PixelFormat::RGBA8) {
+            PixelOps::LookupRGBA8ToF32(staging, src + x * 4, n, SRGB8_TO_LINEAR.data());
+            PixelOps::Deinterleave(s, staging, n);
+        } else if constexpr (Traits::FORMAT == PixelFormat::RGBA32F) {
+            PixelOps::Deinterleave(s, src + x * 4, n);
+        } else {
+            DecodeSpan<Traits>(staging, src + x * 4, n);
+            PixelOps::Deinterleave(s, staging, n);
+        }
+        if constexpr (LINEAR && Traits::FORMAT != PixelFormat::RGBA8) {
+            for (int c = 0; c < 3; c++) ColorSpace::SRGBToLinear(srcPlanes[c], srcPlanes[c], n);
+        }
+        if constexpr (FLOAT_ACCUMULATOR) {
+            PixelOps::Deinterleave(d, span, n);
+        } else {
+            DecodeSpan<Accumulator>(staging, span, n);
+            PixelOps::Deinterleave(d, staging, n);
+        }
+
+        BlendSpanPremultiplied<Mode>(d, s, mask ? mask + x : nullptr, n, opacity);
+
+        if constexpr (FLOAT_ACCUMULATOR) {
+            PixelOps::Interleave(span, d, n);
+        } else {
+            PixelOps::Interleave(staging, d, n);
+            EncodeSpan<Accumulator>(span, staging, n);
+        }
+    }
+}
+
+// Normal from an RGBA8 source onto the premultiplied 16-bit linear-light
+// accumulator of RGBA8 documents, in integers: spans decode through
+// SRGB8_TO_LINEAR16 (the mask scaling alpha) and blend with
+// PixelOps::AlphaOverStraight16, with opacity rounded to 16 bits.
+inline void BlendRowLinearNormal8(uint8_t* dstRow, const uint8_t* srcRow, const uint8_t* mask, uint32_t count,
+                                  float opacity) {
+    alignas(64) uint16_t staging[BLEND_CHUNK * 4];
+    uint16_t alpha = static_cast<uint16_t>(std::clamp(opacity, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    uint16_t* dst = reinterpret_cast<uint16_t*>(dstRow);
+
+    for (uint32_t x = 0; x < count; x += BLEND_CHUNK) {
+        uint32_t n = std::min(BLEND_CHUNK, count - x);
+        PixelOps::LookupRGBA8ToU16(staging, srcRow + x * 4, n, SRGB8_TO_LINEAR16.data());
+        if (mask) {
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t coverage = mask[x + i] * 257u;
+                staging[i * 4 + 3] = static_cast<uint16_t>(PixelOps::Div65535(staging[i * 4 + 3] * coverage));
+            }
+        }
+        PixelOps::AlphaOverStraight16(dst + x * 4, staging, n, alpha);
+    }
+}
@@ -0,0 +1,147 @@
+#include "ColorProgram.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Rec. 709 luma weights, the gray axis hue rotates around
+static constexpr float LUMA_R = 0.213f;
+static constexpr float LUMA_G = 0.715f;
+static constexpr float LUMA_B = 0.072f;
+
+static uint64_t CombineHash(uint64_t hash, uint64_t value) {
+    return hash ^ (value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2));
+}
+
+// Written so NaN maps to 0
+static float Clamp01(float x) {
+    x = x > 0.0f ? x : 0.0f;
+    return x < 1.0f ? x : 1.0f;
+}
+
+static float EvaluateCurve(const float* curve, float x) {
+    float t = Clamp01(x) * static_cast<float>(ColorProgram::CURVE_SIZE);
+    uint32_t i = std::min(static_cast<uint32_t>(t), ColorProgram::CURVE_SIZE - 1);
+    float f = t - static_cast<float>(i);
+    return curve[i] + (curve[i + 1] - curve[i]) * f;
+}
+
+void ColorProgram::Append(const Adjustment& adjustment) {
+    uint32_t amountBits = 0;
+    std::memcpy(&amountBits, &adjustment.amount, sizeof(amountBits));
+    hash_ = CombineHash(hash_, static_cast<uint64_t>(adjustment.type));
+    hash_ = CombineHash(hash_, amountBits);
+
+    float amount = std::max(-1.0f, std::min(1.0f, adjustment.amount));
+    switch (adjustment.type) {
+        case AdjustmentType::Brightness:
+        case AdjustmentType::Contrast: {
+            // Contrast at +1 would be a step; stop just short of it
+            float factor = adjustment.type == AdjustmentType::Brightness
+                ? 1.0f + amount
+                : (1.0f + amount) / (1.0f - std::min(amount, 0.999f));
+            float midpoint = adjustment.type == AdjustmentType::Brightness ? 0.0f : 0.5f;
+            std::vector<float> curve(CURVE_SIZE + 1);
+            for (uint32_t i = 0; i <= CURVE_SIZE; i++) {
+                float x = static_cast<float>(i) / CURVE_SIZE;
+                curve[i] = Clamp01((x - midpoint) * factor + midpoint);
+            }
+            AppendCurve(curve);
+            break;
+        }
+        case AdjustmentType::Hue: {
+            float angle = amount * 2.0f * 3.14159265358979f;
+            float c = std::cos(angle);
+            float s = std::sin(angle);
+            const float matrix[12] = {
+                LUMA_R + c * (1.0f - LUMA_R) - s * LUMA_R, LUMA_G - c * LUMA_G - s * LUMA_G, LUMA_B - c * LUMA_B + s * (1.0f - LUMA_B), 0.0f,
+                LUMA_R - c * LUMA_R + s * 0.143f,          LUMA_G + c * (1.0f - LUMA_G) + s * 0.140f, LUMA_B - c * LUMA_B - s * 0.283f, 0.0f,
+                LUMA_R - c * LUMA_R - s * (1.0f - LUMA_R), LUMA_G - c * LUMA_G + s * LUMA_G, LUMA_B + c * (1.0f - LUMA_B) + s * LUMA_B, 0.0f,
+            };
+            AppendMatrix(matrix);
+            break;
+        }
+        case AdjustmentType::Saturation: {
+            float s = 1.0f + amount;
+            const float matrix[12] = {
+                LUMA_R + (1.0f - LUMA_R) * s, LUMA_G - LUMA_G * s,          LUMA_B - LUMA_B * s,          0.0f,
+                LUMA_R - LUMA_R * s,          LUMA_G + (1.0f - LUMA_G) * s, LUMA_B - LUMA_B * s,          0.0f,
+                LUMA_R - LUMA_R * s,          LUMA_G - LUMA_G * s,          LUMA_B + (1.0f - LUMA_B) * s, 0.0f,
+            };
+            AppendMatrix(matrix);
+            break;
+        }
+    }
+}
+
+void ColorProgram::Append(const ColorProgram& other) {
+    hash_ = CombineHash(hash_, other.hash_);
+    for (const Stage& stage : other.stages_) {
+        if (stage.curve.empty()) {
+            AppendMatrix(stage.matrix);
+        } else {
+            AppendCurve(stage.curve);
+        }
+    }
+}
+
+// A curve after a curve samples the first through the second
+void ColorProgram::AppendCurve(const std::vector<float>& curve) {
+    if (!stages_.empty() && !stages_.back().curve.empty()) {
+        for (float& sample : stages_.back().curve) {
+            sample = EvaluateCurve(curve.data(), sample);
+        }
+        return;
+    }
+    Stage stage;
+    stage.curve = curve;
+    stages_.push_back(std::move(stage));
+}
+
+// A matrix after a matrix multiplies into it (the clamp then happens once
+// for both)
+void ColorProgram::AppendMatrix(const float (&matrix)[12]) {
+    if (!stages_.empty() && stages_.back().curve.empty()) {
+        float* previous = stages_.back().matrix;
+        float product[12];
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 4; col++) {
+                float sum = col == 3 ? matrix[row * 4 + 3] : 0.0f;
+                for (int k = 0; k < 3; k++) {
+                    sum += matrix[row * 4 + k] * previous[k * 4 + col];
+                }
+                product[row * 4 + col] = sum;
+            }
+        }
+        std::memcpy(previous, product, sizeof(product));
+        return;
+    }
+    Stage stage;
+    std::memcpy(stage.matrix, matrix, sizeof(stage.matrix));
+    stages_.push_back(std::move(stage));
+}
+
+void ColorProgram::Apply(float* const planes[3], uint32_t count) const {
+    float* r = planes[0];
+    float* g = planes[1];
+    float* b = planes[2];
+    for (const Stage& stage : stages_) {
+        if (!stage.curve.empty()) {
+            const float* curve = stage.curve.data();
+            for (int c = 0; c < 3; c++) {
+                float* plane = planes[c];
+                for (uint32_t i = 0; i < count; i++) {
+                    plane[i] = EvaluateCurve(curve, plane[i]);
+                }
+            }
+            continue;
+        }
+
+        const float* m = stage.matrix;
+        for (uint32_t i = 0; i < count; i++) {
+            float r0 = r[i], g0 = g[i], b0 = b[i];
+            r[i] = Clamp01(m[0] * r0 + m[1] * g0 + m[2] * b0 + m[3]);
+            g[i] = Clamp01(m[4] * r0 + m[5] * g0 + m[6] * b0 + m[7]);
+            b[i] = Clamp01(m[8] * r0 + m[9] * g0 + m[10] * b0 + m[11]);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Parameters of one non-destructive color adjustment. Amounts run -1..1 as
+// in ColorEngine: brightness scales by 1 + amount, contrast stretches around
+// mid-gray, hue rotates by amount * 360 degrees, saturation scales chroma by
+// 1 + amount.
+enum class AdjustmentType {
+    Brightness,
+    Contrast,
+    Hue,
+    Saturation
+};
+
+struct Adjustment {
+    AdjustmentType type = AdjustmentType::Brightness;
+    float amount = 0.0f;
+};
+
+// A run of adjustments compiled for the compositor. Per-channel adjustments
+// (brightness, contrast) become a sampled curve and color-mixing ones (hue,
+// saturation) a 3x4 matrix; consecutive curves fold into one table and
+// consecutive matrices into one product, so a run of any length is usually
+// one or two stages. Hue and saturation use the luminance-preserving
+// matrices (as in SVG's feColorMatrix), not ColorEngine's HSL round trip.
+class ColorProgram {
+public:
+    // Adds an adjustment after the ones already compiled
+    void Append(const Adjustment& adjustment);
+    // Adds another program's stages after these
+    void Append(const ColorProgram& other);
+
+    bool IsEmpty() const { return stages_.empty(); }
+    size_t GetStageCount() const { return stages_.size(); }
+
+    // Identifies the compiled transform: equal hashes give equal output
+    uint64_t GetHash() const { return hash_; }
+
+    // Runs the program in place over count pixels of straight-alpha color
+    // planes (r, g, b in 0..1). Results are clamped to 0..1.
+    void Apply(float* const planes[3], uint32_t count) const;
+
+    // Curve samples over 0..1 (evaluated with linear interpolation)
+    static constexpr uint32_t CURVE_SIZE = 1024;
+
+private:
+    struct Stage {
+        std::vector<float> curve; // CURVE_SIZE + 1 samples, or empty for a matrix stage
+        float matrix[12];         // Row-major 3x4: rgb' = M * (r, g, b, 1)
+    };
+
+    void AppendCurve(const std::vector<float>& curve);
+    void AppendMatrix(const float (&matrix)[12]);
+
+    std::vector<Stage> stages_;
+    uint64_t hash_ = 0;
+};
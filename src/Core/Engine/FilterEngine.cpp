@@ -1,5 +1,6 @@
 #include "FilterEngine.h"
 #include "../../Filters/FilterBase.h"
+#include "../Memory/ScratchArena.h"
 
 FilterEngine::FilterEngine() {
 }
@@ -11,15 +12,53 @@ bool FilterEngine::ApplyFilter(FilterBase* filter, BufferManager::Buffer& buffer
     if (!filter || !filter->CanApply(buffer)) {
         return false;
     }
+
+    // Scratch memory the filter takes is released when it returns
+    ScratchScope scratch;
     return filter->Apply(buffer);
 }
 
 bool FilterEngine::ApplyFilters(const std::vector<FilterBase*>& filters, BufferManager::Buffer& buffer) {
-    for (FilterBase* filter : filters) {
-        if (!ApplyFilter(filter, buffer)) {
+    for (size_t i = 0; i < filters.size();) {
+        // Consecutive planar filters share one transpose
+        size_t end = i;
+        while (end < filters.size() && dynamic_cast<PlanarFilter*>(filters[end])) {
+            end++;
+        }
+
+        if (end - i < 2) {
+            if (!ApplyFilter(filters[i], buffer)) {
+                return false;
+            }
+            i++;
+            continue;
+        }
+
+        if (!ApplyPlanarFilters(filters.data() + i, end - i, buffer)) {
             return false;
         }
+        i = end;
     }
     return true;
 }
 
+bool FilterEngine::ApplyPlanarFilters(FilterBase* const* filters, size_t count, BufferManager::Buffer& buffer) {
+    for (size_t i = 0; i < count; i++) {
+        if (!filters[i]->CanApply(buffer)) return false;
+    }
+
+    BufferManager::PlanarBuffer planes = BufferManager::CreatePlanar(buffer.width, buffer.height);
+    BufferManager::ToPlanar(BufferManager::GetView(buffer), planes);
+
+    // Filters that ran keep their result, as with one-at-a-time application
+    bool applied = true;
+    for (size_t i = 0; i < count && applied; i++) {
+        ScratchScope scratch;
+        applied = static_cast<PlanarFilter*>(filters[i])->ApplyPlanar(planes);
+    }
+
+    BufferManager::FromPlanar(planes, BufferManager::GetView(buffer));
+    BufferManager::Destroy(planes);
+    return applied;
+}
+
@@ -15,5 +15,9 @@ public:
     
     // Batch apply multiple filters
     bool ApplyFilters(const std::vector<FilterBase*>& filters, BufferManager::Buffer& buffer);
+
+private:
+    // Run of PlanarFilters on one planar copy of the buffer
+    bool ApplyPlanarFilters(FilterBase* const* filters, size_t count, BufferManager::Buffer& buffer);
 };
 
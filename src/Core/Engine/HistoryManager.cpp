@@ -1,20 +1,35 @@
 #include "HistoryManager.h"
 
 HistoryManager::HistoryManager(size_t maxStates) : maxStates_(maxStates) {
+    governorId_ = MemoryGovernor::GetInstance().Register("History", MemoryGovernor::PRIORITY_HISTORY,
+        [this] { return GetMemoryUsage(); },
+        [this](size_t bytes) { return Trim(bytes); });
 }
 
 HistoryManager::~HistoryManager() {
+    MemoryGovernor::GetInstance().Unregister(governorId_);
     Clear();
 }
 
-void HistoryManager::PushState(const std::string& description, const BufferManager::Buffer& buffer, size_t layerIndex) {
+void HistoryManager::PushState(const std::string& description, const TiledImage& pixels, size_t layerIndex) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        AddState(description, pixels, layerIndex);
+    }
+
+    // Snapshots stop sharing tiles as the layer is edited; over budget,
+    // the oldest undo steps go first
+    MemoryGovernor::GetInstance().Check();
+}
+
+void HistoryManager::AddState(const std::string& description, const TiledImage& pixels, size_t layerIndex) {
     // Remove any states after current index (when undoing then making new change)
     if (currentIndex_ < states_.size()) {
         states_.erase(states_.begin() + currentIndex_ + 1, states_.end());
     }
     
     // Add new state
-    states_.push_back(std::make_unique<HistoryState>(description, buffer, layerIndex));
+    states_.push_back(std::make_unique<HistoryState>(description, pixels, layerIndex));
     currentIndex_ = states_.size() - 1;
     
     // Limit history size
@@ -24,20 +39,50 @@ void HistoryManager::PushState(const std::string& description, const BufferManag
     }
 }
 
+void HistoryManager::PushState(const std::string& description, const BufferManager::Buffer& buffer, size_t layerIndex) {
+    TiledImage pixels(buffer.width, buffer.height, buffer.format);
+    pixels.Assign(buffer);
+    PushState(description, pixels, layerIndex);
+}
+
 HistoryManager::HistoryState* HistoryManager::Undo() {
+    std::lock_guard<std::mutex> lock(mutex_);
     if (!CanUndo()) return nullptr;
     currentIndex_--;
     return states_[currentIndex_].get();
 }
 
 HistoryManager::HistoryState* HistoryManager::Redo() {
+    std::lock_guard<std::mutex> lock(mutex_);
     if (!CanRedo()) return nullptr;
     currentIndex_++;
     return states_[currentIndex_].get();
 }
 
 void HistoryManager::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
     states_.clear();
     currentIndex_ = 0;
 }
 
+size_t HistoryManager::GetMemoryUsage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t bytes = 0;
+    for (const auto& state : states_) {
+        bytes += state->snapshot.GetResidentBytes();
+    }
+    return bytes;
+}
+
+size_t HistoryManager::Trim(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t freed = 0;
+    while (freed < bytes && currentIndex_ > 0) {
+        // Only tiles no other state or layer references are actually freed
+        freed += states_.front()->snapshot.GetUniqueBytes();
+        states_.erase(states_.begin());
+        currentIndex_--;
+    }
+    return freed;
+}
+
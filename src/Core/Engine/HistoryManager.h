@@ -1,29 +1,29 @@
 #pragma once
 #include "../Memory/BufferManager.h"
+#include "../Memory/TiledImage.h"
+#include "../Memory/MemoryGovernor.h"
 #include <string>
 #include <vector>
 #include <memory>
 #include <functional>
+#include <mutex>
 
 // Undo/Redo system
 class HistoryManager {
 public:
     struct HistoryState {
         std::string description;
-        BufferManager::Buffer snapshot;
+        TiledImage snapshot; // Shares tiles with the layer until either side is edited
         size_t layerIndex;
         
-        HistoryState(const std::string& desc, const BufferManager::Buffer& buf, size_t layerIdx)
-            : description(desc), snapshot(BufferManager::Clone(buf)), layerIndex(layerIdx) {}
-        
-        ~HistoryState() {
-            BufferManager::Destroy(snapshot);
-        }
+        HistoryState(const std::string& desc, const TiledImage& pixels, size_t layerIdx)
+            : description(desc), snapshot(pixels), layerIndex(layerIdx) {}
     };
 
     HistoryManager(size_t maxStates = 50);
     ~HistoryManager();
 
+    void PushState(const std::string& description, const TiledImage& pixels, size_t layerIndex);
     void PushState(const std::string& description, const BufferManager::Buffer& buffer, size_t layerIndex);
     bool CanUndo() const { return currentIndex_ > 0; }
     bool CanRedo() const { return currentIndex_ < states_.size() - 1; }
@@ -35,9 +35,19 @@ public:
     size_t GetStateCount() const { return states_.size(); }
     size_t GetCurrentIndex() const { return currentIndex_; }
 
+    // Memory governor hooks: heap bytes held by snapshots, and dropping the
+    // oldest undo states until at least bytes are freed (the current state
+    // and redo states are kept)
+    size_t GetMemoryUsage() const;
+    size_t Trim(size_t bytes);
+
 private:
+    void AddState(const std::string& description, const TiledImage& pixels, size_t layerIndex);
+
     std::vector<std::unique_ptr<HistoryState>> states_;
     size_t currentIndex_ = 0;
     size_t maxStates_;
+    MemoryGovernor::ConsumerId governorId_ = 0;
+    mutable std::mutex mutex_;
 };
 
@@ -1,6 +1,10 @@
 #include "ImageEngine.h"
 #include "../FileIO/FileManager.h"
 #include "../Filters/FilterBase.h"
+#include "../Memory/MemoryGovernor.h"
+#include "../Memory/ScratchArena.h"
+#include "../../Utils/Config.h"
+#include <algorithm>
 
 ImageEngine::ImageEngine() {
 }
@@ -8,13 +12,28 @@ ImageEngine::ImageEngine() {
 ImageEngine::~ImageEngine() {
 }
 
-bool ImageEngine::CreateNew(uint32_t width, uint32_t height, const std::string& name) {
+bool ImageEngine::CreateNew(uint32_t width, uint32_t height, const std::string& name, PixelFormat format) {
     width_ = width;
     height_ = height;
     name_ = name;
     
+    // Documents above the threshold page their pixels to a scratch file
+    // instead of the swap file
+    Config& config = Config::GetInstance();
+    uint64_t layerBytes = static_cast<uint64_t>(width) * height * BytesPerPixel(format);
+    uint64_t threshold = static_cast<uint64_t>(config.GetInt("OutOfCoreThresholdMB", 1024)) << 20;
+    std::string scratchDirectory = config.GetString("ScratchDirectory");
+    if (!scratchDirectory.empty()) {
+        MappedArena::SetDirectory(scratchDirectory);
+    }
+
+    layerManager_.SetPixelFormat(format);
+    layerManager_.SetStorage(layerBytes >= threshold ? BufferManager::Storage::Mapped : BufferManager::Storage::Heap);
+    layerManager_.SetBlendSpace(config.GetBool("LinearLightBlending") ? BlendSpace::Linear : BlendSpace::SRGB);
     layerManager_.CreateLayer(width, height, "Background");
     historyManager_.Clear();
+    MemoryGovernor::GetInstance().Check();
+    Publish();
     
     return true;
 }
@@ -35,7 +54,9 @@ bool ImageEngine::LoadFromFile(const std::string& filepath) {
 
     // Load PSD files using PSDFormat
     if (extension == ".psd") {
-        return FileManager::LoadPSD(filepath, this);
+        if (!FileManager::LoadPSD(filepath, this)) return false;
+        Publish();
+        return true;
     }
 
     // Load regular image files (PNG, JPG, BMP, etc.)
@@ -51,16 +72,20 @@ bool ImageEngine::LoadFromFile(const std::string& filepath) {
     }
 
     // Copy loaded data to the background layer
-    Layer* bgLayer = layerManager_.GetLayer(0);
-    if (bgLayer) {
-        BufferManager::Copy(buffer, bgLayer->GetBuffer());
-    }
+    layerManager_.EditLayer(layerManager_.GetLayer(0), [&](Layer& background) {
+        background.GetPixels().Assign(buffer);
+    });
 
     BufferManager::Destroy(buffer);
+    Publish();
     return true;
 }
 
 bool ImageEngine::SaveToFile(const std::string& filepath) {
+    return SaveSnapshot(filepath, *Publish());
+}
+
+bool ImageEngine::SaveSnapshot(const std::string& filepath, const DocumentSnapshot& snapshot) {
     // Check file extension to determine format
     size_t dotPos = filepath.find_last_of('.');
     if (dotPos == std::string::npos) {
@@ -76,19 +101,12 @@ bool ImageEngine::SaveToFile(const std::string& filepath) {
 
     // Save as PSD if extension is .psd
     if (extension == ".psd") {
-        return FileManager::SavePSD(filepath, this);
-    }
-
-    // For other formats, save the composite (flattened) image
-    BufferManager::Buffer composite = GetCompositeImage();
-    if (!composite.data) {
-        return false;
+        return FileManager::SavePSD(filepath, snapshot);
     }
 
-    bool result = FileManager::SaveImage(filepath, composite);
-    BufferManager::Destroy(composite);
-
-    return result;
+    // For other formats, stream the composite (flattened) image into the
+    // encoder band by band
+    return FileManager::SaveImage(filepath, snapshot);
 }
 
 BufferManager::Buffer ImageEngine::GetCompositeImage() const {
@@ -97,19 +115,63 @@ BufferManager::Buffer ImageEngine::GetCompositeImage() const {
 
 void ImageEngine::ApplyFilterToActiveLayer(FilterBase* filter) {
     Layer* layer = layerManager_.GetActiveLayer();
-    if (!layer || !filter) return;
+    // A group's pixels are only its cache; adjustment layers have none
+    if (!layer || !filter || layer->IsGroup() || layer->IsAdjustment()) return;
+
+    // Filters work on contiguous buffers. Filters with a bounded footprint
+    // only need the occupied tiles plus that margin (nothing at all on an
+    // empty layer); the others see the whole layer.
+    TiledImage& pixels = layer->GetPixels();
+    Rect region(0, 0, static_cast<int>(pixels.GetWidth()), static_cast<int>(pixels.GetHeight()));
+    int footprint = filter->GetFootprint();
+    if (footprint >= 0) {
+        Rect occupied = pixels.GetOccupiedBounds();
+        if (occupied.IsEmpty()) return;
+
+        // Grow by the footprint, out to whole tiles so Assign can keep
+        // untouched tiles sparse
+        const int tileSize = static_cast<int>(TiledImage::TILE_SIZE);
+        int left = std::max(0, occupied.x - footprint) / tileSize * tileSize;
+        int top = std::max(0, occupied.y - footprint) / tileSize * tileSize;
+        int right = (occupied.Right() + footprint + tileSize - 1) / tileSize * tileSize;
+        int bottom = (occupied.Bottom() + footprint + tileSize - 1) / tileSize * tileSize;
+        region = region.Intersect(Rect(left, top, right - left, bottom - top));
+    }
 
-    BufferManager::Buffer& layerBuffer = layer->GetBuffer();
+    BufferManager::Buffer layerBuffer = BufferManager::Create(static_cast<uint32_t>(region.width),
+        static_cast<uint32_t>(region.height), pixels.GetFormat(), pixels.GetStorage());
+    pixels.Read(region.x, region.y, BufferManager::GetView(layerBuffer));
 
     // Check if filter can be applied
     if (!filter->CanApply(layerBuffer)) {
+        BufferManager::Destroy(layerBuffer);
         return;
     }
 
-    // Apply the filter to the layer buffer
-    filter->Apply(layerBuffer);
+    // Apply the filter to the layer buffer; its scratch memory is released on
+    // return. Writing the result back leaves the tiles the filter did not
+    // change shared with history.
+    ScratchScope scratch;
+    if (filter->Apply(layerBuffer)) {
+        layerManager_.EditLayer(layer, [&](Layer& target) {
+            target.GetPixels().Assign(region.x, region.y, BufferManager::GetView(layerBuffer));
+        });
+    }
+    BufferManager::Destroy(layerBuffer);
+    MemoryGovernor::GetInstance().Check();
+    Publish();
 
     // TODO: Add to history for undo/redo support
     // historyManager_.AddAction(...);
 }
 
+bool ImageEngine::Crop(const Rect& rect) {
+    if (rect.IsEmpty()) return false;
+
+    width_ = static_cast<uint32_t>(rect.width);
+    height_ = static_cast<uint32_t>(rect.height);
+    layerManager_.EditLayers([&](Layer& layer) { layer.Move(-rect.x, -rect.y); });
+    Publish();
+    return true;
+}
+
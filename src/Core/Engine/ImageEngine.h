@@ -13,12 +13,18 @@ public:
     ~ImageEngine();
 
     // Document management
-    bool CreateNew(uint32_t width, uint32_t height, const std::string& name = "Untitled");
+    bool CreateNew(uint32_t width, uint32_t height, const std::string& name = "Untitled",
+                   PixelFormat format = PixelFormat::RGBA8);
     bool LoadFromFile(const std::string& filepath);
     bool SaveToFile(const std::string& filepath);
+
+    // Saves a published version; safe on any thread, so export and autosave
+    // can run in the background while editing goes on
+    static bool SaveSnapshot(const std::string& filepath, const DocumentSnapshot& snapshot);
     
     uint32_t GetWidth() const { return width_; }
     uint32_t GetHeight() const { return height_; }
+    PixelFormat GetPixelFormat() const { return layerManager_.GetPixelFormat(); }
     const std::string& GetName() const { return name_; }
     void SetName(const std::string& name) { name_ = name; }
 
@@ -33,9 +39,20 @@ public:
     // Composite all layers into final image
     BufferManager::Buffer GetCompositeImage() const;
 
+    // Publishes the current layers and canvas as a new document version for
+    // other threads (see LayerManager::Publish); GetSnapshot returns the
+    // latest one without blocking
+    std::shared_ptr<const DocumentSnapshot> Publish() { return layerManager_.Publish(width_, height_); }
+    std::shared_ptr<const DocumentSnapshot> GetSnapshot() const { return layerManager_.GetSnapshot(); }
+
     // Apply filter to active layer
     void ApplyFilterToActiveLayer(class FilterBase* filter);
 
+    // Crop the canvas to a rectangle in document coordinates. Layers are only
+    // repositioned: no pixels are copied and content outside the new canvas
+    // is kept.
+    bool Crop(const Rect& rect);
+
 private:
     uint32_t width_ = 0;
     uint32_t height_ = 0;
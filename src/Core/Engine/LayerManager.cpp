@@ -1,27 +1,137 @@
 #include "LayerManager.h"
+#include "BlendKernels.h"
 #include "../Math/ColorSpace.h"
+#include "../Math/PixelOps.h"
+#include "../Memory/ScratchArena.h"
+#include "../../Utils/Threading.h"
 #include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
 
-Layer::Layer(uint32_t width, uint32_t height, const std::string& name)
-    : width_(width), height_(height), name_(name) {
-    buffer_ = BufferManager::Create(width, height);
-    BufferManager::Clear(buffer_, 0, 0, 0, 0); // Transparent
+Layer::Layer(uint32_t width, uint32_t height, const std::string& name, PixelFormat format,
+             BufferManager::Storage storage)
+    : pixels_(width, height, format, storage), width_(width), height_(height), name_(name) {
+    pixels_.Clear(0, 0, 0, 0); // Transparent
 }
 
 Layer::~Layer() {
-    BufferManager::Destroy(buffer_);
+}
+
+void Layer::Move(int dx, int dy) {
+    x_ += dx;
+    y_ += dy;
+    for (auto& child : children_) {
+        child->Move(dx, dy);
+    }
+}
+
+Rect Layer::TrimToContent() {
+    if (group_ || adjustmentLayer_) return GetBounds();
+
+    // Bounding box of non-zero alpha in layer coordinates
+    int left = static_cast<int>(width_), top = static_cast<int>(height_), right = 0, bottom = 0;
+    DispatchPixelFormat(pixels_.GetFormat(), [&](auto traits) {
+        using Traits = decltype(traits);
+        using Channel = typename Traits::Channel;
+        for (uint32_t ty = 0; ty < pixels_.GetTilesY(); ty++) {
+            for (uint32_t tx = 0; tx < pixels_.GetTilesX(); tx++) {
+                int originX = static_cast<int>(tx * TiledImage::TILE_SIZE);
+                int originY = static_cast<int>(ty * TiledImage::TILE_SIZE);
+                const BufferManager::Buffer* tile = pixels_.GetTile(tx, ty);
+                if (!tile) {
+                    // Empty tiles have no content; Uniform ones are all content or none
+                    const Channel* value = reinterpret_cast<const Channel*>(pixels_.GetTileValue(tx, ty));
+                    if (!value || Traits::ToFloat(value[3]) <= 0.0f) continue;
+                    left = std::min(left, originX);
+                    top = std::min(top, originY);
+                    right = std::max(right, std::min(originX + static_cast<int>(TiledImage::TILE_SIZE), static_cast<int>(width_)));
+                    bottom = std::max(bottom, std::min(originY + static_cast<int>(TiledImage::TILE_SIZE), static_cast<int>(height_)));
+                    continue;
+                }
+                for (uint32_t y = 0; y < tile->height; y++) {
+                    const Channel* pixel = reinterpret_cast<const Channel*>(BufferManager::GetRow(*tile, y));
+                    int first = -1, last = -1;
+                    for (uint32_t x = 0; x < tile->width; x++) {
+                        if (Traits::ToFloat(pixel[x * 4 + 3]) > 0.0f) {
+                            if (first < 0) first = static_cast<int>(x);
+                            last = static_cast<int>(x);
+                        }
+                    }
+                    if (first < 0) continue;
+                    left = std::min(left, originX + first);
+                    right = std::max(right, originX + last + 1);
+                    top = std::min(top, originY + static_cast<int>(y));
+                    bottom = std::max(bottom, originY + static_cast<int>(y) + 1);
+                }
+            }
+        }
+    });
+
+    if (right <= left) {
+        pixels_ = TiledImage(0, 0, pixels_.GetFormat(), pixels_.GetStorage());
+        if (HasMask()) mask_ = TiledMask(0, 0);
+        width_ = height_ = 0;
+        return GetBounds();
+    }
+
+    uint32_t width = static_cast<uint32_t>(right - left);
+    uint32_t height = static_cast<uint32_t>(bottom - top);
+    if (width == width_ && height == height_) return GetBounds();
+
+    TiledImage trimmed(width, height, pixels_.GetFormat(), pixels_.GetStorage());
+    ScratchScope scratch;
+    BufferManager::BufferView band = scratch.AllocateView(width, TiledImage::TILE_SIZE, pixels_.GetFormat());
+    for (uint32_t bandY = 0; bandY < height; bandY += TiledImage::TILE_SIZE) {
+        BufferManager::BufferView rows = BufferManager::GetSubView(band, 0, 0, width, std::min(TiledImage::TILE_SIZE, height - bandY));
+        pixels_.Read(left, top + static_cast<int>(bandY), rows);
+        trimmed.Write(0, bandY, rows);
+    }
+
+    pixels_ = std::move(trimmed);
+    if (HasMask()) {
+        TiledMask trimmedMask(width, height);
+        uint8_t* rows = scratch.AllocateArray<uint8_t>(static_cast<size_t>(width) * TiledImage::TILE_SIZE);
+        for (uint32_t bandY = 0; bandY < height; bandY += TiledImage::TILE_SIZE) {
+            uint32_t bandHeight = std::min(TiledImage::TILE_SIZE, height - bandY);
+            mask_.Read(left, top + static_cast<int>(bandY), width, bandHeight, rows, width);
+            trimmedMask.Write(0, static_cast<int>(bandY), width, bandHeight, rows, width);
+        }
+        mask_ = std::move(trimmedMask);
+    }
+    width_ = width;
+    height_ = height;
+    x_ += left;
+    y_ += top;
+    return GetBounds();
 }
 
 LayerManager::LayerManager() {
+    governorId_ = MemoryGovernor::GetInstance().Register("Layers", MemoryGovernor::PRIORITY_LAYERS,
+        [this] { return GetMemoryUsage(); },
+        [this](size_t bytes) { return Reclaim(bytes); });
+    stackCacheGovernorId_ = MemoryGovernor::GetInstance().Register("Layer stack caches",
+        MemoryGovernor::PRIORITY_STACK_CACHE,
+        [this] {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return stackBelow_.GetResidentBytes() + stackAbove_.GetResidentBytes();
+        },
+        [this](size_t) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return DropStackCachesLocked();
+        });
 }
 
 LayerManager::~LayerManager() {
+    MemoryGovernor::GetInstance().Unregister(governorId_);
+    MemoryGovernor::GetInstance().Unregister(stackCacheGovernorId_);
+    BufferManager::Destroy(composite_);
 }
 
 Layer* LayerManager::CreateLayer(uint32_t width, uint32_t height, const std::string& name) {
     std::lock_guard<std::mutex> lock(mutex_);
     
-    auto layer = std::make_unique<Layer>(width, height, name);
+    auto layer = std::make_unique<Layer>(width, height, name, format_, storage_);
     Layer* ptr = layer.get();
     layers_.push_back(std::move(layer));
     
@@ -32,40 +142,108 @@ Layer* LayerManager::CreateLayer(uint32_t width, uint32_t height, const std::str
     return ptr;
 }
 
+Layer* LayerManager::CreateGroup(const std::string& name, GroupMode mode) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto group = std::make_unique<Layer>(0, 0, name, format_, storage_);
+    group->group_ = true;
+    group->groupMode_ = mode;
+    Layer* ptr = group.get();
+    layers_.push_back(std::move(group));
+
+    if (!activeLayer_) {
+        activeLayer_ = ptr;
+    }
+
+    return ptr;
+}
+
+Layer* LayerManager::CreateAdjustmentLayer(const Adjustment& adjustment, const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto layer = std::make_unique<Layer>(0, 0, name, format_, storage_);
+    layer->adjustmentLayer_ = true;
+    layer->adjustment_ = adjustment;
+    Layer* ptr = layer.get();
+    layers_.push_back(std::move(layer));
+
+    if (!activeLayer_) {
+        activeLayer_ = ptr;
+    }
+
+    return ptr;
+}
+
+// True if layer is ancestor or one of its descendants
+static bool IsWithin(const Layer* layer, const Layer* ancestor) {
+    for (; layer; layer = layer->GetParent()) {
+        if (layer == ancestor) return true;
+    }
+    return false;
+}
+
+std::vector<std::unique_ptr<Layer>>& LayerManager::GetSiblings(Layer* layer) {
+    return layer->parent_ ? layer->parent_->children_ : layers_;
+}
+
+bool LayerManager::MoveToGroup(Layer* layer, Layer* group) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!layer || (group && (!group->IsGroup() || IsWithin(group, layer)))) return false;
+
+    auto& siblings = GetSiblings(layer);
+    auto it = std::find_if(siblings.begin(), siblings.end(),
+        [layer](const std::unique_ptr<Layer>& l) { return l.get() == layer; });
+    if (it == siblings.end()) return false;
+
+    std::unique_ptr<Layer> moved = std::move(*it);
+    siblings.erase(it);
+    moved->parent_ = group;
+    (group ? group->children_ : layers_).push_back(std::move(moved));
+    return true;
+}
+
 void LayerManager::DeleteLayer(size_t index) {
     std::lock_guard<std::mutex> lock(mutex_);
+    if (index < layers_.size()) {
+        DeleteLayerLocked(layers_, index);
+    }
+}
+
+void LayerManager::DeleteLayer(Layer* layer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!layer) return;
+
+    auto& siblings = GetSiblings(layer);
+    auto it = std::find_if(siblings.begin(), siblings.end(),
+        [layer](const std::unique_ptr<Layer>& l) { return l.get() == layer; });
     
-    if (index >= layers_.size()) return;
-    
-    Layer* toDelete = layers_[index].get();
-    if (activeLayer_ == toDelete) {
+    if (it != siblings.end()) {
+        DeleteLayerLocked(siblings, it - siblings.begin());
+    }
+}
+
+void LayerManager::DeleteLayerLocked(std::vector<std::unique_ptr<Layer>>& siblings, size_t index) {
+    Layer* toDelete = siblings[index].get();
+    // Deleting a group also deletes an active layer inside it
+    if (IsWithin(activeLayer_, toDelete)) {
         activeLayer_ = nullptr;
-        if (index > 0 && layers_.size() > 1) {
-            activeLayer_ = layers_[index - 1].get();
-        } else if (layers_.size() > 1) {
-            activeLayer_ = layers_[1].get();
+        if (index > 0 && siblings.size() > 1) {
+            activeLayer_ = siblings[index - 1].get();
+        } else if (siblings.size() > 1) {
+            activeLayer_ = siblings[1].get();
+        } else {
+            activeLayer_ = toDelete->parent_;
         }
     }
     
-    layers_.erase(layers_.begin() + index);
+    siblings.erase(siblings.begin() + index);
     
     if (!activeLayer_ && !layers_.empty()) {
         activeLayer_ = layers_[0].get();
     }
 }
 
-void LayerManager::DeleteLayer(Layer* layer) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    auto it = std::find_if(layers_.begin(), layers_.end(),
-        [layer](const std::unique_ptr<Layer>& l) { return l.get() == layer; });
-    
-    if (it != layers_.end()) {
-        size_t index = it - layers_.begin();
-        DeleteLayer(index);
-    }
-}
-
 Layer* LayerManager::GetLayer(size_t index) {
     std::lock_guard<std::mutex> lock(mutex_);
     return (index < layers_.size()) ? layers_[index].get() : nullptr;
@@ -106,51 +284,1046 @@ void LayerManager::DuplicateLayer(size_t index) {
     
     if (index >= layers_.size()) return;
     
-    Layer* src = layers_[index].get();
-    auto dup = std::make_unique<Layer>(src->GetWidth(), src->GetHeight(), src->GetName() + " Copy");
-    BufferManager::Copy(src->GetBuffer(), dup->GetBuffer());
-    dup->SetOpacity(src->GetOpacity());
-    dup->SetBlendMode(src->GetBlendMode());
-    
+    auto dup = CloneLayer(*layers_[index], layers_[index]->GetName() + " Copy");
     layers_.insert(layers_.begin() + index + 1, std::move(dup));
 }
 
+std::unique_ptr<Layer> LayerManager::CloneLayer(const Layer& source, const std::string& name) {
+    auto dup = std::make_unique<Layer>(source.GetWidth(), source.GetHeight(), name,
+                                       source.GetFormat(), source.GetPixels().GetStorage());
+    dup->GetPixels() = source.GetPixels(); // Shares tiles until either layer is edited
+    dup->mask_ = source.mask_;
+    dup->x_ = source.x_;
+    dup->y_ = source.y_;
+    dup->SetVisible(source.IsVisible());
+    dup->SetOpacity(source.GetOpacity());
+    dup->SetBlendMode(source.GetBlendMode());
+    dup->adjustmentLayer_ = source.adjustmentLayer_;
+    dup->adjustment_ = source.adjustment_;
+
+    // The children share their tiles too, so a group's cache stays valid
+    dup->group_ = source.group_;
+    dup->groupMode_ = source.groupMode_;
+    dup->groupSignatures_ = source.groupSignatures_;
+    for (const auto& child : source.children_) {
+        dup->children_.push_back(CloneLayer(*child, child->GetName()));
+        dup->children_.back()->parent_ = dup.get();
+    }
+    return dup;
+}
+
+// Blends count straight-alpha source pixels into an accumulator row, with
+// the source alpha scaled by opacity and the 8-bit mask (null for none)
+using RowBlendFn = void (*)(uint8_t* dst, const uint8_t* src, const uint8_t* mask, uint32_t count, float opacity);
+
+// One visible layer's contribution to a composite, resolved once up front.
+// Adjustment passes have a program instead of pixels and a blend function.
+struct CompositePass {
+    const TiledImage* pixels;
+    Rect bounds; // Layer bounds in document coordinates
+    RowBlendFn blend;
+    float opacity;
+    BlendMode mode;
+    const Layer* layer; // Layer or isolated group the pass comes from (null for stack caches)
+    std::shared_ptr<ColorProgram> program;
+    const TiledMask* mask; // Layer mask on the pixels' tile grid (null if none)
+};
+
+// Adjustments reach everything under them, wherever it is
+static const Rect ADJUSTMENT_BOUNDS(-(1 << 29), -(1 << 29), 1 << 30, 1 << 30);
+
+// A pass clipped to one result tile
+struct TilePass {
+    const CompositePass* pass;
+    Rect clip; // Part of the result tile the layer covers
+};
+
+static void BlendRowNormal8(uint8_t* dst, const uint8_t* src, const uint8_t* mask, uint32_t count, float opacity) {
+    uint8_t alpha = static_cast<uint8_t>(opacity * 255.0f + 0.5f);
+    if (mask) {
+        PixelOps::AlphaOverStraightMasked(dst, src, mask, count, alpha);
+    } else {
+        PixelOps::AlphaOverStraight(dst, src, count, alpha);
+    }
+}
+
+// RGBA16 Normal onto the premultiplied accumulator, as BlendRowNormal8; a
+// mask scales the source alpha in a copy of the span
+static void BlendRowNormal16(uint8_t* dstRow, const uint8_t* srcRow, const uint8_t* mask, uint32_t count,
+                             float opacity) {
+    uint16_t alpha = static_cast<uint16_t>(std::clamp(opacity, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    uint16_t* dst = reinterpret_cast<uint16_t*>(dstRow);
+    const uint16_t* src = reinterpret_cast<const uint16_t*>(srcRow);
+    if (!mask) {
+        PixelOps::AlphaOverStraight16(dst, src, count, alpha);
+        return;
+    }
+    alignas(64) uint16_t staging[BLEND_CHUNK * 4];
+    for (uint32_t x = 0; x < count; x += BLEND_CHUNK) {
+        uint32_t n = std::min(BLEND_CHUNK, count - x);
+        std::memcpy(staging, src + x * 4, n * 4 * sizeof(uint16_t));
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t coverage = mask[x + i] * 257u;
+            staging[i * 4 + 3] = static_cast<uint16_t>(PixelOps::Div65535(staging[i * 4 + 3] * coverage));
+        }
+        PixelOps::AlphaOverStraight16(dst + x * 4, staging, n, alpha);
+    }
+}
+
+// Premultiplied RGBA8 source (a saved accumulator, never masked) over the
+// accumulator
+static void BlendRowPremultipliedOver8(uint8_t* dst, const uint8_t* src, const uint8_t*, uint32_t count, float) {
+    PixelOps::AlphaOver(dst, src, count);
+}
+
+// Premultiplied RGBA16 source (a saved accumulator: RGBA16, or linear light
+// for RGBA8 documents; never masked) over the accumulator
+static void BlendRowPremultipliedOver16(uint8_t* dst, const uint8_t* src, const uint8_t*, uint32_t count, float) {
+    uint16_t* d = reinterpret_cast<uint16_t*>(dst);
+    const uint16_t* s = reinterpret_cast<const uint16_t*>(src);
+    for (uint32_t i = 0; i < count * 4; i += 4) {
+        uint32_t keep = 65535 - s[i + 3];
+        for (int c = 0; c < 4; c++) {
+            d[i + c] = static_cast<uint16_t>(s[i + c] + PixelOps::Div65535(d[i + c] * keep));
+        }
+    }
+}
+
+// Premultiplied float source (a saved accumulator, never masked) over the
+// accumulator
+static void BlendRowPremultipliedOverF32(uint8_t* dst, const uint8_t* src, const uint8_t*, uint32_t count, float) {
+    float* d = reinterpret_cast<float*>(dst);
+    const float* s = reinterpret_cast<const float*>(src);
+    for (uint32_t i = 0; i < count * 4; i += 4) {
+        float keep = 1.0f - s[i + 3];
+        for (int c = 0; c < 4; c++) {
+            d[i + c] = s[i + c] + d[i + c] * keep;
+        }
+    }
+}
+
+// The composite accumulates premultiplied. In sRGB that is the document
+// format itself, except that RGBA16F accumulates in RGBA32F (halves would
+// round every layer, and converting the accumulator costs more than it
+// saves). Linear light: RGBA8 documents in 16-bit integers (enough for 8-bit
+// output, and Normal blends without floats), other formats in RGBA32F.
+static constexpr PixelFormat AccumulatorFormat(PixelFormat format, BlendSpace space) {
+    if (space != BlendSpace::Linear) return format == PixelFormat::RGBA16F ? PixelFormat::RGBA32F : format;
+    return format == PixelFormat::RGBA8 ? PixelFormat::RGBA16 : PixelFormat::RGBA32F;
+}
+
+// Source-over for a saved accumulator onto one of the same format
+static RowBlendFn SelectPremultipliedOver(PixelFormat accumulator) {
+    if (accumulator == PixelFormat::RGBA8) return BlendRowPremultipliedOver8;
+    return accumulator == PixelFormat::RGBA16 ? BlendRowPremultipliedOver16 : BlendRowPremultipliedOverF32;
+}
+
+// Blends a document-format source into the AccumulatorFormat accumulator,
+// which returns to straight alpha (and sRGB) per row at the end. Normal on
+// RGBA8 and RGBA16 accumulators blends in fixed-point SIMD, the rest through
+// float planes.
+static RowBlendFn SelectRowBlend(BlendMode mode, PixelFormat format, BlendSpace space) {
+    if (mode == BlendMode::Normal && format == PixelFormat::RGBA8) {
+        return space == BlendSpace::Linear ? BlendRowLinearNormal8 : BlendRowNormal8;
+    }
+    if (mode == BlendMode::Normal && format == PixelFormat::RGBA16 && space == BlendSpace::SRGB) {
+        return BlendRowNormal16;
+    }
+    return DispatchPixelFormat(format, [&](auto traits) {
+        using Traits = decltype(traits);
+        return DispatchBlendMode(mode, [space](auto mode) -> RowBlendFn {
+            constexpr BlendMode MODE = decltype(mode)::value;
+            if (space == BlendSpace::Linear) {
+                using Accumulator = PixelFormatTraits<AccumulatorFormat(Traits::FORMAT, BlendSpace::Linear)>;
+                return BlendRowPremultiplied<MODE, Traits, Accumulator, true>;
+            }
+            using Accumulator = PixelFormatTraits<AccumulatorFormat(Traits::FORMAT, BlendSpace::SRGB)>;
+            return BlendRowPremultiplied<MODE, Traits, Accumulator, false>;
+        });
+    });
+}
+
+// Document-space rectangle of a tile in a TILE_SIZE grid laid over area
+// (the composite canvas, or an isolated group's bounds)
+static Rect GridTileRect(const Rect& area, uint32_t tileX, uint32_t tileY) {
+    int offsetX = static_cast<int>(tileX * TiledImage::TILE_SIZE);
+    int offsetY = static_cast<int>(tileY * TiledImage::TILE_SIZE);
+    return Rect(area.x + offsetX, area.y + offsetY,
+                std::min(static_cast<int>(TiledImage::TILE_SIZE), area.width - offsetX),
+                std::min(static_cast<int>(TiledImage::TILE_SIZE), area.height - offsetY));
+}
+
+// Row of TILE_SIZE copies of a Uniform tile's value, refilled only when the
+// value changes; likewise for single-value mask tiles
+struct UniformRow {
+    uint8_t* pixels = nullptr;
+    const uint8_t* value = nullptr;
+    uint8_t* mask = nullptr;
+    int maskValue = -1;
+};
+
+// Blends the layer pixels under document row y, columns [x0, x1) (already
+// clipped to the layer), into a result row that starts at column originX.
+// Unless the layer sits on the tile grid, the span crosses into a second
+// layer tile. Transparent tiles and tiles masked out entirely are skipped;
+// Uniform tiles blend from a row of their value, and fully white mask tiles
+// blend without a mask. bytesPerPixel is the result row's; the source may
+// differ (an accumulator in another format takes document-format layers).
+static void BlendLayerRow(uint8_t* resultRow, int originX, size_t bytesPerPixel, const CompositePass& pass,
+                          int y, int x0, int x1, UniformRow& uniform) {
+    size_t sourceBytesPerPixel = BytesPerPixel(pass.pixels->GetFormat());
+    uint32_t layerY = static_cast<uint32_t>(y - pass.bounds.y);
+    uint32_t tileY = layerY / TiledImage::TILE_SIZE;
+    uint32_t tileRow = layerY % TiledImage::TILE_SIZE;
+    uint32_t layerEnd = static_cast<uint32_t>(x1 - pass.bounds.x);
+    for (uint32_t layerX = static_cast<uint32_t>(x0 - pass.bounds.x); layerX < layerEnd;) {
+        uint32_t tileX = layerX / TiledImage::TILE_SIZE;
+        uint32_t spanEnd = std::min((tileX + 1) * TiledImage::TILE_SIZE, layerEnd);
+        uint32_t spanX = layerX;
+        layerX = spanEnd;
+
+        if (pass.pixels->GetTileCoverage(tileX, tileY) == TiledImage::Coverage::Transparent) {
+            continue; // Adds nothing in any blend mode
+        }
+
+        const uint8_t* mask = nullptr;
+        if (pass.mask) {
+            if (const uint8_t* values = pass.mask->GetTile(tileX, tileY)) {
+                mask = values + tileRow * TiledImage::TILE_SIZE + (spanX - tileX * TiledImage::TILE_SIZE);
+            } else {
+                uint8_t value = pass.mask->GetTileValue(tileX, tileY);
+                if (value == 0) continue; // Masked out, same as transparent
+                if (value < 255) {
+                    if (uniform.maskValue != value) {
+                        std::memset(uniform.mask, value, TiledImage::TILE_SIZE);
+                        uniform.maskValue = value;
+                    }
+                    mask = uniform.mask;
+                }
+            }
+        }
+
+        const uint8_t* src = nullptr;
+        if (const BufferManager::Buffer* tile = pass.pixels->GetTile(tileX, tileY)) {
+            src = BufferManager::GetRow(*tile, tileRow) + (spanX - tileX * TiledImage::TILE_SIZE) * sourceBytesPerPixel;
+        } else if (const uint8_t* value = pass.pixels->GetTileValue(tileX, tileY)) {
+            if (uniform.value != value) {
+                for (uint32_t x = 0; x < TiledImage::TILE_SIZE; x++) {
+                    std::memcpy(uniform.pixels + x * sourceBytesPerPixel, value, sourceBytesPerPixel);
+                }
+                uniform.value = value;
+            }
+            src = uniform.pixels;
+        }
+        pass.blend(resultRow + (spanX + pass.bounds.x - originX) * bytesPerPixel, src, mask, spanEnd - spanX,
+                   pass.opacity);
+    }
+}
+
+// Runs an adjustment over count premultiplied accumulator pixels in spans of
+// planar floats. The program sees straight, sRGB-encoded color; opacity
+// mixes its output with the original, and transparent pixels keep theirs.
+template<typename Traits, bool LINEAR>
+static void AdjustRow(uint8_t* row, uint32_t count, const ColorProgram& program, float opacity) {
+    using Channel = typename Traits::Channel;
+    alignas(64) float staging[BLEND_CHUNK * 4];
+    alignas(64) float planes[4][BLEND_CHUNK];
+    alignas(64) float original[3][BLEND_CHUNK];
+    alignas(64) float weight[BLEND_CHUNK];
+    alignas(64) float unpremultiply[BLEND_CHUNK];
+    float* const p[4] = {planes[0], planes[1], planes[2], planes[3]};
+
+    Channel* pixels = reinterpret_cast<Channel*>(row);
+    for (uint32_t x = 0; x < count; x += BLEND_CHUNK) {
+        uint32_t n = std::min(BLEND_CHUNK, count - x);
+        Channel* span = pixels + x * 4;
+        DecodeSpan<Traits>(staging, span, n);
+        PixelOps::Deinterleave(p, staging, n);
+
+        for (uint32_t i = 0; i < n; i++) {
+            weight[i] = planes[3][i] > 0.0f ? opacity : 0.0f;
+            unpremultiply[i] = 1.0f / BlendDivisor(planes[3][i]);
+        }
+        for (int c = 0; c < 3; c++) {
+            for (uint32_t i = 0; i < n; i++) {
+                planes[c][i] *= unpremultiply[i];
+            }
+            if constexpr (LINEAR) ColorSpace::LinearToSRGB(planes[c], planes[c], n);
+            for (uint32_t i = 0; i < n; i++) {
+                original[c][i] = planes[c][i];
+            }
+        }
+
+        program.Apply(p, n);
+
+        for (int c = 0; c < 3; c++) {
+            for (uint32_t i = 0; i < n; i++) {
+                planes[c][i] = original[c][i] + (planes[c][i] - original[c][i]) * weight[i];
+            }
+            if constexpr (LINEAR) ColorSpace::SRGBToLinear(planes[c], planes[c], n);
+            for (uint32_t i = 0; i < n; i++) {
+                planes[c][i] *= planes[3][i];
+            }
+        }
+
+        PixelOps::Interleave(staging, p, n);
+        EncodeSpan<Traits>(span, staging, n);
+    }
+}
+
+static void AdjustRow(uint8_t* row, uint32_t count, PixelFormat format, BlendSpace space, const ColorProgram& program,
+                      float opacity) {
+    DispatchPixelFormat(format, [&](auto traits) {
+        using Traits = decltype(traits);
+        if (space == BlendSpace::Linear) {
+            AdjustRow<Traits, true>(row, count, program, opacity); // format is the accumulator's
+        } else {
+            AdjustRow<Traits, false>(row, count, program, opacity);
+        }
+    });
+}
+
+// Returns count pixels of a float accumulator row to straight pixels of the
+// document format, encoding linear light (LINEAR) back to sRGB
+template<typename Traits, bool LINEAR>
+static void EncodeRow(uint8_t* row, const float* accumulator, uint32_t count) {
+    using Channel = typename Traits::Channel;
+    alignas(64) float staging[BLEND_CHUNK * 4];
+    alignas(64) float planes[4][BLEND_CHUNK];
+    alignas(64) float unpremultiply[BLEND_CHUNK];
+    float* const p[4] = {planes[0], planes[1], planes[2], planes[3]};
+
+    Channel* pixels = reinterpret_cast<Channel*>(row);
+    for (uint32_t x = 0; x < count; x += BLEND_CHUNK) {
+        uint32_t n = std::min(BLEND_CHUNK, count - x);
+        PixelOps::Deinterleave(p, accumulator + x * 4, n);
+        for (uint32_t i = 0; i < n; i++) {
+            unpremultiply[i] = 1.0f / BlendDivisor(planes[3][i]);
+        }
+        for (int c = 0; c < 3; c++) {
+            for (uint32_t i = 0; i < n; i++) {
+                planes[c][i] *= unpremultiply[i];
+            }
+            if constexpr (LINEAR) ColorSpace::LinearToSRGB(planes[c], planes[c], n);
+        }
+
+        PixelOps::Interleave(staging, p, n);
+        EncodeSpan<Traits>(pixels + x * 4, staging, n);
+    }
+}
+
+// Returns count pixels of an sRGB accumulator row in the document format to
+// straight alpha, in place (RGBA8 has a PixelOps kernel)
+template<typename Traits>
+static void UnpremultiplyRow(uint8_t* row, uint32_t count) {
+    using Channel = typename Traits::Channel;
+    alignas(64) float staging[BLEND_CHUNK * 4];
+    alignas(64) float planes[4][BLEND_CHUNK];
+    alignas(64) float unpremultiply[BLEND_CHUNK];
+    float* const p[4] = {planes[0], planes[1], planes[2], planes[3]};
+
+    Channel* pixels = reinterpret_cast<Channel*>(row);
+    for (uint32_t x = 0; x < count; x += BLEND_CHUNK) {
+        uint32_t n = std::min(BLEND_CHUNK, count - x);
+        DecodeSpan<Traits>(staging, pixels + x * 4, n);
+        PixelOps::Deinterleave(p, staging, n);
+        for (uint32_t i = 0; i < n; i++) {
+            unpremultiply[i] = 1.0f / BlendDivisor(planes[3][i]);
+        }
+        for (int c = 0; c < 3; c++) {
+            for (uint32_t i = 0; i < n; i++) {
+                planes[c][i] *= unpremultiply[i];
+            }
+        }
+        PixelOps::Interleave(staging, p, n);
+        EncodeSpan<Traits>(pixels + x * 4, staging, n);
+    }
+}
+
+static void UnpremultiplyRow(uint8_t* row, uint32_t count, PixelFormat format) {
+    if (format == PixelFormat::RGBA8) {
+        PixelOps::Unpremultiply(row, row, count);
+        return;
+    }
+    DispatchPixelFormat(format, [&](auto traits) { UnpremultiplyRow<decltype(traits)>(row, count); });
+}
+
+// accumulator is in AccumulatorFormat(format, space); the 16-bit
+// linear-light accumulator of RGBA8 documents encodes through the
+// 8-bit-output table
+static void EncodeRow(uint8_t* row, const uint8_t* accumulator, uint32_t count, PixelFormat format, BlendSpace space) {
+    if (space == BlendSpace::Linear && format == PixelFormat::RGBA8) {
+        PixelOps::EncodeLinear16(row, reinterpret_cast<const uint16_t*>(accumulator), count,
+                                 ColorSpace::GetLinearToSRGB8Table(), ColorSpace::LINEAR_TO_SRGB8_SIZE);
+        return;
+    }
+    DispatchPixelFormat(format, [&](auto traits) {
+        const float* floats = reinterpret_cast<const float*>(accumulator);
+        if (space == BlendSpace::Linear) {
+            EncodeRow<decltype(traits), true>(row, floats, count);
+        } else {
+            EncodeRow<decltype(traits), false>(row, floats, count);
+        }
+    });
+}
+
+// Accumulator bytes blended by every layer before moving on: small enough to
+// stay in L1, long enough that each layer reads a contiguous run of its tile
+static constexpr size_t COMPOSITE_BAND_BYTES = 32 * 1024;
+
+// True if the pass hides everything under it in tileRect: Normal at full
+// opacity with opaque layer tiles (and fully white mask tiles) across the
+// whole rectangle
+static bool Occludes(const CompositePass& pass, const Rect& tileRect) {
+    if (pass.program || pass.mode != BlendMode::Normal || pass.opacity < 1.0f) return false;
+    if (tileRect.Intersect(pass.bounds) != tileRect) return false;
+
+    Rect clip = tileRect.Offset(-pass.bounds.x, -pass.bounds.y);
+    const int tileSize = static_cast<int>(TiledImage::TILE_SIZE);
+    for (int ty = clip.y / tileSize; ty <= (clip.Bottom() - 1) / tileSize; ty++) {
+        for (int tx = clip.x / tileSize; tx <= (clip.Right() - 1) / tileSize; tx++) {
+            if (pass.pixels->GetTileCoverage(tx, ty) != TiledImage::Coverage::Opaque) return false;
+            if (pass.mask && (pass.mask->GetTile(tx, ty) || pass.mask->GetTileValue(tx, ty) != 255)) return false;
+        }
+    }
+    return true;
+}
+
+// Index of the first pass that shows in tileRect: the topmost occluding
+// pass (occluded set), or 0. Opaque Normal over anything gives the source
+// back exactly, so skipping what it covers does not change the result.
+static size_t FirstVisiblePass(const std::vector<CompositePass>& passes, const Rect& tileRect, bool& occluded) {
+    for (size_t i = passes.size(); i-- > 0;) {
+        if (Occludes(passes[i], tileRect)) {
+            occluded = true;
+            return i;
+        }
+    }
+    occluded = false;
+    return 0;
+}
+
+// Composites one tile of the result, document rectangle tileRect, into
+// target (which covers exactly that rectangle). Works in bands of rows: every
+// layer is blended into a band before moving to the next, so the accumulator
+// stays in cache and each layer is streamed once. Layers only touch the part
+// of the tile inside their bounds.
+//
+// The accumulator starts transparent, or from base (an accumulator saved
+// with finish unset, in document coordinates) unless a layer occludes the
+// tile. finish returns the accumulator to straight alpha. Adjustments
+// recolor the band as it stands when their turn comes; ones with nothing
+// under them are skipped.
+//
+// The accumulator is premultiplied, in AccumulatorFormat. It is target
+// itself when finish is unset (a stack cache) or, in sRGB, when the formats
+// agree; otherwise it is a band of scratch that finish encodes into target.
+static void CompositeTile(const BufferManager::BufferView& target, const Rect& tileRect,
+                          const std::vector<CompositePass>& passes, BlendSpace space,
+                          const TiledImage* base = nullptr, bool finish = true) {
+    bool encode = finish && (space == BlendSpace::Linear || AccumulatorFormat(target.format, space) != target.format);
+    PixelFormat format = encode ? AccumulatorFormat(target.format, space) : target.format;
+    size_t bytesPerPixel = BytesPerPixel(format);
+    size_t rowBytes = tileRect.width * bytesPerPixel;
+    int bandRows = static_cast<int>(std::max<size_t>(1, COMPOSITE_BAND_BYTES / rowBytes));
+
+    ScratchScope scratch;
+    BufferManager::BufferView band;
+    if (encode) {
+        band = scratch.AllocateView(tileRect.width, std::min(bandRows, tileRect.height), format);
+    }
+    TilePass* tilePasses = scratch.AllocateArray<TilePass>(passes.size());
+    UniformRow uniform;
+    uniform.pixels = scratch.AllocateArray<uint8_t>(TiledImage::TILE_SIZE * bytesPerPixel);
+    uniform.mask = scratch.AllocateArray<uint8_t>(TiledImage::TILE_SIZE);
+    bool occluded = false;
+    size_t first = FirstVisiblePass(passes, tileRect, occluded);
+    if (occluded) base = nullptr;
+    size_t count = 0;
+    for (size_t i = first; i < passes.size(); i++) {
+        Rect clip = tileRect.Intersect(passes[i].bounds);
+        if (passes[i].program && count == 0 && !base) continue;
+        if (!clip.IsEmpty()) tilePasses[count++] = {&passes[i], clip};
+    }
+
+    for (int bandY = tileRect.y; bandY < tileRect.Bottom(); bandY += bandRows) {
+        int bandEnd = std::min(bandY + bandRows, tileRect.Bottom());
+        const BufferManager::BufferView& accumulator = encode ? band : target;
+        int accumulatorY = encode ? bandY : tileRect.y; // Document row of the accumulator's first row
+        if (base) {
+            base->Read(tileRect.x, bandY, BufferManager::GetSubView(accumulator, 0, bandY - accumulatorY,
+                                                                     tileRect.width, bandEnd - bandY));
+        } else {
+            for (int y = bandY; y < bandEnd; y++) {
+                std::memset(accumulator.Row(y - accumulatorY), 0, rowBytes); // Transparent in every format
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            const Rect& clip = tilePasses[i].clip;
+            const CompositePass& pass = *tilePasses[i].pass;
+            for (int y = std::max(bandY, clip.y); y < std::min(bandEnd, clip.Bottom()); y++) {
+                if (pass.program) {
+                    AdjustRow(accumulator.Row(y - accumulatorY) + (clip.x - tileRect.x) * bytesPerPixel,
+                              static_cast<uint32_t>(clip.width), format, space, *pass.program, pass.opacity);
+                    continue;
+                }
+                BlendLayerRow(accumulator.Row(y - accumulatorY), tileRect.x, bytesPerPixel, *tilePasses[i].pass,
+                              y, clip.x, clip.Right(), uniform);
+            }
+        }
+
+        if (encode) {
+            for (int y = bandY; y < bandEnd; y++) {
+                EncodeRow(target.Row(y - tileRect.y), band.Row(y - bandY), tileRect.width, target.format, space);
+            }
+        } else if (finish) {
+            for (int y = bandY; y < bandEnd; y++) {
+                UnpremultiplyRow(target.Row(y - tileRect.y), tileRect.width, target.format);
+            }
+        }
+    }
+}
+
+static uint64_t CombineSignature(uint64_t signature, uint64_t value) {
+    return signature ^ (value + 0x9E3779B97F4A7C15ull + (signature << 6) + (signature >> 2));
+}
+
+// Identifies what a composite tile is made of: the visible layer tiles under
+// it in stack order with their generations, positions (relative to origin,
+// so a moved group keeps its cache) and blend settings, plus the base tile
+// the accumulator starts from (base shares the tile grid) and the layer
+// mask tiles. Equal signatures
+// mean equal composite pixels. Layers that are transparent over the tile or
+// hidden under an opaque one leave no trace, so changing them does not redo
+// it; so do adjustments with nothing visible under them.
+static uint64_t TileSignature(const std::vector<CompositePass>& passes, const Rect& tileRect, int originX, int originY,
+                              const TiledImage* base = nullptr) {
+    bool occluded = false;
+    size_t first = FirstVisiblePass(passes, tileRect, occluded);
+    uint64_t signature = 0;
+    bool content = base && !occluded;
+    if (content) {
+        uint32_t tileX = static_cast<uint32_t>(tileRect.x - originX) / TiledImage::TILE_SIZE;
+        uint32_t tileY = static_cast<uint32_t>(tileRect.y - originY) / TiledImage::TILE_SIZE;
+        signature = CombineSignature(signature, base->GetTileGeneration(tileX, tileY));
+    }
+
+    for (size_t i = first; i < passes.size(); i++) {
+        const CompositePass& pass = passes[i];
+        uint32_t opacityBits = 0;
+        std::memcpy(&opacityBits, &pass.opacity, sizeof(opacityBits));
+        if (pass.program) {
+            if (!content) continue;
+            signature = CombineSignature(signature, pass.program->GetHash());
+            signature = CombineSignature(signature, opacityBits);
+            continue;
+        }
+
+        Rect clip = tileRect.Intersect(pass.bounds).Offset(-pass.bounds.x, -pass.bounds.y);
+        if (clip.IsEmpty()) continue;
+
+        uint64_t tiles = 0;
+        bool visible = false;
+        const int tileSize = static_cast<int>(TiledImage::TILE_SIZE);
+        for (int ty = clip.y / tileSize; ty <= (clip.Bottom() - 1) / tileSize; ty++) {
+            for (int tx = clip.x / tileSize; tx <= (clip.Right() - 1) / tileSize; tx++) {
+                bool maskedOut = pass.mask && !pass.mask->GetTile(tx, ty) && pass.mask->GetTileValue(tx, ty) == 0;
+                visible |= !maskedOut && pass.pixels->GetTileCoverage(tx, ty) != TiledImage::Coverage::Transparent;
+                tiles = CombineSignature(tiles, pass.pixels->GetTileGeneration(tx, ty));
+                if (pass.mask) tiles = CombineSignature(tiles, pass.mask->GetTileGeneration(tx, ty));
+            }
+        }
+        if (!visible) continue;
+
+        content = true;
+        signature = CombineSignature(signature, static_cast<uint32_t>(pass.bounds.x - originX));
+        signature = CombineSignature(signature, static_cast<uint32_t>(pass.bounds.y - originY));
+        signature = CombineSignature(signature, reinterpret_cast<uintptr_t>(pass.blend));
+        signature = CombineSignature(signature, opacityBits);
+        signature = CombineSignature(signature, tiles);
+    }
+    return signature | 1; // Never 0, which marks a tile to redo
+}
+
+// Pass-through groups contribute their children (scaled by the group's
+// opacity); isolated groups contribute their cache like a layer. Each
+// adjustment layer gets a program of its own; FuseAdjustments merges them.
+void LayerManager::BuildCompositePasses(const std::vector<std::unique_ptr<Layer>>& layers, PixelFormat format,
+                                        BlendSpace space, BufferManager::Storage storage, float opacityScale,
+                                        std::vector<CompositePass>& passes) {
+    for (const auto& layer : layers) {
+        float opacity = layer->GetOpacity() * opacityScale;
+        if (!layer->IsVisible() || opacity <= 0.0f) continue;
+
+        if (layer->IsGroup()) {
+            if (layer->GetGroupMode() == GroupMode::PassThrough) {
+                BuildCompositePasses(layer->children_, format, space, storage, opacity, passes);
+                continue;
+            }
+            UpdateGroupCache(*layer, format, space, storage);
+        }
+        if (layer->IsAdjustment()) {
+            auto program = std::make_shared<ColorProgram>();
+            program->Append(layer->GetAdjustment());
+            passes.push_back({nullptr, ADJUSTMENT_BOUNDS, nullptr, opacity, BlendMode::Normal, layer.get(), program,
+                              nullptr});
+            continue;
+        }
+        // Pixels replaced in another format (a restored history state, say)
+        // are brought over rather than left out
+        if (layer->GetFormat() != format) ConvertLayerPixels(*layer, format);
+        if (layer->GetPixels().IsEmpty()) continue;
+
+        const TiledMask& mask = layer->GetMask();
+        bool masked = !layer->IsGroup() && layer->HasMask() &&
+                      mask.GetWidth() == layer->GetWidth() && mask.GetHeight() == layer->GetHeight();
+        passes.push_back({&layer->GetPixels(), layer->GetBounds(), SelectRowBlend(layer->GetBlendMode(), format, space),
+                          opacity, layer->GetBlendMode(), layer.get(), nullptr, masked ? &mask : nullptr});
+    }
+}
+
+// Consecutive adjustments at full opacity compose into one program, so the
+// run costs one trip through float planes per row. Runs that end up as a
+// single stage are common (all curves, or all matrices).
+static std::vector<CompositePass> FuseAdjustments(const std::vector<CompositePass>& passes) {
+    std::vector<CompositePass> fused;
+    fused.reserve(passes.size());
+    for (const CompositePass& pass : passes) {
+        if (pass.program && !fused.empty() && fused.back().program &&
+            pass.opacity >= 1.0f && fused.back().opacity >= 1.0f) {
+            auto program = std::make_shared<ColorProgram>(*fused.back().program);
+            program->Append(*pass.program);
+            fused.back().program = std::move(program);
+            fused.back().layer = nullptr;
+            continue;
+        }
+        fused.push_back(pass);
+    }
+    return fused;
+}
+
+// Recomputes the signature of every tile of a grid over area (in parallel:
+// classifying layer tiles reads their pixels) and returns the indices of the
+// tiles whose signature changed
+static std::vector<uint32_t> FindDirtyTiles(std::vector<uint64_t>& signatures, const Rect& area, uint32_t tilesX,
+                                            const std::vector<CompositePass>& passes, const TiledImage* base) {
+    std::vector<uint64_t> current(signatures.size());
+    ThreadPool::GetInstance().ParallelFor(current.size(), [&](size_t index) {
+        Rect tileRect = GridTileRect(area, static_cast<uint32_t>(index % tilesX), static_cast<uint32_t>(index / tilesX));
+        current[index] = TileSignature(passes, tileRect, area.x, area.y, base);
+    });
+
+    std::vector<uint32_t> dirty;
+    for (size_t index = 0; index < current.size(); index++) {
+        if (signatures[index] != current[index]) {
+            signatures[index] = current[index];
+            dirty.push_back(static_cast<uint32_t>(index));
+        }
+    }
+    return dirty;
+}
+
+// Brings a tiled composite of passes over area up to date: the tiles whose
+// signature changed are recomposited in parallel. Positions in signatures
+// are relative to the area, so moving everything together redoes nothing.
+// Assign keeps a tile that came out the same (so composites built on top of
+// it stay clean) and stores transparent tiles sparsely; each index writes
+// only its own tile.
+static void UpdateTiledComposite(TiledImage& cache, std::vector<uint64_t>& signatures, const Rect& area,
+                                 const std::vector<CompositePass>& layerPasses, PixelFormat format,
+                                 BlendSpace space, BufferManager::Storage storage, bool finish) {
+    std::vector<CompositePass> passes = FuseAdjustments(layerPasses);
+    if (cache.GetWidth() != static_cast<uint32_t>(area.width) || cache.GetHeight() != static_cast<uint32_t>(area.height) ||
+        cache.GetFormat() != format || signatures.size() != cache.GetTileCount()) {
+        cache = TiledImage(static_cast<uint32_t>(area.width), static_cast<uint32_t>(area.height), format, storage);
+        signatures.assign(cache.GetTileCount(), 0);
+    }
+
+    uint32_t tilesX = cache.GetTilesX();
+    std::vector<uint32_t> dirty = FindDirtyTiles(signatures, area, tilesX, passes, nullptr);
+
+    ThreadPool::GetInstance().ParallelFor(dirty.size(), [&](size_t index) {
+        Rect tileRect = GridTileRect(area, dirty[index] % tilesX, dirty[index] / tilesX);
+        ScratchScope scratch;
+        BufferManager::BufferView tile = scratch.AllocateView(tileRect.width, tileRect.height, format);
+        CompositeTile(tile, tileRect, passes, space, nullptr, finish);
+        cache.Assign(tileRect.x - area.x, tileRect.y - area.y, tile);
+    });
+}
+
+// The cache covers the combined bounds of the visible children
+void LayerManager::UpdateGroupCache(Layer& group, PixelFormat format, BlendSpace space, BufferManager::Storage storage) {
+    std::vector<CompositePass> passes;
+    BuildCompositePasses(group.children_, format, space, storage, 1.0f, passes);
+    Rect bounds;
+    for (const CompositePass& pass : passes) {
+        if (!pass.program) bounds = bounds.Union(pass.bounds);
+    }
+
+    UpdateTiledComposite(group.pixels_, group.groupSignatures_, bounds, passes, format, space, storage, true);
+    group.width_ = group.pixels_.GetWidth();
+    group.height_ = group.pixels_.GetHeight();
+    group.x_ = bounds.x;
+    group.y_ = bounds.y;
+}
+
+void LayerManager::UpdateGroupCaches(std::vector<std::unique_ptr<Layer>>& layers, PixelFormat format, BlendSpace space,
+                                     BufferManager::Storage storage) {
+    for (const auto& layer : layers) {
+        if (!layer->IsGroup()) continue;
+        if (layer->GetGroupMode() == GroupMode::Isolated) {
+            UpdateGroupCache(*layer, format, space, storage);
+        } else {
+            UpdateGroupCaches(layer->children_, format, space, storage);
+        }
+    }
+}
+
+std::vector<CompositePass> LayerManager::ApplyStackCaches(const std::vector<CompositePass>& passes, const Rect& canvas,
+                                                          const TiledImage*& base) const {
+    base = nullptr;
+    size_t active = passes.size();
+    for (size_t i = 0; i < passes.size() && activeLayer_; i++) {
+        if (IsWithin(activeLayer_, passes[i].layer)) {
+            active = i;
+            break;
+        }
+    }
+
+    // Source-over is associative, so the layers above can be merged ahead of
+    // time only if they all blend Normal
+    bool cacheBelow = active < passes.size() && active >= MIN_STACK_CACHE_PASSES;
+    bool cacheAbove = active < passes.size() && passes.size() - active - 1 >= MIN_STACK_CACHE_PASSES &&
+        std::all_of(passes.begin() + active + 1, passes.end(),
+                    [](const CompositePass& pass) { return pass.mode == BlendMode::Normal && !pass.program; });
+
+    PixelFormat accumulator = AccumulatorFormat(format_, blendSpace_);
+    std::vector<CompositePass> frame;
+    if (cacheBelow) {
+        std::vector<CompositePass> below(passes.begin(), passes.begin() + active);
+        UpdateTiledComposite(stackBelow_, stackBelowSignatures_, canvas, below, accumulator, blendSpace_, storage_,
+                             false);
+        base = &stackBelow_;
+    } else {
+        stackBelow_ = TiledImage();
+        stackBelowSignatures_.clear();
+        frame.assign(passes.begin(), passes.begin() + std::min(active, passes.size()));
+    }
+
+    if (active == passes.size()) {
+        stackAbove_ = TiledImage();
+        stackAboveSignatures_.clear();
+        return frame;
+    }
+    frame.push_back(passes[active]);
+
+    if (cacheAbove) {
+        std::vector<CompositePass> above(passes.begin() + active + 1, passes.end());
+        UpdateTiledComposite(stackAbove_, stackAboveSignatures_, canvas, above, accumulator, blendSpace_, storage_,
+                             false);
+        frame.push_back({&stackAbove_, canvas, SelectPremultipliedOver(accumulator), 1.0f, BlendMode::Normal, nullptr,
+                         nullptr, nullptr});
+    } else {
+        stackAbove_ = TiledImage();
+        stackAboveSignatures_.clear();
+        frame.insert(frame.end(), passes.begin() + active + 1, passes.end());
+    }
+    return frame;
+}
+
 BufferManager::Buffer LayerManager::CompositeLayers(uint32_t width, uint32_t height) const {
     std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(mutex_));
     
-    BufferManager::Buffer result = BufferManager::Create(width, height);
-    BufferManager::Clear(result, 0, 0, 0, 0);
+    uint32_t tilesX = (width + TiledImage::TILE_SIZE - 1) / TiledImage::TILE_SIZE;
+    uint32_t tilesY = (height + TiledImage::TILE_SIZE - 1) / TiledImage::TILE_SIZE;
+    if (!composite_.data || composite_.width != width || composite_.height != height || composite_.format != format_) {
+        BufferManager::Destroy(composite_);
+        composite_ = BufferManager::Create(width, height, format_, storage_);
+        compositeSignatures_.assign(static_cast<size_t>(tilesX) * tilesY, 0);
+        if (!composite_.data) return BufferManager::Buffer();
+    }
+
+    std::vector<CompositePass> layerPasses;
+    BuildCompositePasses(layers_, format_, blendSpace_, storage_, 1.0f, layerPasses);
+    Rect canvas(0, 0, static_cast<int>(width), static_cast<int>(height));
+    const TiledImage* base = nullptr;
+    std::vector<CompositePass> passes = FuseAdjustments(ApplyStackCaches(layerPasses, canvas, base));
+
+    std::vector<uint32_t> dirty = FindDirtyTiles(compositeSignatures_, canvas, tilesX, passes, base);
+
+    // Tiles are independent and each one blends its layers in stack order,
+    // so the output does not depend on how tiles land on threads
+    BufferManager::Buffer& composite = composite_;
+    ThreadPool::GetInstance().ParallelFor(dirty.size(), [&](size_t index) {
+        Rect tileRect = GridTileRect(canvas, dirty[index] % tilesX, dirty[index] / tilesX);
+        CompositeTile(BufferManager::GetView(composite, tileRect.x, tileRect.y, tileRect.width, tileRect.height),
+                      tileRect, passes, blendSpace_, base);
+    });
     
+    return BufferManager::Clone(composite_);
+}
+
+// Group caches are updated on a copy of the tree (sharing every tile),
+// which leaves the snapshot as it was published
+void DocumentSnapshot::BuildPasses(std::vector<std::unique_ptr<Layer>>& working,
+                                   std::vector<CompositePass>& passes) const {
+    working.reserve(layers_.size());
     for (const auto& layer : layers_) {
-        if (!layer->IsVisible()) continue;
-        
-        // Simple alpha compositing (can be extended for blend modes)
-        float opacity = layer->GetOpacity();
-        const auto& src = layer->GetBuffer();
-        
-        for (uint32_t y = 0; y < std::min(height, layer->GetHeight()); y++) {
-            for (uint32_t x = 0; x < std::min(width, layer->GetWidth()); x++) {
-                const uint8_t* srcPixel = BufferManager::GetPixel(src, x, y);
-                uint8_t* dstPixel = BufferManager::GetPixel(result, x, y);
-                
-                if (srcPixel && dstPixel) {
-                    float srcA = srcPixel[3] / 255.0f * opacity;
-                    float dstA = dstPixel[3] / 255.0f;
-                    float outA = srcA + dstA * (1.0f - srcA);
-                    
-                    if (outA > 0.0f) {
-                        for (int i = 0; i < 3; i++) {
-                            float srcC = srcPixel[i] / 255.0f;
-                            float dstC = dstPixel[i] / 255.0f;
-                            dstPixel[i] = static_cast<uint8_t>((srcC * srcA + dstC * dstA * (1.0f - srcA)) / outA * 255.0f);
-                        }
-                        dstPixel[3] = static_cast<uint8_t>(outA * 255.0f);
-                    }
+        working.push_back(LayerManager::CloneLayer(*layer, layer->GetName()));
+    }
+
+    std::vector<CompositePass> layerPasses;
+    LayerManager::BuildCompositePasses(working, format_, blendSpace_, storage_, 1.0f, layerPasses);
+    passes = FuseAdjustments(layerPasses);
+}
+
+std::vector<std::unique_ptr<Layer>> DocumentSnapshot::ComposeLayers() const {
+    std::vector<std::unique_ptr<Layer>> working;
+    working.reserve(layers_.size());
+    for (const auto& layer : layers_) {
+        working.push_back(LayerManager::CloneLayer(*layer, layer->GetName()));
+    }
+    LayerManager::UpdateGroupCaches(working, format_, blendSpace_, storage_);
+    return working;
+}
+
+BufferManager::Buffer DocumentSnapshot::Composite() const {
+    BufferManager::Buffer composite = BufferManager::Create(width_, height_, format_, storage_);
+    if (!composite.data) return composite;
+
+    std::vector<std::unique_ptr<Layer>> working;
+    std::vector<CompositePass> passes;
+    BuildPasses(working, passes);
+
+    Rect canvas(0, 0, static_cast<int>(width_), static_cast<int>(height_));
+    uint32_t tilesX = (width_ + TiledImage::TILE_SIZE - 1) / TiledImage::TILE_SIZE;
+    uint32_t tilesY = (height_ + TiledImage::TILE_SIZE - 1) / TiledImage::TILE_SIZE;
+    ThreadPool::GetInstance().ParallelFor(static_cast<size_t>(tilesX) * tilesY, [&](size_t index) {
+        Rect tileRect = GridTileRect(canvas, static_cast<uint32_t>(index % tilesX), static_cast<uint32_t>(index / tilesX));
+        CompositeTile(BufferManager::GetView(composite, tileRect.x, tileRect.y, tileRect.width, tileRect.height),
+                      tileRect, passes, blendSpace_);
+    });
+    return composite;
+}
+
+bool DocumentSnapshot::CompositeBands(const BandConsumer& consume) const {
+    std::vector<std::unique_ptr<Layer>> working;
+    std::vector<CompositePass> passes;
+    BuildPasses(working, passes);
+
+    BufferManager::Buffer ring[BAND_RING];
+    bool allocated = true;
+    for (BufferManager::Buffer& band : ring) {
+        band = BufferManager::Create(width_, TiledImage::TILE_SIZE, format_);
+        allocated = allocated && band.data;
+    }
+    if (!allocated) {
+        for (BufferManager::Buffer& band : ring) BufferManager::Destroy(band);
+        return false;
+    }
+
+    // Band b lives in ring[b % BAND_RING]; the producer waits for the
+    // consumer to release a buffer before compositing into it again
+    Rect canvas(0, 0, static_cast<int>(width_), static_cast<int>(height_));
+    uint32_t tilesX = (width_ + TiledImage::TILE_SIZE - 1) / TiledImage::TILE_SIZE;
+    uint32_t bandCount = (height_ + TiledImage::TILE_SIZE - 1) / TiledImage::TILE_SIZE;
+    std::mutex mutex;
+    std::condition_variable changed;
+    uint32_t produced = 0, consumed = 0;
+    bool stopped = false;
+    std::exception_ptr error;
+
+    // A thread of its own rather than a pool task, so a caller on a pool
+    // thread cannot starve it; its ParallelFor still spreads the tiles
+    std::thread producer([&] {
+        try {
+            for (uint32_t band = 0; band < bandCount; band++) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&] { return stopped || band - consumed < BAND_RING; });
+                    if (stopped) return;
+                }
+                BufferManager::Buffer& buffer = ring[band % BAND_RING];
+                ThreadPool::GetInstance().ParallelFor(tilesX, [&](size_t tileX) {
+                    Rect tileRect = GridTileRect(canvas, static_cast<uint32_t>(tileX), band);
+                    CompositeTile(BufferManager::GetView(buffer, tileRect.x, 0, tileRect.width, tileRect.height),
+                                  tileRect, passes, blendSpace_);
+                });
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    produced = band + 1;
                 }
+                changed.notify_all();
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+            stopped = true;
+            changed.notify_all();
+        }
+    });
+
+    auto stop = [&] {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        changed.notify_all();
+        producer.join();
+        for (BufferManager::Buffer& band : ring) BufferManager::Destroy(band);
+    };
+
+    bool complete = true;
+    try {
+        for (uint32_t band = 0; band < bandCount && complete; band++) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return stopped || produced > band; });
+                if (produced <= band) break; // The producer failed
             }
+            uint32_t y = band * TiledImage::TILE_SIZE;
+            const BufferManager::Buffer& buffer = ring[band % BAND_RING];
+            complete = consume(y, BufferManager::GetView(buffer, 0, 0, width_, std::min(TiledImage::TILE_SIZE, height_ - y)));
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                consumed = band + 1;
+            }
+            changed.notify_all();
         }
+    } catch (...) {
+        stop();
+        throw;
     }
-    
-    return result;
+    stop();
+    if (error) std::rethrow_exception(error);
+    return complete && consumed == bandCount;
+}
+
+size_t LayerManager::DropGroupCache(Layer& layer) {
+    if (!layer.group_) return 0;
+    size_t freed = layer.pixels_.GetResidentBytes();
+    layer.pixels_ = TiledImage();
+    layer.width_ = layer.height_ = 0;
+    layer.groupSignatures_.clear();
+    return freed;
+}
+
+// Calls fn for every layer in a stack, children after their group
+template<typename Fn>
+static void ForEachLayer(const std::vector<std::unique_ptr<Layer>>& layers, Fn&& fn) {
+    for (const auto& layer : layers) {
+        fn(*layer);
+        ForEachLayer(layer->GetChildren(), fn);
+    }
+}
+
+size_t LayerManager::DropStackCachesLocked() {
+    size_t freed = stackBelow_.GetResidentBytes() + stackAbove_.GetResidentBytes();
+    stackBelow_ = TiledImage();
+    stackAbove_ = TiledImage();
+    stackBelowSignatures_.clear();
+    stackAboveSignatures_.clear();
+    return freed;
+}
+
+void LayerManager::ConvertLayerPixels(Layer& layer, PixelFormat format) {
+    if (layer.pixels_.IsEmpty() || layer.pixels_.GetFormat() == format) return;
+    layer.pixels_ = layer.pixels_.Convert(format, format == PixelFormat::RGBA8);
+}
+
+void LayerManager::SetPixelFormat(PixelFormat format) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (format == format_) return;
+    format_ = format;
+
+    // Group caches are rebuilt in the new format rather than converted
+    ForEachLayer(layers_, [format](Layer& layer) {
+        if (layer.IsGroup()) {
+            DropGroupCache(layer);
+        } else {
+            ConvertLayerPixels(layer, format);
+        }
+    });
+    BufferManager::Destroy(composite_);
+    compositeSignatures_.clear();
+    DropStackCachesLocked();
+}
+
+void LayerManager::SetBlendSpace(BlendSpace space) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (space == blendSpace_) return;
+    blendSpace_ = space;
+
+    // Every cache holds values blended the old way
+    BufferManager::Destroy(composite_);
+    compositeSignatures_.clear();
+    DropStackCachesLocked();
+    ForEachLayer(layers_, [](Layer& layer) { DropGroupCache(layer); });
 }
 
+void LayerManager::InvalidateComposite() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    BufferManager::Destroy(composite_);
+    compositeSignatures_.clear();
+    DropStackCachesLocked();
+    ForEachLayer(layers_, [](Layer& layer) { DropGroupCache(layer); });
+}
+
+std::shared_ptr<const DocumentSnapshot> LayerManager::Publish(uint32_t width, uint32_t height) {
+    auto snapshot = std::make_shared<DocumentSnapshot>();
+    std::lock_guard<std::mutex> lock(mutex_);
+    snapshot->layers_.reserve(layers_.size());
+    for (const auto& layer : layers_) {
+        snapshot->layers_.push_back(CloneLayer(*layer, layer->GetName()));
+    }
+    snapshot->version_ = ++snapshotVersion_;
+    snapshot->width_ = width;
+    snapshot->height_ = height;
+    snapshot->format_ = format_;
+    snapshot->blendSpace_ = blendSpace_;
+    snapshot->storage_ = storage_;
+
+    // Stored under the layer lock so versions go out in order; readers
+    // holding the previous version keep it alive, and it is released
+    // outside snapshotMutex_
+    std::shared_ptr<const DocumentSnapshot> published = std::move(snapshot);
+    std::shared_ptr<const DocumentSnapshot> previous = published;
+    {
+        std::lock_guard<std::mutex> snapshotLock(snapshotMutex_);
+        snapshot_.swap(previous);
+    }
+    return published;
+}
+
+std::shared_ptr<const DocumentSnapshot> LayerManager::GetSnapshot() const {
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    return snapshot_;
+}
+
+size_t LayerManager::GetMemoryUsage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t bytes = composite_.storage == BufferManager::Storage::Heap ? composite_.size : 0;
+    ForEachLayer(layers_, [&](const Layer& layer) {
+        bytes += layer.GetPixels().GetResidentBytes() + layer.GetMask().GetResidentBytes();
+    });
+    return bytes;
+}
+
+size_t LayerManager::Reclaim(size_t bytes) {
+    (void)bytes;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The composite and group caches can always be rebuilt from the layers
+    size_t freed = composite_.storage == BufferManager::Storage::Heap ? composite_.size : 0;
+    BufferManager::Destroy(composite_);
+    compositeSignatures_.clear();
+
+    ForEachLayer(layers_, [&](Layer& layer) {
+        freed += DropGroupCache(layer);
+        if (&layer != activeLayer_ && layer.GetPixels().GetStorage() == BufferManager::Storage::Mapped) {
+            layer.GetPixels().Advise(AccessHint::DontNeed);
+        }
+    });
+    return freed; // Pages dropped from RAM are not heap bytes
+}
@@ -1,8 +1,14 @@
 #pragma once
+#include "ColorProgram.h"
 #include "../Memory/BufferManager.h"
+#include "../Memory/TiledImage.h"
+#include "../Memory/TiledMask.h"
+#include "../Memory/MemoryGovernor.h"
+#include "../Math/Rect.h"
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <functional>
 #include <memory>
 #include <mutex>
 
@@ -21,13 +27,61 @@ enum class BlendMode {
     Exclusion
 };
 
+// How a group's children reach the layers below it
+enum class GroupMode {
+    PassThrough, // Children blend into the stack as if ungrouped (group opacity scales them)
+    Isolated     // Children composite on their own, then blend as one layer
+};
+
+// Values blend as stored (sRGB-encoded), or decoded to linear light
+enum class BlendSpace {
+    SRGB,  // Classic: blending on the encoded values
+    Linear // Gamma-correct: layers are decoded, blended in float and re-encoded
+};
+
+// A layer's pixels cover only its bounds: width x height at a position in
+// document coordinates, which may extend past the canvas. Moving a layer
+// changes the position only.
+//
+// A pixel layer may have a mask over the same bounds: 8-bit coverage that
+// scales the layer's alpha per pixel when compositing (255 shows it, 0
+// hides it). Trimming cuts the mask along with the pixels.
+//
+// A group layer holds child layers (bottom to top) instead of painted
+// pixels. An isolated group's pixels are the cached composite of its
+// children, covering their combined bounds; the compositor keeps it up to
+// date. Moving a group moves its children.
+//
+// An adjustment layer holds parameters instead of pixels and recolors the
+// stack below it (up to an enclosing isolated group) when composited;
+// opacity mixes the adjusted colors with the originals and the blend mode
+// is not used.
+//
+// Layer itself is not synchronized. Once a layer is in a LayerManager, the
+// memory governor and Publish walk it from other threads under the
+// manager's lock, so changes to it (setters, pixels, mask) go through
+// LayerManager::EditLayer. Layers of a DocumentSnapshot are const.
 class Layer {
 public:
-    Layer(uint32_t width, uint32_t height, const std::string& name = "Layer");
+    Layer(uint32_t width, uint32_t height, const std::string& name = "Layer",
+          PixelFormat format = PixelFormat::RGBA8,
+          BufferManager::Storage storage = BufferManager::Storage::Heap);
     ~Layer();
 
     uint32_t GetWidth() const { return width_; }
     uint32_t GetHeight() const { return height_; }
+
+    int GetX() const { return x_; }
+    int GetY() const { return y_; }
+    void SetPosition(int x, int y) { Move(x - x_, y - y_); }
+    void Move(int dx, int dy);
+    Rect GetBounds() const { return Rect(x_, y_, static_cast<int>(width_), static_cast<int>(height_)); }
+
+    // Shrinks the pixels to the bounding box of non-transparent content and
+    // moves the position to match; a fully transparent layer becomes empty.
+    // Returns the new bounds (groups are left as they are).
+    Rect TrimToContent();
+    PixelFormat GetFormat() const { return pixels_.GetFormat(); }
     const std::string& GetName() const { return name_; }
     void SetName(const std::string& name) { name_ = name; }
 
@@ -42,21 +96,118 @@ public:
     BlendMode GetBlendMode() const { return blendMode_; }
     void SetBlendMode(BlendMode mode) { blendMode_ = mode; }
 
-    BufferManager::Buffer& GetBuffer() { return buffer_; }
-    const BufferManager::Buffer& GetBuffer() const { return buffer_; }
+    // Copy-on-write pixel storage; copying it shares tiles with this layer
+    TiledImage& GetPixels() { return pixels_; }
+    const TiledImage& GetPixels() const { return pixels_; }
+
+    // Layer mask (pixel layers; groups and adjustment layers ignore it)
+    bool HasMask() const { return !mask_.IsEmpty(); }
+    void AddMask(uint8_t value = 255) { mask_ = TiledMask(width_, height_, value); }
+    void RemoveMask() { mask_ = TiledMask(); }
+    TiledMask& GetMask() { return mask_; }
+    const TiledMask& GetMask() const { return mask_; }
 
     bool IsLocked() const { return locked_; }
     void SetLocked(bool locked) { locked_ = locked; }
 
+    // Groups (children are managed through LayerManager)
+    bool IsGroup() const { return group_; }
+    GroupMode GetGroupMode() const { return groupMode_; }
+    void SetGroupMode(GroupMode mode) { groupMode_ = mode; }
+    size_t GetChildCount() const { return children_.size(); }
+    Layer* GetChild(size_t index) { return index < children_.size() ? children_[index].get() : nullptr; }
+    const Layer* GetChild(size_t index) const { return index < children_.size() ? children_[index].get() : nullptr; }
+    const std::vector<std::unique_ptr<Layer>>& GetChildren() const { return children_; }
+    Layer* GetParent() const { return parent_; } // null at the top level
+
+    // Adjustment layers (created through LayerManager)
+    bool IsAdjustment() const { return adjustmentLayer_; }
+    const Adjustment& GetAdjustment() const { return adjustment_; }
+    void SetAdjustment(const Adjustment& adjustment) { adjustment_ = adjustment; }
+
 private:
-    BufferManager::Buffer buffer_;
+    friend class LayerManager;
+
+    TiledImage pixels_;
+    TiledMask mask_;
     uint32_t width_ = 0;
     uint32_t height_ = 0;
+    int x_ = 0;
+    int y_ = 0;
     std::string name_;
     bool visible_ = true;
     float opacity_ = 1.0f;
     BlendMode blendMode_ = BlendMode::Normal;
     bool locked_ = false;
+
+    bool group_ = false;
+    GroupMode groupMode_ = GroupMode::Isolated;
+    Layer* parent_ = nullptr;
+    std::vector<std::unique_ptr<Layer>> children_;
+    // Isolated groups: per pixels_ tile, a signature of what went into it
+    // (0 = needs compositing)
+    std::vector<uint64_t> groupSignatures_;
+
+    bool adjustmentLayer_ = false;
+    Adjustment adjustment_;
+};
+
+struct CompositePass;
+
+// One published version of a document: its layer tree, canvas size and
+// compositing settings as they were at LayerManager::Publish. Nothing in
+// it changes afterwards, so any thread can read it without locks while the
+// live layers are being edited. The layers share tiles and masks with the
+// live ones (copy-on-write), so a version costs a pointer per tile, and an
+// edit copies only the tiles it touches while a version still holds them.
+class DocumentSnapshot {
+public:
+    uint64_t GetVersion() const { return version_; }
+    uint32_t GetWidth() const { return width_; }
+    uint32_t GetHeight() const { return height_; }
+    PixelFormat GetPixelFormat() const { return format_; }
+    BlendSpace GetBlendSpace() const { return blendSpace_; }
+
+    size_t GetLayerCount() const { return layers_.size(); }
+    const Layer* GetLayer(size_t index) const { return index < layers_.size() ? layers_[index].get() : nullptr; }
+    const std::vector<std::unique_ptr<Layer>>& GetLayers() const { return layers_; }
+
+    // Composite of the whole canvas (caller owns it), in parallel tiles.
+    // Nothing is cached between calls; isolated group caches taken along
+    // at publish are reused where still valid, on a private copy, so several
+    // threads can composite the same version at once.
+    BufferManager::Buffer Composite() const;
+
+    // Streams the composite instead: bands of TILE_SIZE rows (fewer at the
+    // bottom) go to consume top to bottom, on the calling thread, while a
+    // producer thread composites the next ones into a ring of BAND_RING
+    // reusable buffers. Peak memory is the ring, not the image. consume
+    // gets the first row of the band and its pixels (valid until it
+    // returns); returning false stops the stream, and so does a failed
+    // allocation. Returns true if every band was consumed.
+    using BandConsumer = std::function<bool(uint32_t y, const BufferManager::ConstBufferView& band)>;
+    bool CompositeBands(const BandConsumer& consume) const;
+
+    static constexpr size_t BAND_RING = 3;
+
+    // Copy of the layers (sharing tiles with the snapshot) with the cache of
+    // every isolated group composited, hidden groups included, for writers
+    // that store a group as one layer
+    std::vector<std::unique_ptr<Layer>> ComposeLayers() const;
+
+private:
+    friend class LayerManager;
+
+    // Passes over a copy of the layers (working) with its group caches up to date
+    void BuildPasses(std::vector<std::unique_ptr<Layer>>& working, std::vector<CompositePass>& passes) const;
+
+    std::vector<std::unique_ptr<Layer>> layers_;
+    uint64_t version_ = 0;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    PixelFormat format_ = PixelFormat::RGBA8;
+    BlendSpace blendSpace_ = BlendSpace::SRGB;
+    BufferManager::Storage storage_ = BufferManager::Storage::Heap;
 };
 
 class LayerManager {
@@ -64,11 +215,24 @@ public:
     LayerManager();
     ~LayerManager();
 
-    // Layer management
+    // Layer management. Indices address the top level of the stack; a
+    // deleted group takes its children with it.
     Layer* CreateLayer(uint32_t width, uint32_t height, const std::string& name = "Layer");
     void DeleteLayer(size_t index);
     void DeleteLayer(Layer* layer);
+
+    // Groups: a new group is empty and goes on top of the stack.
+    // MoveToGroup puts a layer on top of a group (null = the top level); a
+    // group cannot be moved into itself or its own children.
+    Layer* CreateGroup(const std::string& name = "Group", GroupMode mode = GroupMode::Isolated);
+    bool MoveToGroup(Layer* layer, Layer* group);
+
+    // Adjustment layers go on top of the stack like new layers. Changing
+    // the parameters later only redoes the composite, not any layer pixels.
+    Layer* CreateAdjustmentLayer(const Adjustment& adjustment, const std::string& name = "Adjustment");
     
+    // The pointers stay valid until the layer is deleted. Read them on the
+    // editing thread; change the layers through EditLayer.
     Layer* GetLayer(size_t index);
     const Layer* GetLayer(size_t index) const;
     Layer* GetActiveLayer() { return activeLayer_; }
@@ -76,15 +240,157 @@ public:
     void SetActiveLayer(Layer* layer);
 
     size_t GetLayerCount() const { return layers_.size(); }
+
+    // Storage format of the layers and the composite. Changing it converts
+    // every layer, group children included (dithered when going down to
+    // RGBA8), and redoes the composite and caches.
+    PixelFormat GetPixelFormat() const { return format_; }
+    void SetPixelFormat(PixelFormat format);
+
+    // Where new layers and the composite keep their pixels
+    BufferManager::Storage GetStorage() const { return storage_; }
+    void SetStorage(BufferManager::Storage storage) { storage_ = storage; }
+
+    // Where the composite blends (per document). Linear light accumulates in
+    // premultiplied 16-bit integers (RGBA8) or float, so it costs more than
+    // SRGB; changing it redoes the composite and caches.
+    BlendSpace GetBlendSpace() const { return blendSpace_; }
+    void SetBlendSpace(BlendSpace space);
+
     void MoveLayer(size_t from, size_t to);
     void DuplicateLayer(size_t index);
 
-    // Composite all visible layers into a single buffer
+    // Runs edit(*layer) under the layer lock, so the memory governor and
+    // Publish never see a layer halfway through a change. EditLayers runs
+    // edit on every top-level layer under one lock. Keep long work (filters,
+    // decoding) outside and only store the result in here.
+    template<typename Edit>
+    void EditLayer(Layer* layer, Edit&& edit) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (layer) edit(*layer);
+    }
+    template<typename Edit>
+    void EditLayers(Edit&& edit) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& layer : layers_) edit(*layer);
+    }
+
+    // Composite all visible layers into a single buffer (caller owns it).
+    // The manager keeps the previous composite and redoes only the tiles whose
+    // inputs changed since: layer pixels (by tile generation), opacity,
+    // visibility, blend mode and stacking order. Dirty tiles are composited
+    // in parallel on the shared ThreadPool, each with all layers at once.
+    // Isolated groups are brought up to date the same way first, so an edit
+    // inside one group leaves the caches of the others alone. Per tile, the
+    // stack is walked top-down to the first layer that covers the tile
+    // opaquely (Normal, full opacity); nothing under it is read, and
+    // transparent layer tiles are skipped. Layer masks scale the source
+    // alpha inside the blend kernels; where a mask tile is all black the
+    // layer is skipped as if transparent, and mask edits redo only the tiles
+    // they change.
+    //
+    // Adjustment layers are evaluated here, on the tiles being redone: each
+    // run of consecutive adjustments is compiled into one ColorProgram and
+    // applied to the accumulator in the same pass as the blending.
+    //
+    // Layers blend into a premultiplied accumulator that returns to straight
+    // alpha once per row: the document format itself in SRGB (RGBA32F for
+    // RGBA16F documents). In linear light it is 16-bit for RGBA8 documents
+    // and float otherwise: each layer span is decoded from sRGB through
+    // tables as it is blended, and the finished band is encoded back once.
+    // Adjustments still see encoded color, as they do in SRGB.
+    //
+    // While a layer is active, the layers below it and (when they all blend
+    // Normal, with no adjustments among them) the layers above it are kept pre-composited in stack caches,
+    // so edits to the active layer blend three inputs per tile. The caches
+    // follow the stack by the same per-tile signatures; they are dropped
+    // when they stop applying or under memory pressure. Merging the layers
+    // above rounds in a different order, so RGBA8 results can differ from
+    // an uncached composite in the low bits.
     BufferManager::Buffer CompositeLayers(uint32_t width, uint32_t height) const;
 
+    // Drops the cached composite and group caches; the next CompositeLayers
+    // rebuilds them
+    void InvalidateComposite();
+
+    // Snapshots. Publish captures the layers as a new immutable version over
+    // a width x height canvas; call it from the thread that edits them,
+    // between edits (not while holding a tile from GetTileForWrite).
+    // GetSnapshot returns the latest version (null before the first Publish)
+    // without taking the layer lock, so render, save and analysis threads
+    // never wait on editing or compositing. It is not lock-free: the
+    // pointer is copied under a separate lock held only for that copy (what
+    // std::atomic<std::shared_ptr> does internally in the common standard
+    // libraries), so a reader can wait on another reader or a Publish for
+    // a reference count update at most. A version lives as long as its last
+    // reader holds it.
+    std::shared_ptr<const DocumentSnapshot> Publish(uint32_t width, uint32_t height);
+    std::shared_ptr<const DocumentSnapshot> GetSnapshot() const;
+
+    // Memory governor hooks: heap bytes held by layers, their masks and the
+    // cached composites. Reclaim drops the composite and group caches and pages
+    // inactive scratch-file layers out (layer pixels are never discarded).
+    size_t GetMemoryUsage() const;
+    size_t Reclaim(size_t bytes);
+
 private:
+    friend class DocumentSnapshot;
+
+    // The stack a layer lives in (its parent's children or the top level)
+    std::vector<std::unique_ptr<Layer>>& GetSiblings(Layer* layer);
+    void DeleteLayerLocked(std::vector<std::unique_ptr<Layer>>& siblings, size_t index);
+    static std::unique_ptr<Layer> CloneLayer(const Layer& source, const std::string& name);
+
+    // Compositor (LayerManager.cpp). Building the passes of a stack brings
+    // the caches of the isolated groups in it up to date.
+    static void BuildCompositePasses(const std::vector<std::unique_ptr<Layer>>& layers, PixelFormat format,
+                                     BlendSpace space, BufferManager::Storage storage, float opacityScale,
+                                     std::vector<CompositePass>& passes);
+    static void UpdateGroupCache(Layer& group, PixelFormat format, BlendSpace space, BufferManager::Storage storage);
+    // Every isolated group in a stack, including those inside pass-through groups
+    static void UpdateGroupCaches(std::vector<std::unique_ptr<Layer>>& layers, PixelFormat format, BlendSpace space,
+                                  BufferManager::Storage storage);
+    // Returns the heap bytes freed (0 for layers that are not groups)
+    static size_t DropGroupCache(Layer& layer);
+    // Pixel layers to the document format (dithered down to RGBA8)
+    static void ConvertLayerPixels(Layer& layer, PixelFormat format);
+
+    // Swaps the layers around the active one for the stack caches where
+    // they apply; base is set to the below cache (the accumulator the
+    // composite starts from) or null
+    std::vector<CompositePass> ApplyStackCaches(const std::vector<CompositePass>& passes, const Rect& canvas,
+                                                const TiledImage*& base) const;
+    size_t DropStackCachesLocked();
+
+    // Fewest layers worth merging into a stack cache
+    static constexpr size_t MIN_STACK_CACHE_PASSES = 2;
+
     std::vector<std::unique_ptr<Layer>> layers_;
     Layer* activeLayer_ = nullptr;
+    PixelFormat format_ = PixelFormat::RGBA8;
+    BlendSpace blendSpace_ = BlendSpace::SRGB;
+    BufferManager::Storage storage_ = BufferManager::Storage::Heap;
+    MemoryGovernor::ConsumerId governorId_ = 0;
+    MemoryGovernor::ConsumerId stackCacheGovernorId_ = 0;
     mutable std::mutex mutex_;
+
+    // Latest published version; swapped whole, never modified. Guarded by
+    // snapshotMutex_, never held with anything else taken inside it.
+    std::shared_ptr<const DocumentSnapshot> snapshot_;
+    mutable std::mutex snapshotMutex_;
+    uint64_t snapshotVersion_ = 0;
+
+    // Cached composite and, per composite tile, a signature of everything
+    // that went into it (0 = needs compositing)
+    mutable BufferManager::Buffer composite_;
+    mutable std::vector<uint64_t> compositeSignatures_;
+
+    // Stack caches around the active layer, canvas-sized. Both hold the
+    // composite accumulator (premultiplied, in AccumulatorFormat).
+    // Signatures as for the composite.
+    mutable TiledImage stackBelow_;
+    mutable TiledImage stackAbove_;
+    mutable std::vector<uint64_t> stackBelowSignatures_;
+    mutable std::vector<uint64_t> stackAboveSignatures_;
 };
 
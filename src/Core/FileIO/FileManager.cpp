@@ -14,12 +14,30 @@ bool FileManager::LoadImage(const std::string& filepath, BufferManager::Buffer&
     bool result = ImageCodecs::LoadImage(wpath.c_str(), img);
     if (result && img.valid) {
         outBuffer = BufferManager::Create(img.width, img.height);
-        std::memcpy(outBuffer.data, img.pixels.data(), outBuffer.size);
+        BufferManager::ConstBufferView src(img.pixels.data(), img.width, img.height,
+                                           static_cast<size_t>(img.width) * 4);
+        BufferManager::Copy(src, BufferManager::GetView(outBuffer));
         return true;
     }
     return false;
 }
 
+// Rows handed to the encoder per call when saving a buffer
+static constexpr uint32_t SAVE_BAND_ROWS = TiledImage::TILE_SIZE;
+
+// Codecs take RGBA8; deeper formats are dithered down one band at a time
+// (the dither pattern repeats every 4 rows, so bands match a whole-image
+// conversion)
+static bool WriteBand(ImageWriter& writer, const BufferManager::ConstBufferView& band, std::vector<uint8_t>& staging) {
+    if (band.format == PixelFormat::RGBA8) {
+        return writer.WriteRows(band.data, band.height, static_cast<UINT>(band.stride));
+    }
+    size_t stride = static_cast<size_t>(band.width) * 4;
+    staging.resize(stride * band.height);
+    BufferManager::Convert(band, BufferManager::BufferView(staging.data(), band.width, band.height, stride), true);
+    return writer.WriteRows(staging.data(), band.height, static_cast<UINT>(stride));
+}
+
 bool FileManager::SaveImage(const std::string& filepath, const BufferManager::Buffer& buffer) {
     if (!buffer.data || buffer.width == 0 || buffer.height == 0) {
         return false;
@@ -28,26 +46,45 @@ bool FileManager::SaveImage(const std::string& filepath, const BufferManager::Bu
     // Convert to wide string for WIC
     std::wstring wpath(filepath.begin(), filepath.end());
 
-    ImageData img;
-    img.width = buffer.width;
-    img.height = buffer.height;
-    img.pixels.assign(buffer.data, buffer.data + buffer.size);
-    img.valid = true;
+    ImageWriter writer;
+    if (!writer.Open(wpath.c_str(), buffer.width, buffer.height)) return false;
 
-    return ImageCodecs::SaveImage(wpath.c_str(), img);
+    std::vector<uint8_t> staging;
+    for (uint32_t y = 0; y < buffer.height; y += SAVE_BAND_ROWS) {
+        uint32_t rows = std::min(SAVE_BAND_ROWS, buffer.height - y);
+        if (!WriteBand(writer, BufferManager::GetView(buffer, 0, static_cast<int>(y), buffer.width, rows), staging)) {
+            return false;
+        }
+    }
+    return writer.Commit();
 }
 
-bool FileManager::LoadPSD(const std::string& filepath, ImageEngine* engine) {
-    if (!engine) {
+bool FileManager::SaveImage(const std::string& filepath, const DocumentSnapshot& snapshot) {
+    if (snapshot.GetWidth() == 0 || snapshot.GetHeight() == 0) {
         return false;
     }
-    return PSDFormat::Load(filepath, engine);
+
+    // Convert to wide string for WIC
+    std::wstring wpath(filepath.begin(), filepath.end());
+
+    ImageWriter writer;
+    if (!writer.Open(wpath.c_str(), snapshot.GetWidth(), snapshot.GetHeight())) return false;
+
+    std::vector<uint8_t> staging;
+    bool written = snapshot.CompositeBands([&](uint32_t, const BufferManager::ConstBufferView& band) {
+        return WriteBand(writer, band, staging);
+    });
+    return written && writer.Commit();
 }
 
-bool FileManager::SavePSD(const std::string& filepath, ImageEngine* engine) {
+bool FileManager::LoadPSD(const std::string& filepath, ImageEngine* engine) {
     if (!engine) {
         return false;
     }
-    return PSDFormat::Save(filepath, engine);
+    return PSDFormat::Load(filepath, engine);
+}
+
+bool FileManager::SavePSD(const std::string& filepath, const DocumentSnapshot& snapshot) {
+    return PSDFormat::Save(filepath, snapshot);
 }
 
@@ -6,8 +6,10 @@ class FileManager {
 public:
     static bool LoadImage(const std::string& filepath, BufferManager::Buffer& outBuffer);
     static bool SaveImage(const std::string& filepath, const BufferManager::Buffer& buffer);
+    // Composites and encodes band by band, without a full-size composite
+    static bool SaveImage(const std::string& filepath, const class DocumentSnapshot& snapshot);
     
     static bool LoadPSD(const std::string& filepath, class ImageEngine* engine);
-    static bool SavePSD(const std::string& filepath, class ImageEngine* engine);
+    static bool SavePSD(const std::string& filepath, const class DocumentSnapshot& snapshot);
 };
 
@@ -5,6 +5,7 @@
 #pragma comment(lib, "windowscodecs.lib")
 
 bool ImageCodecs::LoadImage(const wchar_t* filepath, ImageData& out) {
+    ComScope com;
     out.valid = false;
 
     IWICImagingFactory* factory = nullptr;
@@ -91,6 +92,16 @@ bool ImageCodecs::SaveImage(const wchar_t* filepath, const ImageData& img) {
         return false;
     }
 
+    ImageWriter writer;
+    return writer.Open(filepath, img.width, img.height) &&
+           writer.WriteRows(img.pixels.data(), img.height, img.width * 4) &&
+           writer.Commit();
+}
+
+bool ImageWriter::Open(const wchar_t* filepath, UINT width, UINT height) {
+    Release();
+    if (width == 0 || height == 0) return false;
+
     // Determine file format from extension
     const wchar_t* ext = wcsrchr(filepath, L'.');
     if (!ext) return false;
@@ -104,60 +115,23 @@ bool ImageCodecs::SaveImage(const wchar_t* filepath, const ImageData& img) {
         containerFormat = GUID_ContainerFormatTiff;
     }
 
-    IWICImagingFactory* factory = nullptr;
     HRESULT hr = CoCreateInstance(
         CLSID_WICImagingFactory,
         nullptr,
         CLSCTX_INPROC_SERVER,
-        IID_PPV_ARGS(&factory)
+        IID_PPV_ARGS(&factory_)
     );
-    if (FAILED(hr)) return false;
-
-    // Create stream
-    IWICStream* stream = nullptr;
-    hr = factory->CreateStream(&stream);
-    if (FAILED(hr)) {
-        factory->Release();
-        return false;
-    }
-
-    hr = stream->InitializeFromFilename(filepath, GENERIC_WRITE);
-    if (FAILED(hr)) {
-        stream->Release();
-        factory->Release();
-        return false;
-    }
-
-    // Create encoder
-    IWICBitmapEncoder* encoder = nullptr;
-    hr = factory->CreateEncoder(containerFormat, nullptr, &encoder);
-    if (FAILED(hr)) {
-        stream->Release();
-        factory->Release();
-        return false;
-    }
-
-    hr = encoder->Initialize(stream, WICBitmapEncoderNoCache);
-    if (FAILED(hr)) {
-        encoder->Release();
-        stream->Release();
-        factory->Release();
-        return false;
-    }
+    if (SUCCEEDED(hr)) hr = factory_->CreateStream(&stream_);
+    if (SUCCEEDED(hr)) hr = stream_->InitializeFromFilename(filepath, GENERIC_WRITE);
+    if (SUCCEEDED(hr)) hr = factory_->CreateEncoder(containerFormat, nullptr, &encoder_);
+    if (SUCCEEDED(hr)) hr = encoder_->Initialize(stream_, WICBitmapEncoderNoCache);
 
     // Create frame
-    IWICBitmapFrameEncode* frame = nullptr;
     IPropertyBag2* props = nullptr;
-    hr = encoder->CreateNewFrame(&frame, &props);
-    if (FAILED(hr)) {
-        encoder->Release();
-        stream->Release();
-        factory->Release();
-        return false;
-    }
+    if (SUCCEEDED(hr)) hr = encoder_->CreateNewFrame(&frame_, &props);
 
     // Set JPEG quality if applicable
-    if (containerFormat == GUID_ContainerFormatJpeg && props) {
+    if (SUCCEEDED(hr) && containerFormat == GUID_ContainerFormatJpeg && props) {
         PROPBAG2 option = {};
         option.pstrName = const_cast<LPOLESTR>(L"ImageQuality");
         VARIANT varValue;
@@ -167,72 +141,52 @@ bool ImageCodecs::SaveImage(const wchar_t* filepath, const ImageData& img) {
         props->Write(1, &option, &varValue);
     }
 
-    hr = frame->Initialize(props);
+    if (SUCCEEDED(hr)) hr = frame_->Initialize(props);
     if (props) props->Release();
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        stream->Release();
-        factory->Release();
-        return false;
-    }
-
-    hr = frame->SetSize(img.width, img.height);
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        stream->Release();
-        factory->Release();
-        return false;
-    }
+    if (SUCCEEDED(hr)) hr = frame_->SetSize(width, height);
 
     WICPixelFormatGUID format = GUID_WICPixelFormat32bppRGBA;
-    hr = frame->SetPixelFormat(&format);
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        stream->Release();
-        factory->Release();
-        return false;
-    }
+    if (SUCCEEDED(hr)) hr = frame_->SetPixelFormat(&format);
 
-    // Write pixels
-    hr = frame->WritePixels(
-        img.height,
-        img.width * 4,
-        img.width * img.height * 4,
-        const_cast<uint8_t*>(img.pixels.data())
-    );
     if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        stream->Release();
-        factory->Release();
+        Release();
         return false;
     }
+    width_ = width;
+    height_ = height;
+    rowsWritten_ = 0;
+    return true;
+}
 
-    hr = frame->Commit();
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        stream->Release();
-        factory->Release();
-        return false;
-    }
+bool ImageWriter::WriteRows(const uint8_t* rows, UINT count, UINT stride) {
+    if (!frame_ || count > height_ - rowsWritten_) return false;
 
-    hr = encoder->Commit();
+    // Each call appends rows to the frame
+    HRESULT hr = frame_->WritePixels(count, stride, stride * count, const_cast<uint8_t*>(rows));
     if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        stream->Release();
-        factory->Release();
+        Release();
         return false;
     }
+    rowsWritten_ += count;
+    return true;
+}
 
-    frame->Release();
-    encoder->Release();
-    stream->Release();
-    factory->Release();
+bool ImageWriter::Commit() {
+    if (!frame_ || rowsWritten_ != height_) return false;
 
-    return true;
+    HRESULT hr = frame_->Commit();
+    if (SUCCEEDED(hr)) hr = encoder_->Commit();
+    Release();
+    return SUCCEEDED(hr);
+}
+
+void ImageWriter::Release() {
+    if (frame_) frame_->Release();
+    if (encoder_) encoder_->Release();
+    if (stream_) stream_->Release();
+    if (factory_) factory_->Release();
+    frame_ = nullptr;
+    encoder_ = nullptr;
+    stream_ = nullptr;
+    factory_ = nullptr;
 }
@@ -15,8 +15,50 @@ struct ImageData {
     bool valid = false;
 };
 
+// Keeps COM initialized on the calling thread while in scope, so WIC works
+// off the UI thread. A thread that already joined an apartment keeps it.
+class ComScope {
+public:
+    ComScope() : initialized_(SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED))) {}
+    ~ComScope() { if (initialized_) CoUninitialize(); }
+    ComScope(const ComScope&) = delete;
+    ComScope& operator=(const ComScope&) = delete;
+
+private:
+    bool initialized_;
+};
+
 class ImageCodecs {
 public:
     static bool LoadImage(const wchar_t* filepath, ImageData& out);
     static bool SaveImage(const wchar_t* filepath, const ImageData& img);
 };
+
+// Encodes an image a band of rows at a time, so the whole image never has
+// to be in memory. Rows are RGBA8 and go top to bottom; the file is only
+// complete after Commit (destroying the writer earlier abandons it). Use a
+// writer on the thread that created it.
+class ImageWriter {
+public:
+    ImageWriter() = default;
+    ~ImageWriter() { Release(); }
+    ImageWriter(const ImageWriter&) = delete;
+    ImageWriter& operator=(const ImageWriter&) = delete;
+
+    // The container follows the extension (PNG if it is not recognized)
+    bool Open(const wchar_t* filepath, UINT width, UINT height);
+    bool WriteRows(const uint8_t* rows, UINT count, UINT stride);
+    bool Commit();
+
+private:
+    void Release();
+
+    ComScope com_; // declared first: outlives the interfaces below
+    IWICImagingFactory* factory_ = nullptr;
+    IWICStream* stream_ = nullptr;
+    IWICBitmapEncoder* encoder_ = nullptr;
+    IWICBitmapFrameEncode* frame_ = nullptr;
+    UINT width_ = 0;
+    UINT height_ = 0;
+    UINT rowsWritten_ = 0;
+};
@@ -1,11 +1,18 @@
 #include "PSDFormat.h"
+#include "../Memory/ScratchArena.h"
 #include <fstream>
 #include <cstring>
+#include <algorithm>
 
 // PSD file header constants
 #define PSD_SIGNATURE "8BPS"
 #define PSD_VERSION 1
 
+// Additional layer information key for adjustment layers: type (U32) and
+// amount (float bits, U32). Private to Foto; other readers skip the block
+// and see an empty layer.
+#define PSD_ADJUSTMENT_KEY "fAdj"
+
 // Helper functions to write/read big-endian data
 static void WriteU16BE(std::ofstream& file, uint16_t value) {
     uint8_t bytes[2] = {
@@ -40,6 +47,93 @@ static uint32_t ReadU32BE(std::ifstream& file) {
            bytes[3];
 }
 
+// PSD has no half-float depth; FP16 documents are stored as 32-bit float
+static PixelFormat FileFormatFor(PixelFormat format) {
+    return (format == PixelFormat::RGBA16F) ? PixelFormat::RGBA32F : format;
+}
+
+static PixelFormat FormatForDepth(uint16_t depth) {
+    switch (depth) {
+        case 16: return PixelFormat::RGBA16;
+        case 32: return PixelFormat::RGBA32F;
+        default: return PixelFormat::RGBA8;
+    }
+}
+
+// Blend mode keys, in BlendMode order
+static const char BLEND_KEYS[][5] = {
+    "norm", "mul ", "scrn", "over", "sLit", "hLit", "div ", "idiv", "dark", "lite", "diff", "smud"
+};
+
+static BlendMode BlendModeForKey(const char* key) {
+    for (size_t i = 0; i < sizeof(BLEND_KEYS) / sizeof(BLEND_KEYS[0]); i++) {
+        if (std::memcmp(key, BLEND_KEYS[i], 4) == 0) return static_cast<BlendMode>(i);
+    }
+    return BlendMode::Normal;
+}
+
+// A layer as written. Pass-through groups are written as their children,
+// with the group's opacity and visibility folded in; isolated groups as
+// their cached composite.
+struct SavedLayer {
+    const Layer* layer;
+    float opacity;
+    bool visible;
+};
+
+static void CollectSavedLayers(const std::vector<std::unique_ptr<Layer>>& layers, float opacityScale, bool visible,
+                               std::vector<SavedLayer>& saved) {
+    for (const auto& layer : layers) {
+        float opacity = layer->GetOpacity() * opacityScale;
+        bool shown = visible && layer->IsVisible();
+        if (layer->IsGroup() && layer->GetGroupMode() == GroupMode::PassThrough) {
+            CollectSavedLayers(layer->GetChildren(), opacity, shown, saved);
+        } else {
+            saved.push_back({layer.get(), opacity, shown});
+        }
+    }
+}
+
+// PSD samples are big-endian; reverses the bytes of each sample in place
+// (8-bit samples are left alone)
+static void SwapSampleBytes(uint8_t* data, size_t samples, size_t sampleBytes) {
+    if (sampleBytes == 2) {
+        for (size_t i = 0; i < samples; i++, data += 2) {
+            std::swap(data[0], data[1]);
+        }
+    } else if (sampleBytes == 4) {
+        for (size_t i = 0; i < samples; i++, data += 4) {
+            std::swap(data[0], data[3]);
+            std::swap(data[1], data[2]);
+        }
+    }
+}
+
+// Write the rows of a view in the file's pixel format
+static void WriteRows(std::ofstream& file, const BufferManager::ConstBufferView& rows, PixelFormat fileFormat) {
+    size_t sampleBytes = BytesPerPixel(fileFormat) / 4;
+    size_t rowBytes = static_cast<size_t>(rows.width) * BytesPerPixel(fileFormat);
+    if (rows.format == fileFormat && sampleBytes == 1) {
+        for (uint32_t y = 0; y < rows.height; y++) {
+            file.write(reinterpret_cast<const char*>(rows.Row(y)), rowBytes);
+        }
+        return;
+    }
+
+    ScratchScope scratch;
+    BufferManager::BufferView row = scratch.AllocateView(rows.width, 1, fileFormat);
+    for (uint32_t y = 0; y < rows.height; y++) {
+        BufferManager::ConstBufferView src(rows.Row(y), rows.width, 1, rows.stride, rows.format);
+        if (rows.format == fileFormat) {
+            std::memcpy(row.data, src.data, rowBytes);
+        } else {
+            BufferManager::Convert(src, row);
+        }
+        SwapSampleBytes(row.data, static_cast<size_t>(rows.width) * 4, sampleBytes);
+        file.write(reinterpret_cast<const char*>(row.data), rowBytes);
+    }
+}
+
 bool PSDFormat::Load(const std::string& filepath, ImageEngine* engine) {
     if (!engine) return false;
 
@@ -79,7 +173,7 @@ bool PSDFormat::Load(const std::string& filepath, ImageEngine* engine) {
     uint32_t layerMaskLength = ReadU32BE(file);
 
     // Create new document
-    engine->CreateNew(width, height);
+    engine->CreateNew(width, height, "Untitled", FormatForDepth(depth));
 
     if (layerMaskLength > 0) {
         uint32_t layerInfoLength = ReadU32BE(file);
@@ -92,11 +186,11 @@ bool PSDFormat::Load(const std::string& filepath, ImageEngine* engine) {
         // Read layer records
         std::vector<Layer*> layers;
         for (int i = 0; i < layerCount; i++) {
-            // Read layer bounds
-            uint32_t top = ReadU32BE(file);
-            uint32_t left = ReadU32BE(file);
-            uint32_t bottom = ReadU32BE(file);
-            uint32_t right = ReadU32BE(file);
+            // Read layer bounds (signed: layers may extend past the canvas)
+            int32_t top = static_cast<int32_t>(ReadU32BE(file));
+            int32_t left = static_cast<int32_t>(ReadU32BE(file));
+            int32_t bottom = static_cast<int32_t>(ReadU32BE(file));
+            int32_t right = static_cast<int32_t>(ReadU32BE(file));
 
             uint16_t numChannels = ReadU16BE(file);
 
@@ -139,44 +233,92 @@ bool PSDFormat::Load(const std::string& filepath, ImageEngine* engine) {
             int namePadding = ((nameLength + 1 + 3) & ~3) - (nameLength + 1);
             file.seekg(namePadding, std::ios::cur);
 
-            // Skip to end of extra data
-            file.seekg(extraDataStart + extraDataSize, std::ios::beg);
+            // Additional layer information: only adjustments are read
+            bool isAdjustment = false;
+            Adjustment adjustment;
+            long extraDataEnd = extraDataStart + static_cast<long>(extraDataSize);
+            while (file && static_cast<long>(file.tellg()) + 12 <= extraDataEnd) {
+                char blockSig[4], blockKey[4];
+                file.read(blockSig, 4);
+                file.read(blockKey, 4);
+                uint32_t blockLength = ReadU32BE(file);
+                long blockEnd = static_cast<long>(file.tellg()) + static_cast<long>(blockLength);
+                if (std::memcmp(blockSig, "8BIM", 4) == 0 && std::memcmp(blockKey, PSD_ADJUSTMENT_KEY, 4) == 0 &&
+                    blockLength >= 8) {
+                    uint32_t type = ReadU32BE(file);
+                    uint32_t amountBits = ReadU32BE(file);
+                    if (type <= static_cast<uint32_t>(AdjustmentType::Saturation)) {
+                        adjustment.type = static_cast<AdjustmentType>(type);
+                        std::memcpy(&adjustment.amount, &amountBits, sizeof(amountBits));
+                        isAdjustment = true;
+                    }
+                }
+                file.seekg(blockEnd, std::ios::beg);
+            }
 
-            // Create layer
-            Layer* layer = engine->GetLayerManager().CreateLayer(
-                right - left,
-                bottom - top,
-                std::string(layerName)
-            );
-            layer->SetOpacity(opacity / 255.0f);
-            layer->SetVisible((flags & 2) == 0);
+            // Skip to end of extra data
+            file.seekg(extraDataEnd, std::ios::beg);
+
+            // Create layer covering only its bounds
+            LayerManager& layerManager = engine->GetLayerManager();
+            Layer* layer = isAdjustment
+                ? layerManager.CreateAdjustmentLayer(adjustment, std::string(layerName))
+                : layerManager.CreateLayer(
+                      right > left ? static_cast<uint32_t>(right - left) : 0,
+                      bottom > top ? static_cast<uint32_t>(bottom - top) : 0,
+                      std::string(layerName));
+            layerManager.EditLayer(layer, [&](Layer& created) {
+                if (!isAdjustment) created.SetPosition(left, top);
+                created.SetOpacity(opacity / 255.0f);
+                created.SetVisible((flags & 2) == 0);
+                created.SetBlendMode(BlendModeForKey(blendKey));
+            });
 
             layers.push_back(layer);
         }
 
-        // Read layer pixel data
+        // Read layer pixel data one tile row at a time
         for (size_t i = 0; i < layers.size(); i++) {
             Layer* layer = layers[i];
-            auto& buffer = layer->GetBuffer();
+            TiledImage& pixels = layer->GetPixels();
+            if (pixels.IsEmpty()) continue;
 
             // For simplicity, assume raw uncompressed RGBA data
-            if (buffer.data && buffer.size > 0) {
-                file.read(reinterpret_cast<char*>(buffer.data), buffer.size);
+            ScratchScope scratch;
+            BufferManager::BufferView band = scratch.AllocateView(pixels.GetWidth(), TiledImage::TILE_SIZE, pixels.GetFormat());
+            size_t rowBytes = static_cast<size_t>(band.width) * band.bytesPerPixel;
+            for (uint32_t bandY = 0; bandY < pixels.GetHeight(); bandY += TiledImage::TILE_SIZE) {
+                uint32_t rows = std::min(TiledImage::TILE_SIZE, pixels.GetHeight() - bandY);
+                for (uint32_t y = 0; y < rows; y++) {
+                    file.read(reinterpret_cast<char*>(band.Row(y)), rowBytes);
+                    SwapSampleBytes(band.Row(y), static_cast<size_t>(band.width) * 4, band.bytesPerPixel / 4);
+                }
+                // Transparent and single-color tiles are stored sparsely
+                engine->GetLayerManager().EditLayer(layer, [&](Layer& target) {
+                    target.GetPixels().Assign(0, bandY, BufferManager::GetSubView(band, 0, 0, band.width, rows));
+                });
             }
+
+            // Out-of-core documents: let the finished layer page out to the scratch file
+            engine->GetLayerManager().EditLayer(layer, [](Layer& target) {
+                target.GetPixels().Advise(AccessHint::DontNeed);
+            });
         }
     }
 
     return true;
 }
 
-bool PSDFormat::Save(const std::string& filepath, ImageEngine* engine) {
-    if (!engine) return false;
-
+bool PSDFormat::Save(const std::string& filepath, const DocumentSnapshot& snapshot) {
     std::ofstream file(filepath, std::ios::binary);
     if (!file.is_open()) return false;
 
-    uint32_t width = engine->GetWidth();
-    uint32_t height = engine->GetHeight();
+    uint32_t width = snapshot.GetWidth();
+    uint32_t height = snapshot.GetHeight();
+    PixelFormat fileFormat = FileFormatFor(snapshot.GetPixelFormat());
+    uint16_t depth = static_cast<uint16_t>(DispatchPixelFormat(fileFormat, [](auto traits) {
+        return decltype(traits)::BITS_PER_CHANNEL;
+    }));
 
     // Write File Header
     file.write(PSD_SIGNATURE, 4);
@@ -190,7 +332,7 @@ bool PSDFormat::Save(const std::string& filepath, ImageEngine* engine) {
     WriteU16BE(file, 4); // channels (RGBA)
     WriteU32BE(file, height);
     WriteU32BE(file, width);
-    WriteU16BE(file, 8); // depth (8 bits per channel)
+    WriteU16BE(file, depth); // bits per channel
     WriteU16BE(file, 3); // color mode (RGB)
 
     // Color Mode Data section (empty for RGB)
@@ -200,8 +342,12 @@ bool PSDFormat::Save(const std::string& filepath, ImageEngine* engine) {
     WriteU32BE(file, 0);
 
     // Layer and Mask Information section
-    LayerManager& layerMgr = engine->GetLayerManager();
-    size_t layerCount = layerMgr.GetLayerCount();
+    // Groups are written from their composited caches, which the snapshot
+    // may not have up to date (never composited, or dropped since)
+    std::vector<std::unique_ptr<Layer>> layers = snapshot.ComposeLayers();
+    std::vector<SavedLayer> saved;
+    CollectSavedLayers(layers, 1.0f, true, saved);
+    size_t layerCount = saved.size();
 
     // Calculate layer info size (approximate)
     std::streampos layerMaskLengthPos = file.tellp();
@@ -214,32 +360,32 @@ bool PSDFormat::Save(const std::string& filepath, ImageEngine* engine) {
 
     // Write layer records
     for (size_t i = 0; i < layerCount; i++) {
-        const Layer* layer = layerMgr.GetLayer(i);
-        if (!layer) continue;
+        const Layer* layer = saved[i].layer;
 
         // Layer bounds
-        WriteU32BE(file, 0); // top
-        WriteU32BE(file, 0); // left
-        WriteU32BE(file, layer->GetHeight()); // bottom
-        WriteU32BE(file, layer->GetWidth()); // right
+        Rect bounds = layer->GetBounds();
+        WriteU32BE(file, static_cast<uint32_t>(bounds.y)); // top
+        WriteU32BE(file, static_cast<uint32_t>(bounds.x)); // left
+        WriteU32BE(file, static_cast<uint32_t>(bounds.Bottom())); // bottom
+        WriteU32BE(file, static_cast<uint32_t>(bounds.Right())); // right
 
         WriteU16BE(file, 4); // number of channels (RGBA)
 
         // Channel info
         for (int c = 0; c < 4; c++) {
             WriteU16BE(file, c < 3 ? c : -1); // channel ID (0=R, 1=G, 2=B, -1=transparency)
-            WriteU32BE(file, layer->GetWidth() * layer->GetHeight()); // data length
+            WriteU32BE(file, layer->GetWidth() * layer->GetHeight() * (depth / 8)); // data length
         }
 
         // Blend mode signature
         file.write("8BIM", 4);
 
-        // Blend mode key (normal)
-        file.write("norm", 4);
+        // Blend mode key
+        file.write(BLEND_KEYS[static_cast<int>(layer->GetBlendMode())], 4);
 
-        file.put(static_cast<uint8_t>(layer->GetOpacity() * 255)); // opacity
+        file.put(static_cast<uint8_t>(saved[i].opacity * 255.0f + 0.5f)); // opacity
         file.put(0); // clipping
-        file.put(layer->IsVisible() ? 0 : 2); // flags
+        file.put(saved[i].visible ? 0 : 2); // flags
         file.put(0); // filler
 
         // Extra data
@@ -266,6 +412,18 @@ bool PSDFormat::Save(const std::string& filepath, ImageEngine* engine) {
             file.put(0);
         }
 
+        // Adjustment parameters (the layer has no pixels)
+        if (layer->IsAdjustment()) {
+            const Adjustment& adjustment = layer->GetAdjustment();
+            uint32_t amountBits;
+            std::memcpy(&amountBits, &adjustment.amount, sizeof(amountBits));
+            file.write("8BIM", 4);
+            file.write(PSD_ADJUSTMENT_KEY, 4);
+            WriteU32BE(file, 8);
+            WriteU32BE(file, static_cast<uint32_t>(adjustment.type));
+            WriteU32BE(file, amountBits);
+        }
+
         // Update extra data size
         std::streampos currentPos = file.tellp();
         uint32_t extraDataSize = static_cast<uint32_t>(currentPos - extraDataSizePos - 4);
@@ -274,15 +432,21 @@ bool PSDFormat::Save(const std::string& filepath, ImageEngine* engine) {
         file.seekp(currentPos);
     }
 
-    // Write layer pixel data
+    // Write layer pixel data one tile row at a time
     for (size_t i = 0; i < layerCount; i++) {
-        const Layer* layer = layerMgr.GetLayer(i);
-        if (!layer) continue;
-
-        const auto& buffer = layer->GetBuffer();
-        if (buffer.data && buffer.size > 0) {
-            file.write(reinterpret_cast<const char*>(buffer.data), buffer.size);
+        const Layer* layer = saved[i].layer;
+        const TiledImage& pixels = layer->GetPixels();
+        if (pixels.IsEmpty()) continue;
+
+        ScratchScope scratch;
+        BufferManager::BufferView band = scratch.AllocateView(pixels.GetWidth(), TiledImage::TILE_SIZE, pixels.GetFormat());
+        for (uint32_t bandY = 0; bandY < pixels.GetHeight(); bandY += TiledImage::TILE_SIZE) {
+            uint32_t rows = std::min(TiledImage::TILE_SIZE, pixels.GetHeight() - bandY);
+            BufferManager::BufferView bandView = BufferManager::GetSubView(band, 0, 0, band.width, rows);
+            pixels.Read(0, bandY, bandView);
+            WriteRows(file, bandView, fileFormat);
         }
+        pixels.Advise(AccessHint::DontNeed);
     }
 
     // Update layer info length
@@ -302,12 +466,11 @@ bool PSDFormat::Save(const std::string& filepath, ImageEngine* engine) {
     // Compression method (0 = raw)
     WriteU16BE(file, 0);
 
-    // Write composite RGBA data
-    BufferManager::Buffer composite = engine->GetCompositeImage();
-    if (composite.data && composite.size > 0) {
-        file.write(reinterpret_cast<const char*>(composite.data), composite.size);
-        BufferManager::Destroy(composite);
-    }
+    // Write composite RGBA data as it is composited, band by band
+    bool written = snapshot.CompositeBands([&](uint32_t, const BufferManager::ConstBufferView& band) {
+        WriteRows(file, band, fileFormat);
+        return file.good();
+    });
 
-    return true;
+    return written;
 }
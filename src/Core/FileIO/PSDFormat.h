@@ -5,6 +5,7 @@
 class PSDFormat {
 public:
     static bool Load(const std::string& filepath, ImageEngine* engine);
-    static bool Save(const std::string& filepath, ImageEngine* engine);
+    // Writes one published version, so the document can keep changing
+    static bool Save(const std::string& filepath, const DocumentSnapshot& snapshot);
 };
 
@@ -1,6 +1,8 @@
 #include "ColorSpace.h"
+#include "PixelOps.h"
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 
 HSLColor ColorSpace::RGBToHSL(const RGBColor& rgb) {
     float r = rgb.r;
@@ -165,6 +167,67 @@ float ColorSpace::SRGBToLinear(float srgb) {
     return (srgb <= 0.04045f) ? srgb / 12.92f : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
 }
 
+// Samples of both curves over 0..1, with the last one repeated so that 1.0
+// interpolates without a bounds check
+struct GammaTables {
+    float encode[ColorSpace::GAMMA_TABLE_SIZE + 2];
+    float decode[ColorSpace::GAMMA_TABLE_SIZE + 2];
+};
+
+static const GammaTables& GetGammaTables() {
+    static const GammaTables tables = [] {
+        GammaTables t;
+        for (uint32_t i = 0; i <= ColorSpace::GAMMA_TABLE_SIZE; i++) {
+            double x = static_cast<double>(i) / ColorSpace::GAMMA_TABLE_SIZE;
+            t.encode[i] = static_cast<float>(x <= 0.0031308 ? x * 12.92 : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055);
+            t.decode[i] = static_cast<float>(x <= 0.04045 ? x / 12.92 : std::pow((x + 0.055) / 1.055, 2.4));
+        }
+        t.encode[ColorSpace::GAMMA_TABLE_SIZE + 1] = t.encode[ColorSpace::GAMMA_TABLE_SIZE];
+        t.decode[ColorSpace::GAMMA_TABLE_SIZE + 1] = t.decode[ColorSpace::GAMMA_TABLE_SIZE];
+        return t;
+    }();
+    return tables;
+}
+
+// Table pass per chunk; chunks reaching outside 0..1 (HDR float values,
+// which the table clamps) take the exact curve instead
+static void ApplyGammaTable(float* dst, const float* src, size_t count, const float* table, float (*exact)(float)) {
+    float chunk[256];
+    for (size_t i = 0; i < count; i += 256) {
+        size_t n = std::min<size_t>(256, count - i);
+        if (PixelOps::InterpolateF32(chunk, src + i, n, table, ColorSpace::GAMMA_TABLE_SIZE)) {
+            std::memcpy(dst + i, chunk, n * sizeof(float));
+            continue;
+        }
+        for (size_t k = i; k < i + n; k++) {
+            dst[k] = exact(src[k]);
+        }
+    }
+}
+
+void ColorSpace::LinearToSRGB(float* dst, const float* src, size_t count) {
+    float (*exact)(float) = LinearToSRGB;
+    ApplyGammaTable(dst, src, count, GetGammaTables().encode, exact);
+}
+
+void ColorSpace::SRGBToLinear(float* dst, const float* src, size_t count) {
+    float (*exact)(float) = SRGBToLinear;
+    ApplyGammaTable(dst, src, count, GetGammaTables().decode, exact);
+}
+
+const uint8_t* ColorSpace::GetLinearToSRGB8Table() {
+    static const std::array<uint8_t, LINEAR_TO_SRGB8_SIZE + 3> table = [] {
+        std::array<uint8_t, LINEAR_TO_SRGB8_SIZE + 3> t{};
+        for (uint32_t i = 0; i < LINEAR_TO_SRGB8_SIZE; i++) {
+            double x = (i + 0.5) / LINEAR_TO_SRGB8_SIZE;
+            double srgb = x <= 0.0031308 ? x * 12.92 : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055;
+            t[i] = static_cast<uint8_t>(std::min(srgb * 255.0 + 0.5, 255.0));
+        }
+        return t;
+    }();
+    return table.data();
+}
+
 RGBColor ColorSpace::LinearToSRGB(const RGBColor& linear) {
     return RGBColor(
         LinearToSRGB(linear.r),
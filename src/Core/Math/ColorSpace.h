@@ -1,4 +1,6 @@
 #pragma once
+#include <array>
+#include <cstddef>
 #include <cstdint>
 
 struct RGBColor {
@@ -27,6 +29,37 @@ struct LABColor {
     float alpha = 1.0f;
 };
 
+// sRGB decoding evaluated at compile time: x^2.4 as x^2 times the fifth
+// root of x^2, found by Newton's method
+constexpr double SRGBToLinearConstexpr(double srgb) {
+    if (srgb <= 0.04045) return srgb / 12.92;
+    double x = (srgb + 0.055) / 1.055;
+    double square = x * x;
+    double root = 1.0;
+    for (int i = 0; i < 64; i++) {
+        root = (4.0 * root + square / (root * root * root * root)) / 5.0;
+    }
+    return square * root;
+}
+
+// Linear-light value of every 8-bit sRGB code
+inline constexpr std::array<float, 256> SRGB8_TO_LINEAR = [] {
+    std::array<float, 256> table{};
+    for (int code = 0; code < 256; code++) {
+        table[code] = static_cast<float>(SRGBToLinearConstexpr(code / 255.0));
+    }
+    return table;
+}();
+
+// The same in 16 bits (0-65535), for integer linear-light compositing
+inline constexpr std::array<uint16_t, 256> SRGB8_TO_LINEAR16 = [] {
+    std::array<uint16_t, 256> table{};
+    for (int code = 0; code < 256; code++) {
+        table[code] = static_cast<uint16_t>(SRGBToLinearConstexpr(code / 255.0) * 65535.0 + 0.5);
+    }
+    return table;
+}();
+
 class ColorSpace {
 public:
     // RGB <-> HSL conversions
@@ -51,5 +84,21 @@ public:
     static float SRGBToLinear(float srgb);
     static RGBColor LinearToSRGB(const RGBColor& linear);
     static RGBColor SRGBToLinear(const RGBColor& srgb);
+
+    // Gamma correction for spans, for per-pixel work such as linear-light
+    // compositing (dst may equal src). Spans within 0..1 interpolate between
+    // GAMMA_TABLE_SIZE + 1 samples of the curve, within 2e-5 of the exact
+    // functions; spans reaching outside take the exact path. 8-bit codes
+    // decode exactly through SRGB8_TO_LINEAR.
+    static constexpr uint32_t GAMMA_TABLE_SIZE = 4096;
+    static void LinearToSRGB(float* dst, const float* src, size_t count);
+    static void SRGBToLinear(float* dst, const float* src, size_t count);
+
+    // 8-bit sRGB code of each of LINEAR_TO_SRGB8_SIZE equal steps of linear
+    // light over 0..1 (taken at the middle of the step), within 0.8 codes
+    // of the exact encode: the PixelOps::EncodeLinear16 table for 16-bit
+    // linear composites (padded as it requires)
+    static constexpr uint32_t LINEAR_TO_SRGB8_SIZE = 4096;
+    static const uint8_t* GetLinearToSRGB8Table();
 };
 
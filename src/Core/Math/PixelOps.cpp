@@ -0,0 +1,428 @@
+#include "PixelOpsKernels.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef PIXELOPS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// --- Scalar reference kernels ---
+
+void ScalarFill(uint8_t* dst, size_t count, uint32_t color) {
+    for (size_t i = 0; i < count; i++) {
+        std::memcpy(dst + i * 4, &color, 4);
+    }
+}
+
+void ScalarSwizzleRB(uint8_t* dst, const uint8_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+        uint8_t r = src[0];
+        uint8_t b = src[2];
+        dst[0] = b;
+        dst[1] = src[1];
+        dst[2] = r;
+        dst[3] = src[3];
+    }
+}
+
+void ScalarPremultiply(uint8_t* dst, const uint8_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+        uint32_t a = src[3];
+        dst[0] = static_cast<uint8_t>(PixelOps::Div255(src[0] * a));
+        dst[1] = static_cast<uint8_t>(PixelOps::Div255(src[1] * a));
+        dst[2] = static_cast<uint8_t>(PixelOps::Div255(src[2] * a));
+        dst[3] = static_cast<uint8_t>(a);
+    }
+}
+
+void ScalarUnpremultiply(uint8_t* dst, const uint8_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+        uint8_t a = src[3];
+        if (a == 0) {
+            dst[0] = dst[1] = dst[2] = dst[3] = 0;
+            continue;
+        }
+        // Same operation order as the SIMD kernels so results are bit-identical
+        float af = static_cast<float>(a);
+        for (int c = 0; c < 3; c++) {
+            float v = static_cast<float>(src[c]) * 255.0f / af + 0.5f;
+            dst[c] = static_cast<uint8_t>(std::min(v, 255.0f));
+        }
+        dst[3] = a;
+    }
+}
+
+void ScalarAlphaOver(uint8_t* dst, const uint8_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+        uint32_t inv = 255 - src[3];
+        for (int c = 0; c < 4; c++) {
+            uint32_t v = src[c] + PixelOps::Div255(dst[c] * inv);
+            dst[c] = static_cast<uint8_t>(std::min<uint32_t>(v, 255));
+        }
+    }
+}
+
+void ScalarAlphaOverStraight(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity) {
+    for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+        uint32_t a = PixelOps::Div255(src[3] * opacity);
+        uint32_t inv = 255 - a;
+        for (int c = 0; c < 3; c++) {
+            dst[c] = static_cast<uint8_t>(PixelOps::Div255(src[c] * a) + PixelOps::Div255(dst[c] * inv));
+        }
+        dst[3] = static_cast<uint8_t>(a + PixelOps::Div255(dst[3] * inv));
+    }
+}
+
+void ScalarAlphaOverStraightMasked(uint8_t* dst, const uint8_t* src, const uint8_t* mask, size_t count,
+                                   uint32_t opacity) {
+    for (size_t i = 0; i < count; i++) {
+        ScalarAlphaOverStraight(dst + i * 4, src + i * 4, 1, PixelOps::Div255(mask[i] * opacity));
+    }
+}
+
+void ScalarAlphaOverStraight16(uint16_t* dst, const uint16_t* src, size_t count, uint32_t opacity) {
+    for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+        uint32_t a = PixelOps::Div65535(src[3] * opacity);
+        uint32_t inv = 65535 - a;
+        for (int c = 0; c < 3; c++) {
+            dst[c] = static_cast<uint16_t>(PixelOps::Div65535(src[c] * a + dst[c] * inv));
+        }
+        dst[3] = static_cast<uint16_t>(a + PixelOps::Div65535(dst[3] * inv));
+    }
+}
+
+void ScalarEncodeLinear16(uint8_t* dst, const uint16_t* src, size_t count, const uint8_t* table, uint32_t size) {
+    const float last = static_cast<float>(size - 1);
+    for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+        // Same operation order as the SIMD kernels so results are bit-identical
+        uint32_t a = src[3];
+        float scale = a == 0 ? 0.0f : static_cast<float>(size) / static_cast<float>(a);
+        for (int c = 0; c < 3; c++) {
+            float index = static_cast<float>(src[c]) * scale;
+            dst[c] = table[static_cast<uint32_t>(index < last ? index : last)];
+        }
+        dst[3] = static_cast<uint8_t>(PixelOps::Div65535(a * 255));
+    }
+}
+
+void ScalarU8ToF32(float* dst, const uint8_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = static_cast<float>(src[i]) * (1.0f / 255.0f);
+    }
+}
+
+void ScalarF32ToU8(uint8_t* dst, const float* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        // Written so NaN maps to 0, matching the SIMD min/max semantics
+        float v = src[i] * 255.0f + 0.5f;
+        v = v > 0.0f ? v : 0.0f;
+        v = v < 255.0f ? v : 255.0f;
+        dst[i] = static_cast<uint8_t>(v);
+    }
+}
+
+void ScalarU16ToF32(float* dst, const uint16_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = static_cast<float>(src[i]) * (1.0f / 65535.0f);
+    }
+}
+
+void ScalarF32ToU16(uint16_t* dst, const float* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float v = src[i] * 65535.0f + 0.5f;
+        v = v > 0.0f ? v : 0.0f;
+        v = v < 65535.0f ? v : 65535.0f;
+        dst[i] = static_cast<uint16_t>(v);
+    }
+}
+
+void ScalarF32ToF16(Half* dst, const float* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = HalfFloat::FromFloat(src[i]);
+    }
+}
+
+void ScalarF16ToF32(float* dst, const Half* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = HalfFloat::ToFloat(src[i]);
+    }
+}
+
+void ScalarDeinterleave(float* const planes[4], const float* src, size_t count) {
+    for (size_t i = 0; i < count; i++, src += 4) {
+        planes[0][i] = src[0];
+        planes[1][i] = src[1];
+        planes[2][i] = src[2];
+        planes[3][i] = src[3];
+    }
+}
+
+void ScalarInterleave(float* dst, const float* const planes[4], size_t count) {
+    for (size_t i = 0; i < count; i++, dst += 4) {
+        dst[0] = planes[0][i];
+        dst[1] = planes[1][i];
+        dst[2] = planes[2][i];
+        dst[3] = planes[3][i];
+    }
+}
+
+void ScalarLookupRGBA8ToF32(float* dst, const uint8_t* src, size_t count, const float* table) {
+    for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+        dst[0] = table[src[0]];
+        dst[1] = table[src[1]];
+        dst[2] = table[src[2]];
+        dst[3] = static_cast<float>(src[3]) * (1.0f / 255.0f);
+    }
+}
+
+void ScalarLookupRGBA8ToU16(uint16_t* dst, const uint8_t* src, size_t count, const uint16_t* table) {
+    for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+        dst[0] = table[src[0]];
+        dst[1] = table[src[1]];
+        dst[2] = table[src[2]];
+        dst[3] = static_cast<uint16_t>(src[3] * 257);
+    }
+}
+
+bool ScalarInterpolateF32(float* dst, const float* src, size_t count, const float* table, uint32_t size) {
+    bool inside = true;
+    for (size_t i = 0; i < count; i++) {
+        // Written so NaN maps to 0, matching the SIMD min/max semantics
+        float v = src[i] > 0.0f ? src[i] : 0.0f;
+        v = v < 1.0f ? v : 1.0f;
+        inside &= v == src[i];
+        float position = v * static_cast<float>(size);
+        uint32_t index = static_cast<uint32_t>(position);
+        float fraction = position - static_cast<float>(index);
+        dst[i] = table[index] + (table[index + 1] - table[index]) * fraction;
+    }
+    return inside;
+}
+
+// --- CPU detection and dispatch ---
+
+#ifdef PIXELOPS_X86
+static void CpuId(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; i++) regs[i] = static_cast<uint32_t>(info[i]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t ReadXCR0() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+static SimdLevel DetectLevel() {
+#ifdef PIXELOPS_X86
+    uint32_t regs[4];
+    CpuId(0, 0, regs);
+    uint32_t maxLeaf = regs[0];
+
+    CpuId(1, 0, regs);
+    bool sse2 = (regs[3] & (1u << 26)) != 0;
+    bool ssse3 = (regs[2] & (1u << 9)) != 0;
+    bool sse41 = (regs[2] & (1u << 19)) != 0;
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool avx = (regs[2] & (1u << 28)) != 0;
+    bool f16c = (regs[2] & (1u << 29)) != 0;
+
+    if (!sse2) return SimdLevel::Scalar;
+    if (!ssse3 || !sse41) return SimdLevel::SSE2;
+
+    // The OS must save the wider registers on context switches
+    uint64_t xcr0 = osxsave ? ReadXCR0() : 0;
+    bool avxState = (xcr0 & 0x6) == 0x6;
+    bool avx512State = (xcr0 & 0xE6) == 0xE6;
+
+    bool avx2 = false;
+    bool avx512 = false;
+    if (maxLeaf >= 7) {
+        CpuId(7, 0, regs);
+        avx2 = (regs[1] & (1u << 5)) != 0;
+        avx512 = (regs[1] & (1u << 16)) != 0 && (regs[1] & (1u << 30)) != 0; // F + BW
+    }
+
+    if (!(avx && avx2 && f16c && avxState)) return SimdLevel::SSE41;
+    if (!(avx512 && avx512State)) return SimdLevel::AVX2;
+    return SimdLevel::AVX512;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+static void BuildTable(PixelOpsTable& table, SimdLevel level) {
+    table.fill = ScalarFill;
+    table.swizzleRB = ScalarSwizzleRB;
+    table.premultiply = ScalarPremultiply;
+    table.unpremultiply = ScalarUnpremultiply;
+    table.alphaOver = ScalarAlphaOver;
+    table.alphaOverStraight = ScalarAlphaOverStraight;
+    table.alphaOverStraightMasked = ScalarAlphaOverStraightMasked;
+    table.alphaOverStraight16 = ScalarAlphaOverStraight16;
+    table.encodeLinear16 = ScalarEncodeLinear16;
+    table.u8ToF32 = ScalarU8ToF32;
+    table.f32ToU8 = ScalarF32ToU8;
+    table.u16ToF32 = ScalarU16ToF32;
+    table.f32ToU16 = ScalarF32ToU16;
+    table.f32ToF16 = ScalarF32ToF16;
+    table.f16ToF32 = ScalarF16ToF32;
+    table.deinterleave = ScalarDeinterleave;
+    table.interleave = ScalarInterleave;
+    table.lookupRGBA8ToF32 = ScalarLookupRGBA8ToF32;
+    table.lookupRGBA8ToU16 = ScalarLookupRGBA8ToU16;
+    table.interpolateF32 = ScalarInterpolateF32;
+
+#ifdef PIXELOPS_X86
+    if (level >= SimdLevel::SSE2) InitPixelOpsSSE2(table);
+    if (level >= SimdLevel::SSE41) InitPixelOpsSSE41(table);
+    if (level >= SimdLevel::AVX2) InitPixelOpsAVX2(table);
+    if (level >= SimdLevel::AVX512) InitPixelOpsAVX512(table);
+#endif
+}
+
+struct PixelOpsDispatch {
+    PixelOpsTable table;
+    SimdLevel supported;
+    SimdLevel level;
+
+    PixelOpsDispatch() : supported(DetectLevel()), level(supported) {
+        BuildTable(table, level);
+    }
+};
+
+static PixelOpsDispatch& GetDispatch() {
+    static PixelOpsDispatch dispatch;
+    return dispatch;
+}
+
+// --- Public API ---
+
+void PixelOps::Fill(uint8_t* dst, size_t count, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    const uint8_t bytes[4] = {r, g, b, a};
+    uint32_t color;
+    std::memcpy(&color, bytes, 4);
+    GetDispatch().table.fill(dst, count, color);
+}
+
+void PixelOps::Copy(uint8_t* dst, const uint8_t* src, size_t count) {
+    // The C runtime's memmove is already vectorized for every target
+    std::memmove(dst, src, count * 4);
+}
+
+void PixelOps::SwizzleRB(uint8_t* dst, const uint8_t* src, size_t count) {
+    GetDispatch().table.swizzleRB(dst, src, count);
+}
+
+void PixelOps::Premultiply(uint8_t* dst, const uint8_t* src, size_t count) {
+    GetDispatch().table.premultiply(dst, src, count);
+}
+
+void PixelOps::Unpremultiply(uint8_t* dst, const uint8_t* src, size_t count) {
+    GetDispatch().table.unpremultiply(dst, src, count);
+}
+
+void PixelOps::AlphaOver(uint8_t* dst, const uint8_t* src, size_t count) {
+    GetDispatch().table.alphaOver(dst, src, count);
+}
+
+void PixelOps::AlphaOverStraight(uint8_t* dst, const uint8_t* src, size_t count, uint8_t opacity) {
+    GetDispatch().table.alphaOverStraight(dst, src, count, opacity);
+}
+
+void PixelOps::AlphaOverStraightMasked(uint8_t* dst, const uint8_t* src, const uint8_t* mask, size_t count,
+                                       uint8_t opacity) {
+    GetDispatch().table.alphaOverStraightMasked(dst, src, mask, count, opacity);
+}
+
+void PixelOps::AlphaOverStraight16(uint16_t* dst, const uint16_t* src, size_t count, uint16_t opacity) {
+    GetDispatch().table.alphaOverStraight16(dst, src, count, opacity);
+}
+
+void PixelOps::EncodeLinear16(uint8_t* dst, const uint16_t* src, size_t count, const uint8_t* table,
+                              uint32_t size) {
+    GetDispatch().table.encodeLinear16(dst, src, count, table, size);
+}
+
+void PixelOps::ConvertU8ToF32(float* dst, const uint8_t* src, size_t count) {
+    GetDispatch().table.u8ToF32(dst, src, count);
+}
+
+void PixelOps::ConvertF32ToU8(uint8_t* dst, const float* src, size_t count) {
+    GetDispatch().table.f32ToU8(dst, src, count);
+}
+
+void PixelOps::ConvertU16ToF32(float* dst, const uint16_t* src, size_t count) {
+    GetDispatch().table.u16ToF32(dst, src, count);
+}
+
+void PixelOps::ConvertF32ToU16(uint16_t* dst, const float* src, size_t count) {
+    GetDispatch().table.f32ToU16(dst, src, count);
+}
+
+void PixelOps::ConvertF32ToF16(Half* dst, const float* src, size_t count) {
+    GetDispatch().table.f32ToF16(dst, src, count);
+}
+
+void PixelOps::ConvertF16ToF32(float* dst, const Half* src, size_t count) {
+    GetDispatch().table.f16ToF32(dst, src, count);
+}
+
+void PixelOps::Deinterleave(float* const planes[4], const float* src, size_t count) {
+    GetDispatch().table.deinterleave(planes, src, count);
+}
+
+void PixelOps::Interleave(float* dst, const float* const planes[4], size_t count) {
+    GetDispatch().table.interleave(dst, planes, count);
+}
+
+void PixelOps::LookupRGBA8ToF32(float* dst, const uint8_t* src, size_t count, const float* table) {
+    GetDispatch().table.lookupRGBA8ToF32(dst, src, count, table);
+}
+
+void PixelOps::LookupRGBA8ToU16(uint16_t* dst, const uint8_t* src, size_t count, const uint16_t* table) {
+    GetDispatch().table.lookupRGBA8ToU16(dst, src, count, table);
+}
+
+bool PixelOps::InterpolateF32(float* dst, const float* src, size_t count, const float* table, uint32_t size) {
+    return GetDispatch().table.interpolateF32(dst, src, count, table, size);
+}
+
+SimdLevel PixelOps::GetSupportedLevel() {
+    return GetDispatch().supported;
+}
+
+SimdLevel PixelOps::GetLevel() {
+    return GetDispatch().level;
+}
+
+const char* PixelOps::GetLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SSE2:   return "SSE2";
+        case SimdLevel::SSE41:  return "SSE4.1";
+        case SimdLevel::AVX2:   return "AVX2";
+        case SimdLevel::AVX512: return "AVX-512";
+        case SimdLevel::Scalar:
+        default:                return "Scalar";
+    }
+}
+
+void PixelOps::SetLevel(SimdLevel level) {
+    PixelOpsDispatch& dispatch = GetDispatch();
+    dispatch.level = std::min(level, dispatch.supported);
+    BuildTable(dispatch.table, dispatch.level);
+}
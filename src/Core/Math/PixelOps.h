@@ -0,0 +1,102 @@
+#pragma once
+#include "../Memory/PixelFormat.h"
+#include <cstdint>
+#include <cstddef>
+
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    SSE41,
+    AVX2,
+    AVX512
+};
+
+// Vectorized RGBA8 pixel primitives. The widest instruction set supported by
+// the CPU is selected at runtime; every kernel has a scalar reference, and
+// every level gives bit-identical results (NaN payloads included).
+// Counts are in pixels unless noted otherwise. Premultiplied kernels expect
+// every color channel to be <= alpha.
+class PixelOps {
+public:
+    // Fill count pixels with one color
+    static void Fill(uint8_t* dst, size_t count, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+    static void Copy(uint8_t* dst, const uint8_t* src, size_t count);
+
+    // RGBA <-> BGRA (dst may equal src)
+    static void SwizzleRB(uint8_t* dst, const uint8_t* src, size_t count);
+
+    // Straight <-> premultiplied alpha (dst may equal src)
+    static void Premultiply(uint8_t* dst, const uint8_t* src, size_t count);
+    static void Unpremultiply(uint8_t* dst, const uint8_t* src, size_t count);
+
+    // Premultiplied source-over: dst = src + dst * (1 - srcAlpha)
+    static void AlphaOver(uint8_t* dst, const uint8_t* src, size_t count);
+
+    // Straight-alpha source over a premultiplied destination, with the source
+    // alpha scaled by opacity (0-255). This is the layer compositing step:
+    //   a = src.a * opacity, dst = src * a + dst * (1 - a), all /255 rounded
+    static void AlphaOverStraight(uint8_t* dst, const uint8_t* src, size_t count, uint8_t opacity);
+
+    // AlphaOverStraight through an 8-bit coverage mask (one value per pixel):
+    // opacity is scaled by the mask first, so a full mask gives exactly
+    // AlphaOverStraight and a zero mask leaves dst alone
+    static void AlphaOverStraightMasked(uint8_t* dst, const uint8_t* src, const uint8_t* mask, size_t count,
+                                        uint8_t opacity);
+
+    // AlphaOverStraight on 16-bit channels (linear-light compositing of
+    // RGBA8 documents), with opacity 0-65535:
+    //   a = src.a * opacity / 65535, dst = (src * a + dst * (65535 - a)) / 65535
+    // each rounded once
+    static void AlphaOverStraight16(uint16_t* dst, const uint16_t* src, size_t count, uint16_t opacity);
+
+    // Premultiplied 16-bit pixels to straight RGBA8 through an encode table
+    // of size steps over 0..1. Color c under alpha a picks
+    // table[min(c * (size / a), size - 1)] in float math, truncated (a == 0
+    // gives table[0]); alpha is a * 255 / 65535 rounded. The table must be
+    // readable 3 bytes past its end, as gathers load 32 bits.
+    static void EncodeLinear16(uint8_t* dst, const uint16_t* src, size_t count, const uint8_t* table, uint32_t size);
+
+    // Channel conversions (counts are in channel values, not pixels)
+    static void ConvertU8ToF32(float* dst, const uint8_t* src, size_t count);
+    static void ConvertF32ToU8(uint8_t* dst, const float* src, size_t count);
+    static void ConvertU16ToF32(float* dst, const uint16_t* src, size_t count);
+    static void ConvertF32ToU16(uint16_t* dst, const float* src, size_t count);
+    static void ConvertF32ToF16(Half* dst, const float* src, size_t count);
+    static void ConvertF16ToF32(float* dst, const Half* src, size_t count);
+
+    // Interleaved RGBA floats <-> one array per channel (counts in pixels)
+    static void Deinterleave(float* const planes[4], const float* src, size_t count);
+    static void Interleave(float* dst, const float* const planes[4], size_t count);
+
+    // Transfer curves by table (gather-based on AVX2).
+    // LookupRGBA8ToF32: RGBA8 pixels to RGBA floats, color codes through a
+    // 256-entry table and alpha scaled as by ConvertU8ToF32 (count in pixels).
+    // InterpolateF32: values clamped to 0..1 (NaN to 0), interpolated between
+    // size + 1 evenly spaced samples; table[size + 1] must repeat
+    // table[size] (count in values). Returns false if any value was clamped.
+    static void LookupRGBA8ToF32(float* dst, const uint8_t* src, size_t count, const float* table);
+    // LookupRGBA8ToU16: the same to 16-bit channels, alpha scaled by 257.
+    static void LookupRGBA8ToU16(uint16_t* dst, const uint8_t* src, size_t count, const uint16_t* table);
+    static bool InterpolateF32(float* dst, const float* src, size_t count, const float* table, uint32_t size);
+
+    // Exact round(x / 255) for x in [0, 255 * 255]
+    static uint32_t Div255(uint32_t x) {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+    // Exact round(x / 65535) for x in [0, 65535 * 65535]
+    static uint32_t Div65535(uint32_t x) {
+        x += 32768;
+        return (x + (x >> 16)) >> 16;
+    }
+
+    // Instruction set selection
+    static SimdLevel GetSupportedLevel();
+    static SimdLevel GetLevel();
+    static const char* GetLevelName(SimdLevel level);
+
+    // Restrict dispatch to at most the given level (for comparisons and
+    // benchmarks). Not thread-safe with concurrent kernel calls.
+    static void SetLevel(SimdLevel level);
+};
@@ -0,0 +1,410 @@
+#include "PixelOpsKernels.h"
+
+#ifdef PIXELOPS_X86
+#include <immintrin.h>
+
+// AVX2 + F16C kernels. Pack instructions work per 128-bit lane, so results are
+// put back in pixel order with a cross-lane permute.
+
+static inline __m256i Div255Epu16(__m256i x) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+static inline __m256i BroadcastAlpha16(__m256i px) {
+    px = _mm256_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm256_shufflehi_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+// Reorders the output of packs_epi32 + packus_epi16 on four registers
+static inline __m256i PackOrder(__m256i v) {
+    return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+static void FillAVX2(uint8_t* dst, size_t count, uint32_t color) {
+    const __m256i v = _mm256_set1_epi32(static_cast<int>(color));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), v);
+    }
+    ScalarFill(dst + i * 4, count - i, color);
+}
+
+static void SwizzleRBAVX2(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m256i shuffle = _mm256_setr_epi8(
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_shuffle_epi8(v, shuffle));
+    }
+    ScalarSwizzleRB(dst + i * 4, src + i * 4, count - i);
+}
+
+static void PremultiplyAVX2(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i colorMask = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+    const __m256i alphaOne = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        __m256i lo = _mm256_unpacklo_epi8(v, zero);
+        __m256i hi = _mm256_unpackhi_epi8(v, zero);
+        __m256i aLo = _mm256_or_si256(_mm256_and_si256(BroadcastAlpha16(lo), colorMask), alphaOne);
+        __m256i aHi = _mm256_or_si256(_mm256_and_si256(BroadcastAlpha16(hi), colorMask), alphaOne);
+        lo = Div255Epu16(_mm256_mullo_epi16(lo, aLo));
+        hi = Div255Epu16(_mm256_mullo_epi16(hi, aHi));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_packus_epi16(lo, hi));
+    }
+    ScalarPremultiply(dst + i * 4, src + i * 4, count - i);
+}
+
+// Two pixels (eight bytes): c * 255 / a + 0.5 with alpha passed through
+static inline __m256i UnpremultiplyPair(const uint8_t* src) {
+    __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+    __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+    __m256 a = _mm256_shuffle_ps(f, f, _MM_SHUFFLE(3, 3, 3, 3));
+    __m256 v = _mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(f, _mm256_set1_ps(255.0f)), a), _mm256_set1_ps(0.5f));
+    v = _mm256_min_ps(v, _mm256_set1_ps(255.0f));
+    v = _mm256_blend_ps(v, f, 0x88);
+    v = _mm256_andnot_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_EQ_OQ), v);
+    return _mm256_cvttps_epi32(v);
+}
+
+static void UnpremultiplyAVX2(uint8_t* dst, const uint8_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint8_t* s = src + i * 4;
+        __m256i p01 = UnpremultiplyPair(s);
+        __m256i p23 = UnpremultiplyPair(s + 8);
+        __m256i p45 = UnpremultiplyPair(s + 16);
+        __m256i p67 = UnpremultiplyPair(s + 24);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(p01, p23), _mm256_packs_epi32(p45, p67));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), PackOrder(packed));
+    }
+    ScalarUnpremultiply(dst + i * 4, src + i * 4, count - i);
+}
+
+static void AlphaOverAVX2(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16(255);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i * 4));
+        __m256i invLo = _mm256_sub_epi16(full, BroadcastAlpha16(_mm256_unpacklo_epi8(s, zero)));
+        __m256i invHi = _mm256_sub_epi16(full, BroadcastAlpha16(_mm256_unpackhi_epi8(s, zero)));
+        __m256i lo = Div255Epu16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), invLo));
+        __m256i hi = Div255Epu16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), invHi));
+        __m256i result = _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), result);
+    }
+    ScalarAlphaOver(dst + i * 4, src + i * 4, count - i);
+}
+
+static inline __m256i OverStraight16(__m256i s, __m256i d, __m256i opacity) {
+    const __m256i alphaMask = _mm256_set1_epi64x(static_cast<long long>(0xFFFF000000000000ull));
+    __m256i a = Div255Epu16(_mm256_mullo_epi16(BroadcastAlpha16(s), opacity));
+    __m256i premul = Div255Epu16(_mm256_mullo_epi16(s, a));
+    premul = _mm256_blendv_epi8(premul, a, alphaMask);
+    __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+    return _mm256_add_epi16(premul, Div255Epu16(_mm256_mullo_epi16(d, inv)));
+}
+
+// Unpack and pack both work per lane, so pixel order is preserved
+static void AlphaOverStraightAVX2(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i op = _mm256_set1_epi16(static_cast<short>(opacity));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i * 4));
+        __m256i lo = OverStraight16(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), op);
+        __m256i hi = OverStraight16(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), op);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_packus_epi16(lo, hi));
+    }
+    ScalarAlphaOverStraight(dst + i * 4, src + i * 4, count - i, opacity);
+}
+
+// Per-pixel opacity = mask * opacity / 255 for eight pixels, each value
+// spread over its pixel's four 16-bit lanes in the order the per-lane
+// unpacks of the pixels use: lo holds pixels 0-1 and 4-5, hi 2-3 and 6-7
+static inline void MaskOpacity16(const uint8_t* mask, __m256i opacity, __m256i& lo, __m256i& hi) {
+    __m128i m = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(mask));
+    m = _mm_unpacklo_epi8(m, m);
+    __m256i spread = _mm256_set_m128i(_mm_unpackhi_epi16(m, m), _mm_unpacklo_epi16(m, m));
+    const __m256i zero = _mm256_setzero_si256();
+    lo = Div255Epu16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(spread, zero), opacity));
+    hi = Div255Epu16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(spread, zero), opacity));
+}
+
+static void AlphaOverStraightMaskedAVX2(uint8_t* dst, const uint8_t* src, const uint8_t* mask, size_t count,
+                                        uint32_t opacity) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i op = _mm256_set1_epi16(static_cast<short>(opacity));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i opLo, opHi;
+        MaskOpacity16(mask + i, op, opLo, opHi);
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i * 4));
+        __m256i lo = OverStraight16(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), opLo);
+        __m256i hi = OverStraight16(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), opHi);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_packus_epi16(lo, hi));
+    }
+    ScalarAlphaOverStraightMasked(dst + i * 4, src + i * 4, mask + i, count - i, opacity);
+}
+
+static inline __m256i Div65535Epu32(__m256i x) {
+    x = _mm256_add_epi32(x, _mm256_set1_epi32(32768));
+    return _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_srli_epi32(x, 16)), 16);
+}
+
+// Two 16-bit pixels widened to 32-bit lanes, one per 128-bit lane. The alpha
+// lanes take 65535 as their source, so a + dst.a * (1 - a) comes out of the
+// color expression.
+static inline __m256i OverStraight32(__m256i s, __m256i d, __m256i opacity) {
+    __m256i a = Div65535Epu32(_mm256_mullo_epi32(_mm256_shuffle_epi32(s, _MM_SHUFFLE(3, 3, 3, 3)), opacity));
+    s = _mm256_blend_epi16(s, _mm256_set1_epi32(65535), 0xC0);
+    __m256i inv = _mm256_sub_epi32(_mm256_set1_epi32(65535), a);
+    return Div65535Epu32(_mm256_add_epi32(_mm256_mullo_epi32(s, a), _mm256_mullo_epi32(d, inv)));
+}
+
+// The per-lane pack leaves pixels in the order 0, 2, 1, 3
+static void AlphaOverStraight16AVX2(uint16_t* dst, const uint16_t* src, size_t count, uint32_t opacity) {
+    const __m256i op = _mm256_set1_epi32(static_cast<int>(opacity));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i * 4));
+        __m256i p01 = OverStraight32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(s)),
+                                     _mm256_cvtepu16_epi32(_mm256_castsi256_si128(d)), op);
+        __m256i p23 = OverStraight32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(s, 1)),
+                                     _mm256_cvtepu16_epi32(_mm256_extracti128_si256(d, 1)), op);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(p01, p23), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), packed);
+    }
+    ScalarAlphaOverStraight16(dst + i * 4, src + i * 4, count - i, opacity);
+}
+
+// Two pixels (eight 16-bit values): the encoded color, gathered from the
+// table, and the 8-bit alpha, in 32-bit lanes
+static inline __m256i EncodePair(const uint16_t* src, const uint8_t* table, __m256 steps, __m256 last) {
+    const __m256i colorLanes = _mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0);
+    __m256i px = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    __m256 f = _mm256_cvtepi32_ps(px);
+    __m256 a = _mm256_shuffle_ps(f, f, _MM_SHUFFLE(3, 3, 3, 3));
+    __m256 scale = _mm256_andnot_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_EQ_OQ), _mm256_div_ps(steps, a));
+    __m256i index = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_mul_ps(f, scale), last));
+    __m256i alpha = Div65535Epu32(_mm256_mullo_epi32(px, _mm256_set1_epi32(255)));
+    __m256i encoded = _mm256_mask_i32gather_epi32(alpha, reinterpret_cast<const int*>(table), index, colorLanes, 1);
+    return _mm256_and_si256(encoded, _mm256_set1_epi32(0xFF));
+}
+
+static void EncodeLinear16AVX2(uint8_t* dst, const uint16_t* src, size_t count, const uint8_t* table, uint32_t size) {
+    const __m256 steps = _mm256_set1_ps(static_cast<float>(size));
+    const __m256 last = _mm256_set1_ps(static_cast<float>(size - 1));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i p01 = EncodePair(src + i * 4, table, steps, last);
+        __m256i p23 = EncodePair(src + i * 4 + 8, table, steps, last);
+        __m256i p45 = EncodePair(src + i * 4 + 16, table, steps, last);
+        __m256i p67 = EncodePair(src + i * 4 + 24, table, steps, last);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(p01, p23), _mm256_packs_epi32(p45, p67));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), PackOrder(packed));
+    }
+    ScalarEncodeLinear16(dst + i * 4, src + i * 4, count - i, table, size);
+}
+
+static void U8ToF32AVX2(float* dst, const uint8_t* src, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)), scale));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8))), scale));
+    }
+    ScalarU8ToF32(dst + i, src + i, count - i);
+}
+
+static inline __m256i QuantizeAVX2(__m256 v) {
+    v = _mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f));
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+    return _mm256_cvttps_epi32(v);
+}
+
+static void F32ToU8AVX2(uint8_t* dst, const float* src, size_t count) {
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = QuantizeAVX2(_mm256_loadu_ps(src + i));
+        __m256i b = QuantizeAVX2(_mm256_loadu_ps(src + i + 8));
+        __m256i c = QuantizeAVX2(_mm256_loadu_ps(src + i + 16));
+        __m256i d = QuantizeAVX2(_mm256_loadu_ps(src + i + 24));
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), PackOrder(packed));
+    }
+    ScalarF32ToU8(dst + i, src + i, count - i);
+}
+
+static void U16ToF32AVX2(float* dst, const uint16_t* src, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 65535.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+    }
+    ScalarU16ToF32(dst + i, src + i, count - i);
+}
+
+static inline __m256i Quantize16AVX2(__m256 v) {
+    v = _mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(65535.0f)), _mm256_set1_ps(0.5f));
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(65535.0f));
+    return _mm256_cvttps_epi32(v);
+}
+
+static void F32ToU16AVX2(uint16_t* dst, const float* src, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i packed = _mm256_packus_epi32(Quantize16AVX2(_mm256_loadu_ps(src + i)),
+                                             Quantize16AVX2(_mm256_loadu_ps(src + i + 8)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    ScalarF32ToU16(dst + i, src + i, count - i);
+}
+
+static void F32ToF16AVX2(Half* dst, const float* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+    ScalarF32ToF16(dst + i, src + i, count - i);
+}
+
+static void F16ToF32AVX2(float* dst, const Half* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    ScalarF16ToF32(dst + i, src + i, count - i);
+}
+
+// 4x4 transpose inside each 128-bit lane
+static inline void TransposeLanes(__m256& a, __m256& b, __m256& c, __m256& d) {
+    __m256 t0 = _mm256_unpacklo_ps(a, b);
+    __m256 t1 = _mm256_unpacklo_ps(c, d);
+    __m256 t2 = _mm256_unpackhi_ps(a, b);
+    __m256 t3 = _mm256_unpackhi_ps(c, d);
+    a = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+    b = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+    c = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    d = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// Eight pixels per step. Pixels are first regrouped so lane 0 holds
+// pixels 0-3 and lane 1 pixels 4-7, then transposed within the lanes.
+static void DeinterleaveAVX2(float* const planes[4], const float* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 p01 = _mm256_loadu_ps(src + i * 4);
+        __m256 p23 = _mm256_loadu_ps(src + i * 4 + 8);
+        __m256 p45 = _mm256_loadu_ps(src + i * 4 + 16);
+        __m256 p67 = _mm256_loadu_ps(src + i * 4 + 24);
+        __m256 r = _mm256_permute2f128_ps(p01, p45, 0x20); // p0 | p4
+        __m256 g = _mm256_permute2f128_ps(p01, p45, 0x31); // p1 | p5
+        __m256 b = _mm256_permute2f128_ps(p23, p67, 0x20); // p2 | p6
+        __m256 a = _mm256_permute2f128_ps(p23, p67, 0x31); // p3 | p7
+        TransposeLanes(r, g, b, a);
+        _mm256_storeu_ps(planes[0] + i, r);
+        _mm256_storeu_ps(planes[1] + i, g);
+        _mm256_storeu_ps(planes[2] + i, b);
+        _mm256_storeu_ps(planes[3] + i, a);
+    }
+    float* const tail[4] = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    ScalarDeinterleave(tail, src + i * 4, count - i);
+}
+
+static void InterleaveAVX2(float* dst, const float* const planes[4], size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 r = _mm256_loadu_ps(planes[0] + i);
+        __m256 g = _mm256_loadu_ps(planes[1] + i);
+        __m256 b = _mm256_loadu_ps(planes[2] + i);
+        __m256 a = _mm256_loadu_ps(planes[3] + i);
+        TransposeLanes(r, g, b, a); // r = p0 | p4, g = p1 | p5, b = p2 | p6, a = p3 | p7
+        _mm256_storeu_ps(dst + i * 4, _mm256_permute2f128_ps(r, g, 0x20));
+        _mm256_storeu_ps(dst + i * 4 + 8, _mm256_permute2f128_ps(b, a, 0x20));
+        _mm256_storeu_ps(dst + i * 4 + 16, _mm256_permute2f128_ps(r, g, 0x31));
+        _mm256_storeu_ps(dst + i * 4 + 24, _mm256_permute2f128_ps(b, a, 0x31));
+    }
+    const float* const tail[4] = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    ScalarInterleave(dst + i * 4, tail, count - i);
+}
+
+// Two pixels per gather; the alpha lanes take the plain conversion instead
+static void LookupRGBA8ToF32AVX2(float* dst, const uint8_t* src, size_t count, const float* table) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+    const __m256 alphaLanes = _mm256_castsi256_ps(_mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m256i lo = _mm256_cvtepu8_epi32(v);
+        __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8));
+        __m256 colorLo = _mm256_i32gather_ps(table, lo, 4);
+        __m256 colorHi = _mm256_i32gather_ps(table, hi, 4);
+        __m256 alphaLo = _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale);
+        __m256 alphaHi = _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale);
+        _mm256_storeu_ps(dst + i * 4, _mm256_blendv_ps(colorLo, alphaLo, alphaLanes));
+        _mm256_storeu_ps(dst + i * 4 + 8, _mm256_blendv_ps(colorHi, alphaHi, alphaLanes));
+    }
+    ScalarLookupRGBA8ToF32(dst + i * 4, src + i * 4, count - i, table);
+}
+
+static bool InterpolateF32AVX2(float* dst, const float* src, size_t count, const float* table, uint32_t size) {
+    const __m256 scale = _mm256_set1_ps(static_cast<float>(size));
+    __m256 clamped = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // max before min, so NaN becomes 0 as in the scalar kernel
+        __m256 value = _mm256_loadu_ps(src + i);
+        __m256 v = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+        clamped = _mm256_or_ps(clamped, _mm256_cmp_ps(v, value, _CMP_NEQ_UQ));
+        __m256 position = _mm256_mul_ps(v, scale);
+        __m256i index = _mm256_cvttps_epi32(position);
+        __m256 fraction = _mm256_sub_ps(position, _mm256_cvtepi32_ps(index));
+        __m256 a = _mm256_i32gather_ps(table, index, 4);
+        __m256 b = _mm256_i32gather_ps(table + 1, index, 4);
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), fraction)));
+    }
+    bool inside = ScalarInterpolateF32(dst + i, src + i, count - i, table, size);
+    return inside && _mm256_movemask_ps(clamped) == 0;
+}
+
+void InitPixelOpsAVX2(PixelOpsTable& table) {
+    table.fill = FillAVX2;
+    table.swizzleRB = SwizzleRBAVX2;
+    table.premultiply = PremultiplyAVX2;
+    table.unpremultiply = UnpremultiplyAVX2;
+    table.alphaOver = AlphaOverAVX2;
+    table.alphaOverStraight = AlphaOverStraightAVX2;
+    table.alphaOverStraightMasked = AlphaOverStraightMaskedAVX2;
+    table.alphaOverStraight16 = AlphaOverStraight16AVX2;
+    table.encodeLinear16 = EncodeLinear16AVX2;
+    table.u8ToF32 = U8ToF32AVX2;
+    table.f32ToU8 = F32ToU8AVX2;
+    table.u16ToF32 = U16ToF32AVX2;
+    table.f32ToU16 = F32ToU16AVX2;
+    table.f32ToF16 = F32ToF16AVX2;
+    table.f16ToF32 = F16ToF32AVX2;
+    table.deinterleave = DeinterleaveAVX2;
+    table.interleave = InterleaveAVX2;
+    table.lookupRGBA8ToF32 = LookupRGBA8ToF32AVX2;
+    table.interpolateF32 = InterpolateF32AVX2;
+}
+#endif
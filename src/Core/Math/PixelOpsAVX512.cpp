@@ -0,0 +1,171 @@
+#include "PixelOpsKernels.h"
+
+#ifdef PIXELOPS_X86
+#include <immintrin.h>
+
+// AVX-512 (F + BW) kernels for the integer RGBA8 and 16-bit operations.
+// Conversions keep the AVX2 implementations, which are load/store bound
+// already.
+
+static inline __m512i Div255Epu16(__m512i x) {
+    x = _mm512_add_epi16(x, _mm512_set1_epi16(128));
+    return _mm512_srli_epi16(_mm512_add_epi16(x, _mm512_srli_epi16(x, 8)), 8);
+}
+
+static inline __m512i BroadcastAlpha16(__m512i px) {
+    px = _mm512_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm512_shufflehi_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static void FillAVX512(uint8_t* dst, size_t count, uint32_t color) {
+    const __m512i v = _mm512_set1_epi32(static_cast<int>(color));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm512_storeu_si512(dst + i * 4, v);
+    }
+    ScalarFill(dst + i * 4, count - i, color);
+}
+
+static void SwizzleRBAVX512(uint8_t* dst, const uint8_t* src, size_t count) {
+    // Byte indices 2, 1, 0, 3, 6, 5, 4, 7, ... in every 128-bit lane
+    const __m512i shuffle = _mm512_set4_epi32(0x0F0C0D0E, 0x0B08090A, 0x07040506, 0x03000102);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i v = _mm512_loadu_si512(src + i * 4);
+        _mm512_storeu_si512(dst + i * 4, _mm512_shuffle_epi8(v, shuffle));
+    }
+    ScalarSwizzleRB(dst + i * 4, src + i * 4, count - i);
+}
+
+static void PremultiplyAVX512(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m512i zero = _mm512_setzero_si512();
+    // Alpha lanes of each pixel (every fourth 16-bit lane) are multiplied by 255
+    const __mmask32 alphaLanes = 0x88888888u;
+    const __m512i full = _mm512_set1_epi16(255);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i v = _mm512_loadu_si512(src + i * 4);
+        __m512i lo = _mm512_unpacklo_epi8(v, zero);
+        __m512i hi = _mm512_unpackhi_epi8(v, zero);
+        __m512i aLo = _mm512_mask_mov_epi16(BroadcastAlpha16(lo), alphaLanes, full);
+        __m512i aHi = _mm512_mask_mov_epi16(BroadcastAlpha16(hi), alphaLanes, full);
+        lo = Div255Epu16(_mm512_mullo_epi16(lo, aLo));
+        hi = Div255Epu16(_mm512_mullo_epi16(hi, aHi));
+        _mm512_storeu_si512(dst + i * 4, _mm512_packus_epi16(lo, hi));
+    }
+    ScalarPremultiply(dst + i * 4, src + i * 4, count - i);
+}
+
+static void AlphaOverAVX512(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i full = _mm512_set1_epi16(255);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i s = _mm512_loadu_si512(src + i * 4);
+        __m512i d = _mm512_loadu_si512(dst + i * 4);
+        __m512i invLo = _mm512_sub_epi16(full, BroadcastAlpha16(_mm512_unpacklo_epi8(s, zero)));
+        __m512i invHi = _mm512_sub_epi16(full, BroadcastAlpha16(_mm512_unpackhi_epi8(s, zero)));
+        __m512i lo = Div255Epu16(_mm512_mullo_epi16(_mm512_unpacklo_epi8(d, zero), invLo));
+        __m512i hi = Div255Epu16(_mm512_mullo_epi16(_mm512_unpackhi_epi8(d, zero), invHi));
+        _mm512_storeu_si512(dst + i * 4, _mm512_adds_epu8(s, _mm512_packus_epi16(lo, hi)));
+    }
+    ScalarAlphaOver(dst + i * 4, src + i * 4, count - i);
+}
+
+static inline __m512i Div65535Epu32(__m512i x) {
+    x = _mm512_add_epi32(x, _mm512_set1_epi32(32768));
+    return _mm512_srli_epi32(_mm512_add_epi32(x, _mm512_srli_epi32(x, 16)), 16);
+}
+
+// Four 16-bit pixels widened to 32-bit lanes, one per 128-bit lane. The
+// alpha lanes take 65535 as their source, so a + dst.a * (1 - a) comes out
+// of the color expression.
+static inline __m512i OverStraight32(__m512i s, __m512i d, __m512i opacity) {
+    __m512i a = Div65535Epu32(_mm512_mullo_epi32(_mm512_shuffle_epi32(s, _MM_PERM_DDDD), opacity));
+    s = _mm512_mask_mov_epi32(s, 0x8888, _mm512_set1_epi32(65535));
+    __m512i inv = _mm512_sub_epi32(_mm512_set1_epi32(65535), a);
+    return Div65535Epu32(_mm512_add_epi32(_mm512_mullo_epi32(s, a), _mm512_mullo_epi32(d, inv)));
+}
+
+// The per-lane pack interleaves the two halves pixel by pixel
+static void AlphaOverStraight16AVX512(uint16_t* dst, const uint16_t* src, size_t count, uint32_t opacity) {
+    const __m512i op = _mm512_set1_epi32(static_cast<int>(opacity));
+    const __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m512i s = _mm512_loadu_si512(src + i * 4);
+        __m512i d = _mm512_loadu_si512(dst + i * 4);
+        __m512i p0123 = OverStraight32(_mm512_cvtepu16_epi32(_mm512_castsi512_si256(s)),
+                                       _mm512_cvtepu16_epi32(_mm512_castsi512_si256(d)), op);
+        __m512i p4567 = OverStraight32(_mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(s, 1)),
+                                       _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(d, 1)), op);
+        __m512i packed = _mm512_permutexvar_epi64(order, _mm512_packus_epi32(p0123, p4567));
+        _mm512_storeu_si512(dst + i * 4, packed);
+    }
+    ScalarAlphaOverStraight16(dst + i * 4, src + i * 4, count - i, opacity);
+}
+
+// The 256-entry table sits in eight registers: each two-register permute
+// looks up one quarter of it, and bits 6 and 7 of the code pick the quarter
+static void LookupRGBA8ToU16AVX512(uint16_t* dst, const uint8_t* src, size_t count, const uint16_t* table) {
+    __m512i quarter[8];
+    for (int q = 0; q < 8; q++) quarter[q] = _mm512_loadu_si512(table + q * 32);
+    const __mmask32 alphaLanes = 0x88888888u;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m512i codes = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4)));
+        __m512i v0 = _mm512_permutex2var_epi16(quarter[0], codes, quarter[1]);
+        __m512i v1 = _mm512_permutex2var_epi16(quarter[2], codes, quarter[3]);
+        __m512i v2 = _mm512_permutex2var_epi16(quarter[4], codes, quarter[5]);
+        __m512i v3 = _mm512_permutex2var_epi16(quarter[6], codes, quarter[7]);
+        __mmask32 bit6 = _mm512_test_epi16_mask(codes, _mm512_set1_epi16(64));
+        __mmask32 bit7 = _mm512_test_epi16_mask(codes, _mm512_set1_epi16(128));
+        __m512i color = _mm512_mask_blend_epi16(bit7, _mm512_mask_blend_epi16(bit6, v0, v1),
+                                                _mm512_mask_blend_epi16(bit6, v2, v3));
+        __m512i alpha = _mm512_mullo_epi16(codes, _mm512_set1_epi16(257));
+        _mm512_storeu_si512(dst + i * 4, _mm512_mask_mov_epi16(color, alphaLanes, alpha));
+    }
+    ScalarLookupRGBA8ToU16(dst + i * 4, src + i * 4, count - i, table);
+}
+
+// Four pixels (sixteen 16-bit values): the encoded color, gathered from the
+// table, and the 8-bit alpha, in 32-bit lanes
+static inline __m512i EncodeQuad(const uint16_t* src, const uint8_t* table, __m512 steps, __m512 last) {
+    __m512i px = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+    __m512 f = _mm512_cvtepi32_ps(px);
+    __m512 a = _mm512_permute_ps(f, _MM_SHUFFLE(3, 3, 3, 3));
+    __mmask16 opaque = _mm512_cmp_ps_mask(a, _mm512_setzero_ps(), _CMP_NEQ_UQ);
+    __m512 scale = _mm512_maskz_div_ps(opaque, steps, a);
+    __m512i index = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_mul_ps(f, scale), last));
+    __m512i alpha = Div65535Epu32(_mm512_mullo_epi32(px, _mm512_set1_epi32(255)));
+    __m512i encoded = _mm512_mask_i32gather_epi32(alpha, 0x7777, index, table, 1);
+    return _mm512_and_si512(encoded, _mm512_set1_epi32(0xFF));
+}
+
+static void EncodeLinear16AVX512(uint8_t* dst, const uint16_t* src, size_t count, const uint8_t* table,
+                                 uint32_t size) {
+    const __m512 steps = _mm512_set1_ps(static_cast<float>(size));
+    const __m512 last = _mm512_set1_ps(static_cast<float>(size - 1));
+    const __m512i order = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i p0 = EncodeQuad(src + i * 4, table, steps, last);
+        __m512i p1 = EncodeQuad(src + i * 4 + 16, table, steps, last);
+        __m512i p2 = EncodeQuad(src + i * 4 + 32, table, steps, last);
+        __m512i p3 = EncodeQuad(src + i * 4 + 48, table, steps, last);
+        __m512i packed = _mm512_packus_epi16(_mm512_packs_epi32(p0, p1), _mm512_packs_epi32(p2, p3));
+        _mm512_storeu_si512(dst + i * 4, _mm512_permutexvar_epi32(order, packed));
+    }
+    ScalarEncodeLinear16(dst + i * 4, src + i * 4, count - i, table, size);
+}
+
+void InitPixelOpsAVX512(PixelOpsTable& table) {
+    table.fill = FillAVX512;
+    table.swizzleRB = SwizzleRBAVX512;
+    table.premultiply = PremultiplyAVX512;
+    table.alphaOver = AlphaOverAVX512;
+    table.alphaOverStraight16 = AlphaOverStraight16AVX512;
+    table.lookupRGBA8ToU16 = LookupRGBA8ToU16AVX512;
+    table.encodeLinear16 = EncodeLinear16AVX512;
+}
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+#include "PixelOps.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXELOPS_X86 1
+#endif
+
+// Internal dispatch table shared by the per-instruction-set translation units.
+// Each PixelOps*.cpp overrides the entries it implements; the others keep the
+// implementation from the level below. Fill colors are packed in memory order
+// (R, G, B, A on little-endian).
+struct PixelOpsTable {
+    void (*fill)(uint8_t* dst, size_t count, uint32_t color);
+    void (*swizzleRB)(uint8_t* dst, const uint8_t* src, size_t count);
+    void (*premultiply)(uint8_t* dst, const uint8_t* src, size_t count);
+    void (*unpremultiply)(uint8_t* dst, const uint8_t* src, size_t count);
+    void (*alphaOver)(uint8_t* dst, const uint8_t* src, size_t count);
+    void (*alphaOverStraight)(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity);
+    void (*alphaOverStraightMasked)(uint8_t* dst, const uint8_t* src, const uint8_t* mask, size_t count,
+                                    uint32_t opacity);
+    void (*alphaOverStraight16)(uint16_t* dst, const uint16_t* src, size_t count, uint32_t opacity);
+    void (*encodeLinear16)(uint8_t* dst, const uint16_t* src, size_t count, const uint8_t* table, uint32_t size);
+    void (*u8ToF32)(float* dst, const uint8_t* src, size_t count);
+    void (*f32ToU8)(uint8_t* dst, const float* src, size_t count);
+    void (*u16ToF32)(float* dst, const uint16_t* src, size_t count);
+    void (*f32ToU16)(uint16_t* dst, const float* src, size_t count);
+    void (*f32ToF16)(Half* dst, const float* src, size_t count);
+    void (*f16ToF32)(float* dst, const Half* src, size_t count);
+    void (*deinterleave)(float* const planes[4], const float* src, size_t count);
+    void (*interleave)(float* dst, const float* const planes[4], size_t count);
+    void (*lookupRGBA8ToF32)(float* dst, const uint8_t* src, size_t count, const float* table);
+    void (*lookupRGBA8ToU16)(uint16_t* dst, const uint8_t* src, size_t count, const uint16_t* table);
+    bool (*interpolateF32)(float* dst, const float* src, size_t count, const float* table, uint32_t size);
+};
+
+// Scalar reference kernels. SIMD kernels call these for their tails: the SIMD
+// translation units are built with wider instruction sets, so they must not
+// call inline helpers shared with the rest of the program.
+void ScalarFill(uint8_t* dst, size_t count, uint32_t color);
+void ScalarSwizzleRB(uint8_t* dst, const uint8_t* src, size_t count);
+void ScalarPremultiply(uint8_t* dst, const uint8_t* src, size_t count);
+void ScalarUnpremultiply(uint8_t* dst, const uint8_t* src, size_t count);
+void ScalarAlphaOver(uint8_t* dst, const uint8_t* src, size_t count);
+void ScalarAlphaOverStraight(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity);
+void ScalarAlphaOverStraightMasked(uint8_t* dst, const uint8_t* src, const uint8_t* mask, size_t count,
+                                   uint32_t opacity);
+void ScalarAlphaOverStraight16(uint16_t* dst, const uint16_t* src, size_t count, uint32_t opacity);
+void ScalarEncodeLinear16(uint8_t* dst, const uint16_t* src, size_t count, const uint8_t* table, uint32_t size);
+void ScalarU8ToF32(float* dst, const uint8_t* src, size_t count);
+void ScalarF32ToU8(uint8_t* dst, const float* src, size_t count);
+void ScalarU16ToF32(float* dst, const uint16_t* src, size_t count);
+void ScalarF32ToU16(uint16_t* dst, const float* src, size_t count);
+void ScalarF32ToF16(Half* dst, const float* src, size_t count);
+void ScalarF16ToF32(float* dst, const Half* src, size_t count);
+void ScalarDeinterleave(float* const planes[4], const float* src, size_t count);
+void ScalarInterleave(float* dst, const float* const planes[4], size_t count);
+void ScalarLookupRGBA8ToF32(float* dst, const uint8_t* src, size_t count, const float* table);
+void ScalarLookupRGBA8ToU16(uint16_t* dst, const uint8_t* src, size_t count, const uint16_t* table);
+bool ScalarInterpolateF32(float* dst, const float* src, size_t count, const float* table, uint32_t size);
+
+#ifdef PIXELOPS_X86
+void InitPixelOpsSSE2(PixelOpsTable& table);
+void InitPixelOpsSSE41(PixelOpsTable& table);
+void InitPixelOpsAVX2(PixelOpsTable& table);
+void InitPixelOpsAVX512(PixelOpsTable& table);
+#endif
@@ -0,0 +1,215 @@
+#include "PixelOpsKernels.h"
+#include <cstring>
+
+#ifdef PIXELOPS_X86
+#include <emmintrin.h>
+
+// round(x / 255) on eight 16-bit lanes, same formula as PixelOps::Div255
+static inline __m128i Div255Epu16(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Broadcast the alpha of each of the two pixels held in 16-bit lanes
+static inline __m128i BroadcastAlpha16(__m128i px) {
+    px = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static void FillSSE2(uint8_t* dst, size_t count, uint32_t color) {
+    const __m128i v = _mm_set1_epi32(static_cast<int>(color));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+    }
+    ScalarFill(dst + i * 4, count - i, color);
+}
+
+static void SwizzleRBSSE2(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m128i maskGA = _mm_set1_epi32(static_cast<int>(0xFF00FF00u));
+    const __m128i maskR = _mm_set1_epi32(0x000000FF);
+    const __m128i maskB = _mm_set1_epi32(0x00FF0000);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i ga = _mm_and_si128(v, maskGA);
+        __m128i r = _mm_slli_epi32(_mm_and_si128(v, maskR), 16);
+        __m128i b = _mm_srli_epi32(_mm_and_si128(v, maskB), 16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(ga, _mm_or_si128(r, b)));
+    }
+    ScalarSwizzleRB(dst + i * 4, src + i * 4, count - i);
+}
+
+static void PremultiplySSE2(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    // Alpha is multiplied by 255 so it passes through Div255 unchanged
+    const __m128i colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i alphaOne = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        __m128i aLo = _mm_or_si128(_mm_and_si128(BroadcastAlpha16(lo), colorMask), alphaOne);
+        __m128i aHi = _mm_or_si128(_mm_and_si128(BroadcastAlpha16(hi), colorMask), alphaOne);
+        lo = Div255Epu16(_mm_mullo_epi16(lo, aLo));
+        hi = Div255Epu16(_mm_mullo_epi16(hi, aHi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+    ScalarPremultiply(dst + i * 4, src + i * 4, count - i);
+}
+
+static void AlphaOverSSE2(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+        __m128i invLo = _mm_sub_epi16(full, BroadcastAlpha16(_mm_unpacklo_epi8(s, zero)));
+        __m128i invHi = _mm_sub_epi16(full, BroadcastAlpha16(_mm_unpackhi_epi8(s, zero)));
+        __m128i lo = Div255Epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), invLo));
+        __m128i hi = Div255Epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), invHi));
+        __m128i result = _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), result);
+    }
+    ScalarAlphaOver(dst + i * 4, src + i * 4, count - i);
+}
+
+// Two pixels in 16-bit lanes: premultiply by a = alpha * opacity, then over
+static inline __m128i OverStraight16(__m128i s, __m128i d, __m128i opacity) {
+    const __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    __m128i a = Div255Epu16(_mm_mullo_epi16(BroadcastAlpha16(s), opacity));
+    __m128i premul = Div255Epu16(_mm_mullo_epi16(s, a));
+    premul = _mm_or_si128(_mm_andnot_si128(alphaMask, premul), _mm_and_si128(alphaMask, a));
+    __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    return _mm_add_epi16(premul, Div255Epu16(_mm_mullo_epi16(d, inv)));
+}
+
+static void AlphaOverStraightSSE2(uint8_t* dst, const uint8_t* src, size_t count, uint32_t opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i op = _mm_set1_epi16(static_cast<short>(opacity));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+        __m128i lo = OverStraight16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), op);
+        __m128i hi = OverStraight16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), op);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+    ScalarAlphaOverStraight(dst + i * 4, src + i * 4, count - i, opacity);
+}
+
+// Per-pixel opacity = mask * opacity / 255, each pixel's value spread over
+// its four 16-bit lanes; lo holds pixels 0-1 and hi pixels 2-3
+static inline void MaskOpacity16(const uint8_t* mask, __m128i opacity, __m128i& lo, __m128i& hi) {
+    int packed = 0;
+    std::memcpy(&packed, mask, 4);
+    __m128i m = _mm_cvtsi32_si128(packed);
+    m = _mm_unpacklo_epi8(m, m);
+    m = _mm_unpacklo_epi16(m, m); // Each mask byte four times
+    const __m128i zero = _mm_setzero_si128();
+    lo = Div255Epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(m, zero), opacity));
+    hi = Div255Epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(m, zero), opacity));
+}
+
+static void AlphaOverStraightMaskedSSE2(uint8_t* dst, const uint8_t* src, const uint8_t* mask, size_t count,
+                                        uint32_t opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i op = _mm_set1_epi16(static_cast<short>(opacity));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i opLo, opHi;
+        MaskOpacity16(mask + i, op, opLo, opHi);
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+        __m128i lo = OverStraight16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), opLo);
+        __m128i hi = OverStraight16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), opHi);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+    ScalarAlphaOverStraightMasked(dst + i * 4, src + i * 4, mask + i, count - i, opacity);
+}
+
+static void U8ToF32SSE2(float* dst, const uint8_t* src, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+    }
+    ScalarU8ToF32(dst + i, src + i, count - i);
+}
+
+static inline __m128i QuantizeSSE2(__m128 v) {
+    v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    return _mm_cvttps_epi32(v);
+}
+
+static void F32ToU8SSE2(uint8_t* dst, const float* src, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = QuantizeSSE2(_mm_loadu_ps(src + i));
+        __m128i b = QuantizeSSE2(_mm_loadu_ps(src + i + 4));
+        __m128i c = QuantizeSSE2(_mm_loadu_ps(src + i + 8));
+        __m128i d = QuantizeSSE2(_mm_loadu_ps(src + i + 12));
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+    ScalarF32ToU8(dst + i, src + i, count - i);
+}
+
+// Four pixels per step: a 4x4 transpose of the channel values
+static void DeinterleaveSSE2(float* const planes[4], const float* src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 p0 = _mm_loadu_ps(src + i * 4);
+        __m128 p1 = _mm_loadu_ps(src + i * 4 + 4);
+        __m128 p2 = _mm_loadu_ps(src + i * 4 + 8);
+        __m128 p3 = _mm_loadu_ps(src + i * 4 + 12);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        _mm_storeu_ps(planes[0] + i, p0);
+        _mm_storeu_ps(planes[1] + i, p1);
+        _mm_storeu_ps(planes[2] + i, p2);
+        _mm_storeu_ps(planes[3] + i, p3);
+    }
+    float* const tail[4] = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    ScalarDeinterleave(tail, src + i * 4, count - i);
+}
+
+static void InterleaveSSE2(float* dst, const float* const planes[4], size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 r = _mm_loadu_ps(planes[0] + i);
+        __m128 g = _mm_loadu_ps(planes[1] + i);
+        __m128 b = _mm_loadu_ps(planes[2] + i);
+        __m128 a = _mm_loadu_ps(planes[3] + i);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(dst + i * 4, r);
+        _mm_storeu_ps(dst + i * 4 + 4, g);
+        _mm_storeu_ps(dst + i * 4 + 8, b);
+        _mm_storeu_ps(dst + i * 4 + 12, a);
+    }
+    const float* const tail[4] = {planes[0] + i, planes[1] + i, planes[2] + i, planes[3] + i};
+    ScalarInterleave(dst + i * 4, tail, count - i);
+}
+
+void InitPixelOpsSSE2(PixelOpsTable& table) {
+    table.fill = FillSSE2;
+    table.swizzleRB = SwizzleRBSSE2;
+    table.premultiply = PremultiplySSE2;
+    table.alphaOver = AlphaOverSSE2;
+    table.alphaOverStraight = AlphaOverStraightSSE2;
+    table.alphaOverStraightMasked = AlphaOverStraightMaskedSSE2;
+    table.u8ToF32 = U8ToF32SSE2;
+    table.f32ToU8 = F32ToU8SSE2;
+    table.deinterleave = DeinterleaveSSE2;
+    table.interleave = InterleaveSSE2;
+}
+#endif
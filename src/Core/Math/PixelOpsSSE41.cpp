@@ -0,0 +1,145 @@
+#include "PixelOpsKernels.h"
+
+#ifdef PIXELOPS_X86
+#include <smmintrin.h>
+
+static void SwizzleRBSSE41(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(v, shuffle));
+    }
+    ScalarSwizzleRB(dst + i * 4, src + i * 4, count - i);
+}
+
+// One pixel: c * 255 / a + 0.5 with alpha passed through and a == 0 -> 0
+static inline __m128i UnpremultiplyPixel(__m128i px) {
+    __m128 f = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(px));
+    __m128 a = _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 v = _mm_add_ps(_mm_div_ps(_mm_mul_ps(f, _mm_set1_ps(255.0f)), a), _mm_set1_ps(0.5f));
+    v = _mm_min_ps(v, _mm_set1_ps(255.0f));
+    v = _mm_blend_ps(v, f, 0x8);
+    v = _mm_andnot_ps(_mm_cmpeq_ps(a, _mm_setzero_ps()), v);
+    return _mm_cvttps_epi32(v);
+}
+
+static void UnpremultiplySSE41(uint8_t* dst, const uint8_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i p0 = UnpremultiplyPixel(v);
+        __m128i p1 = UnpremultiplyPixel(_mm_srli_si128(v, 4));
+        __m128i p2 = UnpremultiplyPixel(_mm_srli_si128(v, 8));
+        __m128i p3 = UnpremultiplyPixel(_mm_srli_si128(v, 12));
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), packed);
+    }
+    ScalarUnpremultiply(dst + i * 4, src + i * 4, count - i);
+}
+
+static void U8ToF32SSE41(float* dst, const uint8_t* src, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(v)), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4))), scale));
+        _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 8))), scale));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 12))), scale));
+    }
+    ScalarU8ToF32(dst + i, src + i, count - i);
+}
+
+static void U16ToF32SSE41(float* dst, const uint16_t* src, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(v)), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(v, 8))), scale));
+    }
+    ScalarU16ToF32(dst + i, src + i, count - i);
+}
+
+// max/min return their second operand for NaN, so NaN maps to 0 as in the
+// scalar kernel
+static inline __m128i Quantize16(__m128 v) {
+    v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(65535.0f)), _mm_set1_ps(0.5f));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(65535.0f));
+    return _mm_cvttps_epi32(v);
+}
+
+static void F32ToU16SSE41(uint16_t* dst, const float* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm_packus_epi32(Quantize16(_mm_loadu_ps(src + i)), Quantize16(_mm_loadu_ps(src + i + 4)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+    ScalarF32ToU16(dst + i, src + i, count - i);
+}
+
+static inline __m128i Div65535Epu32(__m128i x) {
+    x = _mm_add_epi32(x, _mm_set1_epi32(32768));
+    return _mm_srli_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 16)), 16);
+}
+
+// One 16-bit pixel widened to 32-bit lanes. The alpha lane takes 65535 as
+// its source, so a + dst.a * (1 - a) comes out of the color expression.
+static inline __m128i OverStraight32(__m128i s, __m128i d, __m128i opacity) {
+    __m128i a = Div65535Epu32(_mm_mullo_epi32(_mm_shuffle_epi32(s, _MM_SHUFFLE(3, 3, 3, 3)), opacity));
+    s = _mm_blend_epi16(s, _mm_set1_epi32(65535), 0xC0);
+    __m128i inv = _mm_sub_epi32(_mm_set1_epi32(65535), a);
+    return Div65535Epu32(_mm_add_epi32(_mm_mullo_epi32(s, a), _mm_mullo_epi32(d, inv)));
+}
+
+static void AlphaOverStraight16SSE41(uint16_t* dst, const uint16_t* src, size_t count, uint32_t opacity) {
+    const __m128i op = _mm_set1_epi32(static_cast<int>(opacity));
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+        __m128i p0 = OverStraight32(_mm_cvtepu16_epi32(s), _mm_cvtepu16_epi32(d), op);
+        __m128i p1 = OverStraight32(_mm_cvtepu16_epi32(_mm_srli_si128(s, 8)), _mm_cvtepu16_epi32(_mm_srli_si128(d, 8)),
+                                    op);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi32(p0, p1));
+    }
+    ScalarAlphaOverStraight16(dst + i * 4, src + i * 4, count - i, opacity);
+}
+
+// Table indices of one pixel's color in lanes 0-2 and its 8-bit alpha in lane 3
+static inline __m128i EncodePixel(__m128i px, __m128 steps, __m128 last) {
+    __m128 f = _mm_cvtepi32_ps(px);
+    __m128 a = _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 scale = _mm_andnot_ps(_mm_cmpeq_ps(a, _mm_setzero_ps()), _mm_div_ps(steps, a));
+    __m128i index = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(f, scale), last));
+    __m128i alpha = Div65535Epu32(_mm_mullo_epi32(px, _mm_set1_epi32(255)));
+    return _mm_blend_epi16(index, alpha, 0xC0);
+}
+
+// SSE has no gather: the indices are computed four at a time and looked up
+// one by one
+static void EncodeLinear16SSE41(uint8_t* dst, const uint16_t* src, size_t count, const uint8_t* table,
+                                uint32_t size) {
+    const __m128 steps = _mm_set1_ps(static_cast<float>(size));
+    const __m128 last = _mm_set1_ps(static_cast<float>(size - 1));
+    for (size_t i = 0; i < count; i++) {
+        __m128i px = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i * 4)));
+        __m128i v = EncodePixel(px, steps, last);
+        dst[i * 4 + 0] = table[_mm_cvtsi128_si32(v)];
+        dst[i * 4 + 1] = table[_mm_extract_epi32(v, 1)];
+        dst[i * 4 + 2] = table[_mm_extract_epi32(v, 2)];
+        dst[i * 4 + 3] = static_cast<uint8_t>(_mm_extract_epi32(v, 3));
+    }
+}
+
+void InitPixelOpsSSE41(PixelOpsTable& table) {
+    table.swizzleRB = SwizzleRBSSE41;
+    table.unpremultiply = UnpremultiplySSE41;
+    table.alphaOverStraight16 = AlphaOverStraight16SSE41;
+    table.encodeLinear16 = EncodeLinear16SSE41;
+    table.u8ToF32 = U8ToF32SSE41;
+    table.u16ToF32 = U16ToF32SSE41;
+    table.f32ToU16 = F32ToU16SSE41;
+}
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+
+// Integer pixel rectangle in document coordinates. The origin may be
+// negative (layers can extend past the canvas); right and bottom are exclusive.
+struct Rect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    Rect() = default;
+    Rect(int x, int y, int width, int height) : x(x), y(y), width(width), height(height) {}
+
+    int Right() const { return x + width; }
+    int Bottom() const { return y + height; }
+    bool IsEmpty() const { return width <= 0 || height <= 0; }
+    bool Contains(int px, int py) const { return px >= x && py >= y && px < Right() && py < Bottom(); }
+
+    // Empty rectangles intersect nothing and are ignored by Union
+    Rect Intersect(const Rect& other) const {
+        int left = std::max(x, other.x);
+        int top = std::max(y, other.y);
+        int right = std::min(Right(), other.Right());
+        int bottom = std::min(Bottom(), other.Bottom());
+        if (right <= left || bottom <= top) return Rect();
+        return Rect(left, top, right - left, bottom - top);
+    }
+
+    Rect Union(const Rect& other) const {
+        if (IsEmpty()) return other;
+        if (other.IsEmpty()) return *this;
+        int left = std::min(x, other.x);
+        int top = std::min(y, other.y);
+        return Rect(left, top, std::max(Right(), other.Right()) - left, std::max(Bottom(), other.Bottom()) - top);
+    }
+
+    Rect Offset(int dx, int dy) const { return Rect(x + dx, y + dy, width, height); }
+
+    bool operator==(const Rect& other) const {
+        return x == other.x && y == other.y && width == other.width && height == other.height;
+    }
+    bool operator!=(const Rect& other) const { return !(*this == other); }
+};
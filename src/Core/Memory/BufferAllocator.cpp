@@ -0,0 +1,386 @@
+#include "BufferAllocator.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <string>
+#include <sys/mman.h>
+#endif
+
+static constexpr size_t DEFAULT_CACHE_LIMIT = 256ull * 1024 * 1024;
+
+// Per-thread cache bounds (tile blocks are 256 KB to 1 MB depending on format)
+static constexpr size_t THREAD_CACHE_BLOCKS_PER_CLASS = 8;
+static constexpr size_t THREAD_CACHE_MAX_BYTES = 8ull * 1024 * 1024;
+
+struct AllocatorCounters {
+    std::atomic<size_t> liveBytes{0};
+    std::atomic<size_t> peakLiveBytes{0};
+    std::atomic<size_t> cachedBytes{0};
+    std::atomic<size_t> systemBytes{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> cacheHits{0};
+    std::atomic<uint64_t> systemAllocations{0};
+    std::atomic<uint64_t> systemFrees{0};
+    std::atomic<bool> hugePagesRequested{false};
+};
+
+// Shared cache of free blocks, keyed by size class
+struct SharedBlockCache {
+    std::mutex mutex;
+    std::unordered_map<size_t, std::vector<void*>> blocks;
+    size_t bytes = 0;
+    size_t limit = DEFAULT_CACHE_LIMIT;
+};
+
+static AllocatorCounters& GetCounters() {
+    static AllocatorCounters* counters = new AllocatorCounters(); // outlives thread caches at exit
+    return *counters;
+}
+
+static SharedBlockCache& GetSharedCache() {
+    static SharedBlockCache* cache = new SharedBlockCache();
+    return *cache;
+}
+
+// --- OS allocation ---
+
+#ifdef _WIN32
+static bool EnableLargePages() {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return false;
+    }
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool ok = LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+              AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+              GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return ok && GetLargePageMinimum() > 0;
+}
+#else
+// MADV_HUGEPAGE succeeds even when transparent huge pages are off; the
+// active mode is the bracketed word, e.g. "always [madvise] never"
+static bool TransparentHugePagesEnabled() {
+    std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string mode;
+    while (file >> mode) {
+        if (mode == "[always]" || mode == "[madvise]") return true;
+    }
+    return false;
+}
+
+// Anonymous memory of the whole process currently in huge pages, in kB
+static size_t AnonHugePagesKB() {
+    std::ifstream file("/proc/self/smaps_rollup");
+    std::string key;
+    size_t kb;
+    while (file >> key) {
+        if (key == "AnonHugePages:") return file >> kb ? kb : 0;
+        file.ignore(256, '\n');
+    }
+    return 0;
+}
+#endif
+
+static void* AllocatePages(size_t size) {
+#ifdef _WIN32
+    // Large pages need the "Lock pages in memory" privilege; fall back silently
+    static const bool largePages = EnableLargePages();
+    if (largePages && size % GetLargePageMinimum() == 0) {
+        void* ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (ptr) {
+            GetCounters().hugePagesRequested.store(true, std::memory_order_relaxed);
+            return ptr;
+        }
+    }
+    return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) return nullptr;
+#ifdef MADV_HUGEPAGE
+    static const bool transparentHugePages = TransparentHugePagesEnabled();
+    if (transparentHugePages && madvise(ptr, size, MADV_HUGEPAGE) == 0) {
+        GetCounters().hugePagesRequested.store(true, std::memory_order_relaxed);
+    }
+#endif
+    return ptr;
+#endif
+}
+
+static void FreePages(void* ptr, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, size);
+#endif
+}
+
+static void* SystemAllocate(size_t blockSize) {
+    void* ptr;
+    if (blockSize >= BufferAllocator::LARGE_BLOCK) {
+        ptr = AllocatePages(blockSize);
+        if (!ptr) throw std::bad_alloc();
+    } else {
+        ptr = ::operator new(blockSize, std::align_val_t(BufferAllocator::ALIGNMENT));
+    }
+    AllocatorCounters& counters = GetCounters();
+    counters.systemAllocations.fetch_add(1, std::memory_order_relaxed);
+    counters.systemBytes.fetch_add(blockSize, std::memory_order_relaxed);
+    return ptr;
+}
+
+static void SystemFree(void* ptr, size_t blockSize) {
+    if (blockSize >= BufferAllocator::LARGE_BLOCK) {
+        FreePages(ptr, blockSize);
+    } else {
+        ::operator delete(ptr, std::align_val_t(BufferAllocator::ALIGNMENT));
+    }
+    AllocatorCounters& counters = GetCounters();
+    counters.systemFrees.fetch_add(1, std::memory_order_relaxed);
+    counters.systemBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+}
+
+// --- Shared cache ---
+
+static void* SharedPop(size_t blockSize) {
+    SharedBlockCache& cache = GetSharedCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto it = cache.blocks.find(blockSize);
+    if (it == cache.blocks.end() || it->second.empty()) return nullptr;
+
+    void* ptr = it->second.back();
+    it->second.pop_back();
+    cache.bytes -= blockSize;
+    GetCounters().cachedBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+    return ptr;
+}
+
+static bool SharedPush(void* ptr, size_t blockSize) {
+    SharedBlockCache& cache = GetSharedCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (cache.bytes + blockSize > cache.limit) return false;
+
+    cache.blocks[blockSize].push_back(ptr);
+    cache.bytes += blockSize;
+    GetCounters().cachedBytes.fetch_add(blockSize, std::memory_order_relaxed);
+    return true;
+}
+
+static void ReleaseToSystem(std::vector<std::pair<void*, size_t>>& blocks) {
+    for (const auto& block : blocks) {
+        SystemFree(block.first, block.second);
+    }
+    blocks.clear();
+}
+
+// --- Per-thread cache for tile-sized blocks ---
+
+// Index of a size class no larger than THREAD_CACHE_MAX_BLOCK
+static size_t ThreadClassIndex(size_t blockSize) {
+    if (blockSize <= BufferAllocator::MIN_BLOCK) return 0;
+    int shift = std::bit_width(blockSize - 1) - 1;
+    size_t step = ((blockSize - 1) >> (shift - 2)) - 3;
+    return static_cast<size_t>(shift - 12) * 4 + step;
+}
+
+static constexpr size_t THREAD_CLASS_COUNT = 33; // 4 KB .. 1 MB
+
+struct ThreadBlockCache {
+    std::vector<void*> blocks[THREAD_CLASS_COUNT];
+    size_t bytes = 0;
+
+    ~ThreadBlockCache() { Flush(); }
+
+    void Flush() {
+        std::vector<std::pair<void*, size_t>> overflow;
+        for (size_t index = 0; index < THREAD_CLASS_COUNT; index++) {
+            size_t blockSize = ClassSize(index);
+            for (void* ptr : blocks[index]) {
+                GetCounters().cachedBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+                if (!SharedPush(ptr, blockSize)) {
+                    overflow.emplace_back(ptr, blockSize);
+                }
+            }
+            blocks[index].clear();
+        }
+        bytes = 0;
+        ReleaseToSystem(overflow);
+    }
+
+    static size_t ClassSize(size_t index) {
+        if (index == 0) return BufferAllocator::MIN_BLOCK;
+        size_t octave = (index - 1) / 4;
+        size_t step = (index - 1) % 4 + 1;
+        size_t base = BufferAllocator::MIN_BLOCK << octave;
+        return base + step * (base / 4);
+    }
+};
+
+static ThreadBlockCache& GetThreadCache() {
+    static thread_local ThreadBlockCache cache;
+    return cache;
+}
+
+size_t BufferAllocator::SizeClass(size_t size) {
+    if (size <= MIN_BLOCK) return MIN_BLOCK;
+
+    // Four classes per power of two: at most 25% slack
+    int shift = std::bit_width(size - 1) - 1;
+    size_t step = (static_cast<size_t>(1) << shift) >> 2;
+    size_t blockSize = (size + step - 1) & ~(step - 1);
+
+    // Large blocks are whole huge pages
+    if (blockSize >= LARGE_BLOCK) {
+        blockSize = (blockSize + LARGE_BLOCK - 1) & ~(LARGE_BLOCK - 1);
+    }
+    return blockSize;
+}
+
+void* BufferAllocator::Allocate(size_t size) {
+    if (size == 0) return nullptr;
+    size_t blockSize = SizeClass(size);
+    AllocatorCounters& counters = GetCounters();
+
+    void* ptr = nullptr;
+    if (blockSize <= THREAD_CACHE_MAX_BLOCK) {
+        ThreadBlockCache& cache = GetThreadCache();
+        auto& list = cache.blocks[ThreadClassIndex(blockSize)];
+        if (!list.empty()) {
+            ptr = list.back();
+            list.pop_back();
+            cache.bytes -= blockSize;
+            counters.cachedBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+        }
+    }
+    if (!ptr) {
+        ptr = SharedPop(blockSize);
+    }
+    if (ptr) {
+        counters.cacheHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        ptr = SystemAllocate(blockSize);
+    }
+
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t live = counters.liveBytes.fetch_add(blockSize, std::memory_order_relaxed) + blockSize;
+    size_t peak = counters.peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !counters.peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    return ptr;
+}
+
+void BufferAllocator::Free(void* ptr, size_t size) {
+    if (!ptr) return;
+    size_t blockSize = SizeClass(size);
+    AllocatorCounters& counters = GetCounters();
+    counters.frees.fetch_add(1, std::memory_order_relaxed);
+    counters.liveBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+
+    if (blockSize <= THREAD_CACHE_MAX_BLOCK) {
+        ThreadBlockCache& cache = GetThreadCache();
+        auto& list = cache.blocks[ThreadClassIndex(blockSize)];
+        if (list.size() < THREAD_CACHE_BLOCKS_PER_CLASS && cache.bytes + blockSize <= THREAD_CACHE_MAX_BYTES) {
+            list.push_back(ptr);
+            cache.bytes += blockSize;
+            counters.cachedBytes.fetch_add(blockSize, std::memory_order_relaxed);
+            return;
+        }
+    }
+    if (!SharedPush(ptr, blockSize)) {
+        SystemFree(ptr, blockSize);
+    }
+}
+
+void BufferAllocator::Trim() {
+    GetThreadCache().Flush();
+
+    std::vector<std::pair<void*, size_t>> released;
+    {
+        SharedBlockCache& cache = GetSharedCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        for (auto& entry : cache.blocks) {
+            for (void* ptr : entry.second) {
+                released.emplace_back(ptr, entry.first);
+            }
+        }
+        GetCounters().cachedBytes.fetch_sub(cache.bytes, std::memory_order_relaxed);
+        cache.blocks.clear();
+        cache.bytes = 0;
+    }
+    ReleaseToSystem(released);
+}
+
+void BufferAllocator::SetCacheLimit(size_t bytes) {
+    std::vector<std::pair<void*, size_t>> released;
+    {
+        SharedBlockCache& cache = GetSharedCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.limit = bytes;
+
+        // Evict the largest blocks first until the cache fits
+        std::vector<size_t> classes;
+        for (const auto& entry : cache.blocks) classes.push_back(entry.first);
+        std::sort(classes.rbegin(), classes.rend());
+        for (size_t blockSize : classes) {
+            auto& list = cache.blocks[blockSize];
+            while (cache.bytes > cache.limit && !list.empty()) {
+                released.emplace_back(list.back(), blockSize);
+                list.pop_back();
+                cache.bytes -= blockSize;
+                GetCounters().cachedBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+            }
+        }
+    }
+    ReleaseToSystem(released);
+}
+
+size_t BufferAllocator::GetCacheLimit() {
+    SharedBlockCache& cache = GetSharedCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return cache.limit;
+}
+
+BufferAllocator::Stats BufferAllocator::GetStats() {
+    const AllocatorCounters& counters = GetCounters();
+    Stats stats;
+    stats.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+    stats.peakLiveBytes = counters.peakLiveBytes.load(std::memory_order_relaxed);
+    stats.cachedBytes = counters.cachedBytes.load(std::memory_order_relaxed);
+    stats.systemBytes = counters.systemBytes.load(std::memory_order_relaxed);
+    stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+    stats.frees = counters.frees.load(std::memory_order_relaxed);
+    stats.cacheHits = counters.cacheHits.load(std::memory_order_relaxed);
+    stats.systemAllocations = counters.systemAllocations.load(std::memory_order_relaxed);
+    stats.systemFrees = counters.systemFrees.load(std::memory_order_relaxed);
+    stats.hugePagesRequested = counters.hugePagesRequested.load(std::memory_order_relaxed);
+#ifdef _WIN32
+    // MEM_LARGE_PAGES commits large pages or fails
+    stats.hugePages = stats.hugePagesRequested;
+#else
+    // The kernel may still back advised blocks with small pages (fragmented
+    // memory, khugepaged not caught up); AnonHugePages is process-wide
+    stats.hugePages = stats.hugePagesRequested && AnonHugePagesKB() > 0;
+#endif
+    return stats;
+}
+
+void BufferAllocator::ResetPeak() {
+    AllocatorCounters& counters = GetCounters();
+    counters.peakLiveBytes.store(counters.liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Recycling allocator for pixel memory (backs BufferManager::Create/Destroy).
+// Requests are rounded up to size classes (four per power of two) so freed
+// blocks can be reused by later buffers of similar size. Tile-sized blocks go
+// through a small per-thread cache first, then a shared cache; blocks of
+// LARGE_BLOCK bytes and up come straight from the OS and ask for huge pages
+// when the system allows it. Every block is at least ALIGNMENT-aligned.
+class BufferAllocator {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr size_t MIN_BLOCK = 4096;
+    static constexpr size_t LARGE_BLOCK = 2 * 1024 * 1024;
+    static constexpr size_t THREAD_CACHE_MAX_BLOCK = 1024 * 1024;
+
+    struct Stats {
+        size_t liveBytes = 0;       // size-class bytes handed out
+        size_t peakLiveBytes = 0;
+        size_t cachedBytes = 0;     // free blocks kept for reuse
+        size_t systemBytes = 0;     // bytes currently obtained from the OS
+        uint64_t allocations = 0;
+        uint64_t frees = 0;
+        uint64_t cacheHits = 0;     // allocations served from a cache
+        uint64_t systemAllocations = 0;
+        uint64_t systemFrees = 0;
+        bool hugePagesRequested = false; // large blocks asked for huge pages and the system allows them
+        bool hugePages = false;          // huge pages are actually in use (see GetStats)
+    };
+
+    // size must be passed back unchanged to Free
+    static void* Allocate(size_t size);
+    static void Free(void* ptr, size_t size);
+
+    // Bytes actually reserved for a request of the given size
+    static size_t SizeClass(size_t size);
+
+    // Return cached blocks to the OS (the calling thread's cache and the
+    // shared cache; other threads keep theirs until they exit)
+    static void Trim();
+
+    // Upper bound for the shared cache (default 256 MB)
+    static void SetCacheLimit(size_t bytes);
+    static size_t GetCacheLimit();
+
+    static Stats GetStats();
+    static void ResetPeak();
+};
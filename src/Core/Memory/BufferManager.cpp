@@ -1,106 +1,346 @@
 #include "BufferManager.h"
+#include "BufferAllocator.h"
+#include "../Math/PixelOps.h"
 #include <cstring>
 #include <algorithm>
 
-BufferManager::Buffer BufferManager::Create(uint32_t width, uint32_t height) {
+// Clamp a rectangle to [0, maxW) x [0, maxH). Returns false if nothing is left.
+static bool ClampRect(int& x, int& y, uint32_t& w, uint32_t& h, uint32_t maxW, uint32_t maxH) {
+    int64_t x0 = std::max<int64_t>(x, 0);
+    int64_t y0 = std::max<int64_t>(y, 0);
+    int64_t x1 = std::min<int64_t>(static_cast<int64_t>(x) + w, maxW);
+    int64_t y1 = std::min<int64_t>(static_cast<int64_t>(y) + h, maxH);
+    if (x1 <= x0 || y1 <= y0) {
+        return false;
+    }
+    x = static_cast<int>(x0);
+    y = static_cast<int>(y0);
+    w = static_cast<uint32_t>(x1 - x0);
+    h = static_cast<uint32_t>(y1 - y0);
+    return true;
+}
+
+size_t BufferManager::AlignedStride(uint32_t width, PixelFormat format) {
+    size_t rowBytes = static_cast<size_t>(width) * BytesPerPixel(format);
+    return (rowBytes + ROW_ALIGNMENT - 1) & ~(ROW_ALIGNMENT - 1);
+}
+
+static_assert(BufferAllocator::ALIGNMENT >= BufferManager::ROW_ALIGNMENT, "rows must stay cache-line aligned");
+
+BufferManager::Buffer BufferManager::Create(uint32_t width, uint32_t height, PixelFormat format, Storage storage) {
     Buffer buffer;
     buffer.width = width;
     buffer.height = height;
-    buffer.size = static_cast<size_t>(width) * height * 4;
-    buffer.data = new uint8_t[buffer.size];
+    buffer.format = format;
+    buffer.stride = AlignedStride(width, format);
+    buffer.size = buffer.stride * height;
+    if (buffer.size > 0) {
+        if (storage == Storage::Mapped) {
+            buffer.data = static_cast<uint8_t*>(MappedArena::Allocate(buffer.size));
+            buffer.storage = buffer.data ? Storage::Mapped : Storage::Heap;
+        }
+        if (!buffer.data) {
+            buffer.data = static_cast<uint8_t*>(BufferAllocator::Allocate(buffer.size));
+        }
+    }
     return buffer;
 }
 
 void BufferManager::Destroy(Buffer& buffer) {
     if (buffer.data) {
-        delete[] buffer.data;
+        if (buffer.storage == Storage::Mapped) {
+            MappedArena::Free(buffer.data, buffer.size);
+        } else {
+            BufferAllocator::Free(buffer.data, buffer.size);
+        }
         buffer.data = nullptr;
         buffer.width = 0;
         buffer.height = 0;
+        buffer.stride = 0;
         buffer.size = 0;
+        buffer.format = PixelFormat::RGBA8;
+        buffer.storage = Storage::Heap;
     }
 }
 
 BufferManager::Buffer BufferManager::Clone(const Buffer& source) {
-    Buffer buffer = Create(source.width, source.height);
+    Buffer buffer = Create(source.width, source.height, source.format, source.storage);
     if (source.data && buffer.data) {
         std::memcpy(buffer.data, source.data, buffer.size);
     }
     return buffer;
 }
 
+void BufferManager::Advise(const Buffer& buffer, AccessHint hint) {
+    if (!buffer.data) return;
+    if (hint == AccessHint::DontNeed && buffer.storage != Storage::Mapped) return;
+    MappedArena::Advise(buffer.data, buffer.size, hint);
+}
+
+BufferManager::BufferView BufferManager::GetView(Buffer& buffer) {
+    return BufferView(buffer.data, buffer.width, buffer.height, buffer.stride, buffer.format);
+}
+
+BufferManager::ConstBufferView BufferManager::GetView(const Buffer& buffer) {
+    return ConstBufferView(buffer.data, buffer.width, buffer.height, buffer.stride, buffer.format);
+}
+
+BufferManager::BufferView BufferManager::GetView(Buffer& buffer, int x, int y, uint32_t width, uint32_t height) {
+    return GetSubView(GetView(buffer), x, y, width, height);
+}
+
+BufferManager::ConstBufferView BufferManager::GetView(const Buffer& buffer, int x, int y, uint32_t width, uint32_t height) {
+    if (!buffer.data || !ClampRect(x, y, width, height, buffer.width, buffer.height)) {
+        return ConstBufferView();
+    }
+    return ConstBufferView(buffer.data + y * buffer.stride + static_cast<size_t>(x) * BytesPerPixel(buffer.format),
+                           width, height, buffer.stride, buffer.format);
+}
+
+BufferManager::BufferView BufferManager::GetSubView(const BufferView& view, int x, int y, uint32_t width, uint32_t height) {
+    if (!view.data || !ClampRect(x, y, width, height, view.width, view.height)) {
+        return BufferView();
+    }
+    return BufferView(view.Pixel(x, y), width, height, view.stride, view.format);
+}
+
 void BufferManager::Copy(const Buffer& src, Buffer& dst) {
-    if (src.width != dst.width || src.height != dst.height) {
-        return; // Size mismatch
+    if (src.width != dst.width || src.height != dst.height || src.format != dst.format) {
+        return; // Size or format mismatch
     }
     if (src.data && dst.data) {
         std::memcpy(dst.data, src.data, dst.size);
     }
 }
 
+void BufferManager::Copy(const ConstBufferView& src, const BufferView& dst) {
+    if (src.IsEmpty() || dst.IsEmpty() || src.format != dst.format) return;
+
+    uint32_t width = std::min(src.width, dst.width);
+    uint32_t height = std::min(src.height, dst.height);
+    size_t rowBytes = static_cast<size_t>(width) * dst.bytesPerPixel;
+
+    for (uint32_t y = 0; y < height; y++) {
+        std::memmove(dst.Row(y), src.Row(y), rowBytes);
+    }
+}
+
 void BufferManager::CopyRegion(const Buffer& src, int srcX, int srcY,
                                Buffer& dst, int dstX, int dstY,
                                uint32_t width, uint32_t height) {
     if (!src.data || !dst.data) return;
-    
-    // Clamp to valid regions
-    int srcEndX = std::min(static_cast<int>(srcX + width), static_cast<int>(src.width));
-    int srcEndY = std::min(static_cast<int>(srcY + height), static_cast<int>(src.height));
-    int dstEndX = std::min(static_cast<int>(dstX + width), static_cast<int>(dst.width));
-    int dstEndY = std::min(static_cast<int>(dstY + height), static_cast<int>(dst.height));
-    
-    int copyWidth = std::min(srcEndX - srcX, dstEndX - dstX);
-    int copyHeight = std::min(srcEndY - srcY, dstEndY - dstY);
-    
-    if (copyWidth <= 0 || copyHeight <= 0) return;
-    
-    for (int y = 0; y < copyHeight; y++) {
-        const uint8_t* srcRow = GetPixel(src, srcX, srcY + y);
-        uint8_t* dstRow = GetPixel(dst, dstX, dstY + y);
-        std::memcpy(dstRow, srcRow, copyWidth * 4);
+
+    // Shift the region so that neither origin is negative
+    int shiftX = std::max({0, -srcX, -dstX});
+    int shiftY = std::max({0, -srcY, -dstY});
+    if (static_cast<uint32_t>(shiftX) >= width || static_cast<uint32_t>(shiftY) >= height) return;
+
+    ConstBufferView srcView = GetView(src, srcX + shiftX, srcY + shiftY, width - shiftX, height - shiftY);
+    BufferView dstView = GetView(dst, dstX + shiftX, dstY + shiftY, width - shiftX, height - shiftY);
+    Copy(srcView, dstView);
+}
+
+// Pixels converted per step through the float staging row
+static constexpr uint32_t CONVERT_CHUNK = 256;
+
+// 4x4 Bayer matrix for ordered dithering down to 8 bits
+static const float DITHER_MATRIX[4][4] = {
+    { 0.0f,  8.0f,  2.0f, 10.0f},
+    {12.0f,  4.0f, 14.0f,  6.0f},
+    { 3.0f, 11.0f,  1.0f,  9.0f},
+    {15.0f,  7.0f, 13.0f,  5.0f}
+};
+
+template<typename Traits>
+static void DecodeRow(const uint8_t* src, float* dst, uint32_t count) {
+    const auto* in = reinterpret_cast<const typename Traits::Channel*>(src);
+    if constexpr (Traits::FORMAT == PixelFormat::RGBA16F) {
+        HalfFloat::ToFloat(in, dst, static_cast<size_t>(count) * 4);
+    } else if constexpr (Traits::FORMAT == PixelFormat::RGBA8) {
+        PixelOps::ConvertU8ToF32(dst, in, static_cast<size_t>(count) * 4);
+    } else {
+        for (uint32_t i = 0; i < count * 4; i++) {
+            dst[i] = Traits::ToFloat(in[i]);
+        }
     }
 }
 
+template<typename Traits>
+static void EncodeRow(const float* src, uint8_t* dst, uint32_t count, uint32_t x0, uint32_t y, bool dither) {
+    auto* out = reinterpret_cast<typename Traits::Channel*>(dst);
+    if constexpr (Traits::FORMAT == PixelFormat::RGBA16F) {
+        HalfFloat::FromFloat(src, out, static_cast<size_t>(count) * 4);
+    } else if constexpr (Traits::FORMAT == PixelFormat::RGBA8) {
+        if (!dither) {
+            PixelOps::ConvertF32ToU8(out, src, static_cast<size_t>(count) * 4);
+            return;
+        }
+        // Spread the rounding error of the color channels; alpha is rounded
+        const float* ditherRow = DITHER_MATRIX[y & 3];
+        for (uint32_t i = 0; i < count; i++) {
+            float offset = (ditherRow[(x0 + i) & 3] + 0.5f) / 16.0f - 0.5f;
+            for (int c = 0; c < 3; c++) {
+                float v = src[i * 4 + c] * 255.0f + offset + 0.5f;
+                out[i * 4 + c] = static_cast<uint8_t>(v <= 0.0f ? 0.0f : (v >= 255.0f ? 255.0f : v));
+            }
+            out[i * 4 + 3] = Traits::FromFloat(src[i * 4 + 3]);
+        }
+    } else {
+        for (uint32_t i = 0; i < count * 4; i++) {
+            out[i] = Traits::FromFloat(src[i]);
+        }
+    }
+}
+
+void BufferManager::Convert(const Buffer& src, Buffer& dst, bool dither) {
+    if (src.width != dst.width || src.height != dst.height) {
+        return; // Size mismatch
+    }
+    Convert(GetView(src), GetView(dst), dither);
+}
+
+void BufferManager::Convert(const ConstBufferView& src, const BufferView& dst, bool dither) {
+    if (src.IsEmpty() || dst.IsEmpty()) return;
+    if (src.format == dst.format) {
+        Copy(src, dst);
+        return;
+    }
+
+    uint32_t width = std::min(src.width, dst.width);
+    uint32_t height = std::min(src.height, dst.height);
+    float staging[CONVERT_CHUNK * 4];
+
+    DispatchPixelFormat(src.format, [&](auto srcTraits) {
+        DispatchPixelFormat(dst.format, [&](auto dstTraits) {
+            using SrcTraits = decltype(srcTraits);
+            using DstTraits = decltype(dstTraits);
+            for (uint32_t y = 0; y < height; y++) {
+                for (uint32_t x = 0; x < width; x += CONVERT_CHUNK) {
+                    uint32_t count = std::min(CONVERT_CHUNK, width - x);
+                    DecodeRow<SrcTraits>(src.Pixel(x, y), staging, count);
+                    EncodeRow<DstTraits>(staging, dst.Pixel(x, y), count, x, y, dither);
+                }
+            }
+        });
+    });
+}
+
+BufferManager::PlanarBuffer BufferManager::CreatePlanar(uint32_t width, uint32_t height) {
+    PlanarBuffer buffer;
+    buffer.width = width;
+    buffer.height = height;
+    buffer.stride = ((static_cast<size_t>(width) * sizeof(float) + ROW_ALIGNMENT - 1) & ~(ROW_ALIGNMENT - 1)) / sizeof(float);
+    buffer.planeSize = buffer.stride * height;
+    if (buffer.planeSize > 0) {
+        buffer.data = static_cast<float*>(BufferAllocator::Allocate(buffer.planeSize * 4 * sizeof(float)));
+    }
+    return buffer;
+}
+
+void BufferManager::Destroy(PlanarBuffer& buffer) {
+    if (buffer.data) {
+        BufferAllocator::Free(buffer.data, buffer.planeSize * 4 * sizeof(float));
+    }
+    buffer = PlanarBuffer();
+}
+
+// The transposes go through the float staging row CONVERT_CHUNK pixels at a
+// time, so the source span, the staging row and the four plane spans all
+// stay in L1 while a block is moved
+void BufferManager::ToPlanar(const ConstBufferView& src, const PlanarBuffer& dst) {
+    if (src.IsEmpty() || !dst.data) return;
+
+    uint32_t width = std::min(src.width, dst.width);
+    uint32_t height = std::min(src.height, dst.height);
+    float staging[CONVERT_CHUNK * 4];
+
+    DispatchPixelFormat(src.format, [&](auto traits) {
+        using Traits = decltype(traits);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x += CONVERT_CHUNK) {
+                uint32_t count = std::min(CONVERT_CHUNK, width - x);
+                float* const planes[4] = {dst.Row(0, y) + x, dst.Row(1, y) + x, dst.Row(2, y) + x, dst.Row(3, y) + x};
+                if constexpr (Traits::FORMAT == PixelFormat::RGBA32F) {
+                    PixelOps::Deinterleave(planes, reinterpret_cast<const float*>(src.Pixel(x, y)), count);
+                } else {
+                    DecodeRow<Traits>(src.Pixel(x, y), staging, count);
+                    PixelOps::Deinterleave(planes, staging, count);
+                }
+            }
+        }
+    });
+}
+
+void BufferManager::FromPlanar(const PlanarBuffer& src, const BufferView& dst, bool dither) {
+    if (!src.data || dst.IsEmpty()) return;
+
+    uint32_t width = std::min(src.width, dst.width);
+    uint32_t height = std::min(src.height, dst.height);
+    float staging[CONVERT_CHUNK * 4];
+
+    DispatchPixelFormat(dst.format, [&](auto traits) {
+        using Traits = decltype(traits);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x += CONVERT_CHUNK) {
+                uint32_t count = std::min(CONVERT_CHUNK, width - x);
+                const float* const planes[4] = {src.Row(0, y) + x, src.Row(1, y) + x, src.Row(2, y) + x, src.Row(3, y) + x};
+                if constexpr (Traits::FORMAT == PixelFormat::RGBA32F) {
+                    PixelOps::Interleave(reinterpret_cast<float*>(dst.Pixel(x, y)), planes, count);
+                } else {
+                    PixelOps::Interleave(staging, planes, count);
+                    EncodeRow<Traits>(staging, dst.Pixel(x, y), count, x, y, dither);
+                }
+            }
+        }
+    });
+}
+
 void BufferManager::Clear(Buffer& buffer, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-    if (!buffer.data) return;
-    
-    for (size_t i = 0; i < buffer.size; i += 4) {
-        buffer.data[i + 0] = r;
-        buffer.data[i + 1] = g;
-        buffer.data[i + 2] = b;
-        buffer.data[i + 3] = a;
+    Clear(GetView(buffer), r, g, b, a);
+}
+
+void BufferManager::Clear(const BufferView& view, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    if (view.IsEmpty()) return;
+
+    // Fill the first row, then replicate it
+    if (view.format == PixelFormat::RGBA8) {
+        PixelOps::Fill(view.Row(0), view.width, r, g, b, a);
+    } else {
+        DispatchPixelFormat(view.format, [&](auto traits) {
+            using Traits = decltype(traits);
+            using Channel = typename Traits::Channel;
+            const Channel color[4] = {
+                Traits::FromFloat(r / 255.0f), Traits::FromFloat(g / 255.0f),
+                Traits::FromFloat(b / 255.0f), Traits::FromFloat(a / 255.0f)
+            };
+            Channel* first = reinterpret_cast<Channel*>(view.Row(0));
+            for (uint32_t x = 0; x < view.width; x++) {
+                std::memcpy(first + x * 4, color, sizeof(color));
+            }
+        });
+    }
+
+    size_t rowBytes = static_cast<size_t>(view.width) * view.bytesPerPixel;
+    for (uint32_t y = 1; y < view.height; y++) {
+        std::memcpy(view.Row(y), view.Row(0), rowBytes);
     }
 }
 
 void BufferManager::ClearRegion(Buffer& buffer, int x, int y, uint32_t w, uint32_t h,
                                 uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-    if (!buffer.data) return;
-    
-    int endX = std::min(static_cast<int>(x + w), static_cast<int>(buffer.width));
-    int endY = std::min(static_cast<int>(y + h), static_cast<int>(buffer.height));
-    
-    for (int py = std::max(0, y); py < endY; py++) {
-        for (int px = std::max(0, x); px < endX; px++) {
-            uint8_t* pixel = GetPixel(buffer, px, py);
-            pixel[0] = r;
-            pixel[1] = g;
-            pixel[2] = b;
-            pixel[3] = a;
-        }
-    }
+    Clear(GetView(buffer, x, y, w, h), r, g, b, a);
 }
 
 uint8_t* BufferManager::GetPixel(Buffer& buffer, uint32_t x, uint32_t y) {
     if (x >= buffer.width || y >= buffer.height || !buffer.data) {
         return nullptr;
     }
-    return buffer.data + (y * buffer.width + x) * 4;
+    return buffer.data + y * buffer.stride + static_cast<size_t>(x) * BytesPerPixel(buffer.format);
 }
 
 const uint8_t* BufferManager::GetPixel(const Buffer& buffer, uint32_t x, uint32_t y) {
     if (x >= buffer.width || y >= buffer.height || !buffer.data) {
         return nullptr;
     }
-    return buffer.data + (y * buffer.width + x) * 4;
+    return buffer.data + y * buffer.stride + static_cast<size_t>(x) * BytesPerPixel(buffer.format);
 }
-
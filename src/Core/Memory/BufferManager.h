@@ -1,36 +1,131 @@
 #pragma once
+#include "PixelFormat.h"
+#include "MappedArena.h"
 #include <cstdint>
+#include <cstddef>
 #include <vector>
 #include <memory>
 #include <mutex>
 
-// Manages image buffer memory (RGBA8 format)
+// Manages image buffer memory (RGBA8 by default, see PixelFormat.h)
 class BufferManager {
 public:
+    // Rows start on a cache line boundary so row kernels can use aligned loads
+    static constexpr size_t ROW_ALIGNMENT = 64;
+
+    // Where pixel memory lives. Mapped buffers are paged to a scratch file
+    // (see MappedArena) and otherwise behave like heap buffers.
+    enum class Storage {
+        Heap,
+        Mapped
+    };
+
     struct Buffer {
         uint8_t* data = nullptr;
         uint32_t width = 0;
         uint32_t height = 0;
-        size_t size = 0; // width * height * 4
+        size_t stride = 0; // bytes per row, multiple of ROW_ALIGNMENT
+        size_t size = 0;   // stride * height
+        PixelFormat format = PixelFormat::RGBA8;
+        Storage storage = Storage::Heap;
     };
 
-    static Buffer Create(uint32_t width, uint32_t height);
+    // Non-owning window onto a sub-rectangle of a buffer. Rows keep the
+    // parent's stride, so a view can be processed in place without cloning.
+    template<typename T>
+    struct BasicView {
+        T* data = nullptr; // first pixel of the view
+        uint32_t width = 0;
+        uint32_t height = 0;
+        size_t stride = 0;
+        PixelFormat format = PixelFormat::RGBA8;
+        uint32_t bytesPerPixel = 4;
+
+        BasicView() = default;
+        BasicView(T* data, uint32_t width, uint32_t height, size_t stride,
+                  PixelFormat format = PixelFormat::RGBA8)
+            : data(data), width(width), height(height), stride(stride), format(format),
+              bytesPerPixel(static_cast<uint32_t>(BytesPerPixel(format))) {}
+
+        // Allow BufferView -> ConstBufferView
+        template<typename U>
+        BasicView(const BasicView<U>& other)
+            : data(other.data), width(other.width), height(other.height), stride(other.stride),
+              format(other.format), bytesPerPixel(other.bytesPerPixel) {}
+
+        T* Row(uint32_t y) const { return data + y * stride; }
+        T* Pixel(uint32_t x, uint32_t y) const { return data + y * stride + static_cast<size_t>(x) * bytesPerPixel; }
+        bool IsEmpty() const { return !data || width == 0 || height == 0; }
+    };
+
+    using BufferView = BasicView<uint8_t>;
+    using ConstBufferView = BasicView<const uint8_t>;
+
+    // Planar float layout: one contiguous plane per channel (R, G, B, A) with
+    // values normalized as by PixelFormatTraits::ToFloat. Convolutions run
+    // full-width SIMD over one channel instead of mixing channels per lane.
+    struct PlanarBuffer {
+        float* data = nullptr;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        size_t stride = 0;    // floats per row, rows start on ROW_ALIGNMENT
+        size_t planeSize = 0; // floats per plane (stride * height)
+
+        float* Plane(int channel) const { return data + channel * planeSize; }
+        float* Row(int channel, uint32_t y) const { return Plane(channel) + y * stride; }
+    };
+
+    // Mapped storage falls back to the heap if no scratch file is available
+    static Buffer Create(uint32_t width, uint32_t height, PixelFormat format = PixelFormat::RGBA8,
+                         Storage storage = Storage::Heap);
     static void Destroy(Buffer& buffer);
     static Buffer Clone(const Buffer& source);
-    
+
+    // Paging hint for the buffer's memory. DontNeed only applies to mapped
+    // buffers (heap pages have nowhere to go but the swap file).
+    static void Advise(const Buffer& buffer, AccessHint hint);
+
+    static size_t AlignedStride(uint32_t width, PixelFormat format = PixelFormat::RGBA8);
+
+    // Planar buffers (always on the heap)
+    static PlanarBuffer CreatePlanar(uint32_t width, uint32_t height);
+    static void Destroy(PlanarBuffer& buffer);
+
+    // Interleaved <-> planar transposes over the overlapping size. With
+    // dither set, conversion down to RGBA8 dithers as in Convert.
+    static void ToPlanar(const ConstBufferView& src, const PlanarBuffer& dst);
+    static void FromPlanar(const PlanarBuffer& src, const BufferView& dst, bool dither = false);
+
+    // Views (clamped to the buffer bounds)
+    static BufferView GetView(Buffer& buffer);
+    static ConstBufferView GetView(const Buffer& buffer);
+    static BufferView GetView(Buffer& buffer, int x, int y, uint32_t width, uint32_t height);
+    static ConstBufferView GetView(const Buffer& buffer, int x, int y, uint32_t width, uint32_t height);
+    static BufferView GetSubView(const BufferView& view, int x, int y, uint32_t width, uint32_t height);
+
     // Copy operations
     static void Copy(const Buffer& src, Buffer& dst);
+    static void Copy(const ConstBufferView& src, const BufferView& dst);
     static void CopyRegion(const Buffer& src, int srcX, int srcY,
                           Buffer& dst, int dstX, int dstY,
                           uint32_t width, uint32_t height);
 
-    // Clear buffer
+    // Format conversion between same-sized buffers. With dither set, conversions
+    // down to RGBA8 use an ordered dither instead of plain rounding.
+    static void Convert(const Buffer& src, Buffer& dst, bool dither = false);
+    static void Convert(const ConstBufferView& src, const BufferView& dst, bool dither = false);
+
+    // Clear buffer (color is given in 8-bit and converted to the buffer format)
     static void Clear(Buffer& buffer, uint8_t r = 0, uint8_t g = 0, uint8_t b = 0, uint8_t a = 255);
+    static void Clear(const BufferView& view, uint8_t r = 0, uint8_t g = 0, uint8_t b = 0, uint8_t a = 255);
     static void ClearRegion(Buffer& buffer, int x, int y, uint32_t w, uint32_t h,
                            uint8_t r = 0, uint8_t g = 0, uint8_t b = 0, uint8_t a = 255);
 
     // Pixel access
     static uint8_t* GetPixel(Buffer& buffer, uint32_t x, uint32_t y);
     static const uint8_t* GetPixel(const Buffer& buffer, uint32_t x, uint32_t y);
-};
 
+    // Row access (no bounds check on x)
+    static uint8_t* GetRow(Buffer& buffer, uint32_t y) { return buffer.data + y * buffer.stride; }
+    static const uint8_t* GetRow(const Buffer& buffer, uint32_t y) { return buffer.data + y * buffer.stride; }
+};
@@ -0,0 +1,241 @@
+#include "MappedArena.h"
+#include "BufferAllocator.h"
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdlib>
+#endif
+
+// Blocks are whole pages; segments are multiples of the Windows allocation
+// granularity so every segment can start at a valid view offset
+static constexpr size_t BLOCK_GRANULARITY = 4096;
+static constexpr size_t SEGMENT_GRANULARITY = 64 * 1024;
+
+struct ArenaSegment {
+    uint8_t* base = nullptr;
+    size_t size = 0;
+    size_t used = 0;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+};
+
+struct ArenaState {
+    std::mutex mutex;
+    std::string directory;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    size_t fileSize = 0;
+    size_t liveBytes = 0;
+    std::vector<ArenaSegment> segments;
+    std::unordered_map<size_t, std::vector<uint8_t*>> freeBlocks;
+};
+
+static ArenaState& GetState() {
+    static ArenaState* state = new ArenaState();
+    return *state;
+}
+
+static size_t BlockSize(size_t size) {
+    return (BufferAllocator::SizeClass(size) + BLOCK_GRANULARITY - 1) & ~(BLOCK_GRANULARITY - 1);
+}
+
+static bool OpenScratchFile(ArenaState& state) {
+    std::error_code error;
+    std::filesystem::path directory = state.directory.empty()
+        ? std::filesystem::temp_directory_path(error)
+        : std::filesystem::path(state.directory);
+    if (error) return false;
+
+#ifdef _WIN32
+    wchar_t path[MAX_PATH];
+    if (!GetTempFileNameW(directory.wstring().c_str(), L"fto", 0, path)) return false;
+    state.file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    return state.file != INVALID_HANDLE_VALUE;
+#else
+    std::string path = (directory / "foto-scratch-XXXXXX").string();
+    state.fd = mkstemp(path.data());
+    if (state.fd < 0) return false;
+    unlink(path.c_str()); // the file lives until the descriptor is closed
+    return true;
+#endif
+}
+
+// Caller holds the lock
+static ArenaSegment* AddSegment(ArenaState& state, size_t minSize) {
+#ifdef _WIN32
+    if (state.file == INVALID_HANDLE_VALUE && !OpenScratchFile(state)) return nullptr;
+#else
+    if (state.fd < 0 && !OpenScratchFile(state)) return nullptr;
+#endif
+
+    size_t size = std::max(MappedArena::SEGMENT_SIZE, minSize);
+    size = (size + SEGMENT_GRANULARITY - 1) & ~(SEGMENT_GRANULARITY - 1);
+    size_t offset = state.fileSize;
+
+    ArenaSegment segment;
+    segment.size = size;
+#ifdef _WIN32
+    uint64_t end = static_cast<uint64_t>(offset) + size;
+    segment.mapping = CreateFileMappingW(state.file, nullptr, PAGE_READWRITE,
+                                         static_cast<DWORD>(end >> 32), static_cast<DWORD>(end), nullptr);
+    if (!segment.mapping) return nullptr;
+    segment.base = static_cast<uint8_t*>(MapViewOfFile(segment.mapping, FILE_MAP_ALL_ACCESS,
+        static_cast<DWORD>(static_cast<uint64_t>(offset) >> 32), static_cast<DWORD>(offset), size));
+    if (!segment.base) {
+        CloseHandle(segment.mapping);
+        return nullptr;
+    }
+#else
+    // Reserve the disk space now so a full disk fails here, not on first touch
+    if (posix_fallocate(state.fd, static_cast<off_t>(offset), static_cast<off_t>(size)) != 0) return nullptr;
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, state.fd, static_cast<off_t>(offset));
+    if (base == MAP_FAILED) return nullptr;
+    segment.base = static_cast<uint8_t*>(base);
+#endif
+
+    state.fileSize += size;
+    state.segments.push_back(segment);
+    return &state.segments.back();
+}
+
+// Unmaps everything and closes the scratch file. Caller holds the lock.
+static void ReleaseAll(ArenaState& state) {
+    for (const ArenaSegment& segment : state.segments) {
+#ifdef _WIN32
+        UnmapViewOfFile(segment.base);
+        CloseHandle(segment.mapping);
+#else
+        munmap(segment.base, segment.size);
+#endif
+    }
+    state.segments.clear();
+    state.freeBlocks.clear();
+    state.fileSize = 0;
+#ifdef _WIN32
+    if (state.file != INVALID_HANDLE_VALUE) {
+        CloseHandle(state.file);
+        state.file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (state.fd >= 0) {
+        close(state.fd);
+        state.fd = -1;
+    }
+#endif
+}
+
+void* MappedArena::Allocate(size_t size) {
+    if (size == 0) return nullptr;
+    size_t blockSize = BlockSize(size);
+
+    ArenaState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    uint8_t* block = nullptr;
+    auto it = state.freeBlocks.find(blockSize);
+    if (it != state.freeBlocks.end() && !it->second.empty()) {
+        block = it->second.back();
+        it->second.pop_back();
+    } else {
+        ArenaSegment* segment = state.segments.empty() ? nullptr : &state.segments.back();
+        if (!segment || segment->size - segment->used < blockSize) {
+            segment = AddSegment(state, blockSize);
+            if (!segment) return nullptr;
+        }
+        block = segment->base + segment->used;
+        segment->used += blockSize;
+    }
+
+    state.liveBytes += blockSize;
+    return block;
+}
+
+void MappedArena::Free(void* ptr, size_t size) {
+    if (!ptr) return;
+    size_t blockSize = BlockSize(size);
+
+    ArenaState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.liveBytes -= blockSize;
+    if (state.liveBytes == 0) {
+        ReleaseAll(state); // last block of the document: give the disk space back
+        return;
+    }
+    state.freeBlocks[blockSize].push_back(static_cast<uint8_t*>(ptr));
+}
+
+void MappedArena::Advise(void* ptr, size_t size, AccessHint hint) {
+    if (!ptr || size == 0) return;
+
+#ifdef _WIN32
+    const uintptr_t pageSize = BLOCK_GRANULARITY;
+#else
+    const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+#endif
+    uintptr_t begin = (reinterpret_cast<uintptr_t>(ptr) + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + size) & ~(pageSize - 1);
+    if (end <= begin) return;
+    void* start = reinterpret_cast<void*>(begin);
+    size_t length = end - begin;
+
+#ifdef _WIN32
+    switch (hint) {
+        case AccessHint::WillNeed: {
+            WIN32_MEMORY_RANGE_ENTRY range = {start, length};
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+            break;
+        }
+        case AccessHint::DontNeed:
+            // Unlocking pages that are not locked trims them from the working set
+            VirtualUnlock(start, length);
+            break;
+        default:
+            break; // No per-range read-ahead control
+    }
+#else
+    int advice = MADV_NORMAL;
+    switch (hint) {
+        case AccessHint::Normal:     advice = MADV_NORMAL; break;
+        case AccessHint::Sequential: advice = MADV_SEQUENTIAL; break;
+        case AccessHint::Random:     advice = MADV_RANDOM; break;
+        case AccessHint::WillNeed:   advice = MADV_WILLNEED; break;
+        case AccessHint::DontNeed:   advice = MADV_DONTNEED; break;
+    }
+    madvise(start, length, advice);
+#endif
+}
+
+void MappedArena::SetDirectory(const std::string& directory) {
+    ArenaState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.directory = directory;
+}
+
+size_t MappedArena::GetMappedBytes() {
+    ArenaState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.fileSize;
+}
+
+size_t MappedArena::GetUsedBytes() {
+    ArenaState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.liveBytes;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Page-out hints for file-backed (or any page-aligned) memory
+enum class AccessHint {
+    Normal,
+    Sequential, // read ahead aggressively
+    Random,     // no read-ahead
+    WillNeed,   // page in now
+    DontNeed    // drop from RAM; mapped data stays in the scratch file
+};
+
+// Pixel memory backed by a memory-mapped scratch file. The OS pages blocks
+// in and out of the file on demand, so documents larger than physical memory
+// do not go through the swap file. The scratch file is created on first use,
+// deleted automatically and grows in SEGMENT_SIZE steps; it is released when
+// the last block is freed.
+class MappedArena {
+public:
+    static constexpr size_t SEGMENT_SIZE = 256 * 1024 * 1024;
+
+    // Returns nullptr if no scratch file could be created or grown
+    static void* Allocate(size_t size);
+    static void Free(void* ptr, size_t size);
+
+    // Hint over the whole pages inside [ptr, ptr + size)
+    static void Advise(void* ptr, size_t size, AccessHint hint);
+
+    // Directory for scratch files (default: the system temp directory).
+    // Takes effect when the next scratch file is created.
+    static void SetDirectory(const std::string& directory);
+
+    static size_t GetMappedBytes(); // size of the scratch file
+    static size_t GetUsedBytes();   // bytes in live blocks
+};
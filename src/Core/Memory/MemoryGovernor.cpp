@@ -0,0 +1,187 @@
+#include "MemoryGovernor.h"
+#include "BufferAllocator.h"
+#include "../../Utils/Config.h"
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Used when neither Config nor the system report anything
+static constexpr size_t FALLBACK_BUDGET = 4ull * 1024 * 1024 * 1024;
+static constexpr int MAX_RECLAIM_PASSES = 3;
+
+MemoryGovernor& MemoryGovernor::GetInstance() {
+    static MemoryGovernor instance;
+    return instance;
+}
+
+MemoryGovernor::MemoryGovernor() {
+    int budgetMB = Config::GetInstance().GetInt("MemoryBudgetMB", 0);
+    size_t budget = budgetMB > 0 ? static_cast<size_t>(budgetMB) << 20 : DetectSystemMemory() / 4 * 3;
+    budget_ = budget > 0 ? budget : FALLBACK_BUDGET;
+
+    // Free blocks parked in the buffer allocator are the cheapest to give back
+    Register("Buffer allocator cache", PRIORITY_ALLOCATOR_CACHE,
+        [] { return BufferAllocator::GetStats().cachedBytes; },
+        [](size_t) {
+            size_t before = BufferAllocator::GetStats().cachedBytes;
+            BufferAllocator::Trim();
+            size_t after = BufferAllocator::GetStats().cachedBytes;
+            return before > after ? before - after : 0;
+        });
+}
+
+MemoryGovernor::ConsumerId MemoryGovernor::Register(const std::string& name, int priority,
+                                                    UsageCallback usage, ReclaimCallback reclaim) {
+    auto consumer = std::make_shared<Consumer>();
+    consumer->name = name;
+    consumer->priority = priority;
+    consumer->usage = std::move(usage);
+    consumer->reclaim = std::move(reclaim);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    consumer->id = nextId_++;
+    auto pos = std::upper_bound(consumers_.begin(), consumers_.end(), priority,
+        [](int value, const std::shared_ptr<Consumer>& c) { return value < c->priority; });
+    consumers_.insert(pos, consumer);
+    return consumer->id;
+}
+
+void MemoryGovernor::Unregister(ConsumerId id) {
+    std::shared_ptr<Consumer> consumer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find_if(consumers_.begin(), consumers_.end(),
+            [id](const std::shared_ptr<Consumer>& c) { return c->id == id; });
+        if (it == consumers_.end()) return;
+        consumer = *it;
+        consumers_.erase(it);
+    }
+
+    // Wait for a callback running on another thread before the owner goes away
+    std::lock_guard<std::mutex> lock(consumer->callMutex);
+    consumer->active = false;
+}
+
+void MemoryGovernor::SetBudget(size_t bytes) {
+    budget_ = bytes;
+}
+
+std::vector<std::shared_ptr<MemoryGovernor::Consumer>> MemoryGovernor::Snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return consumers_;
+}
+
+size_t MemoryGovernor::QueryUsage(Consumer& consumer) {
+    std::lock_guard<std::mutex> lock(consumer.callMutex);
+    return (consumer.active && consumer.usage) ? consumer.usage() : 0;
+}
+
+size_t MemoryGovernor::Check() {
+    size_t budget = GetBudget();
+    size_t usage = GetTotalUsage();
+    if (usage <= budget) return 0;
+
+    // Memory freed by one consumer can park in the allocator cache, which was
+    // already trimmed, so measure again and repeat while passes make progress
+    size_t target = static_cast<size_t>(budget * RECLAIM_TARGET);
+    size_t freed = 0;
+    for (int pass = 0; pass < MAX_RECLAIM_PASSES && usage > target; pass++) {
+        size_t released = Reclaim(usage - target);
+        if (released == 0) break;
+        freed += released;
+        usage = GetTotalUsage();
+    }
+    return freed;
+}
+
+size_t MemoryGovernor::Reclaim(size_t bytes) {
+    // One reclaim pass at a time; concurrent callers leave it to the first
+    if (reclaiming_.exchange(true)) return 0;
+
+    size_t freed = 0;
+    for (const auto& consumer : Snapshot()) {
+        if (freed >= bytes) break;
+
+        std::lock_guard<std::mutex> lock(consumer->callMutex);
+        if (!consumer->active || !consumer->reclaim) continue;
+        size_t released = consumer->reclaim(bytes - freed);
+        consumer->reclaimedBytes += released;
+        freed += released;
+    }
+
+    reclaiming_ = false;
+    return freed;
+}
+
+size_t MemoryGovernor::GetTotalUsage() const {
+    size_t total = 0;
+    for (const auto& consumer : Snapshot()) {
+        total += QueryUsage(*consumer);
+    }
+    return total;
+}
+
+std::vector<MemoryGovernor::ConsumerUsage> MemoryGovernor::GetUsage() const {
+    std::vector<ConsumerUsage> report;
+    for (const auto& consumer : Snapshot()) {
+        ConsumerUsage entry;
+        entry.name = consumer->name;
+        entry.priority = consumer->priority;
+        entry.bytes = QueryUsage(*consumer);
+        {
+            std::lock_guard<std::mutex> lock(consumer->callMutex);
+            entry.reclaimedBytes = consumer->reclaimedBytes;
+        }
+        report.push_back(entry);
+    }
+    return report;
+}
+
+size_t MemoryGovernor::DetectSystemMemory() {
+#ifdef _WIN32
+    size_t memory = 0;
+    MEMORYSTATUSEX status = {};
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status)) {
+        memory = static_cast<size_t>(status.ullTotalPhys);
+    }
+
+    // A job object may cap the process below physical memory
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION job = {};
+    if (QueryInformationJobObject(nullptr, JobObjectExtendedLimitInformation, &job, sizeof(job), nullptr)) {
+        if (job.BasicLimitInformation.LimitFlags & JOB_OBJECT_LIMIT_PROCESS_MEMORY) {
+            memory = std::min(memory, static_cast<size_t>(job.ProcessMemoryLimit));
+        }
+        if (job.BasicLimitInformation.LimitFlags & JOB_OBJECT_LIMIT_JOB_MEMORY) {
+            memory = std::min(memory, static_cast<size_t>(job.JobMemoryLimit));
+        }
+    }
+    return memory;
+#else
+    size_t memory = static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    // cgroup v2, then v1 ("max" or a huge value means no limit)
+    for (const char* path : {"/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes"}) {
+        std::ifstream file(path);
+        std::string value;
+        if (file >> value && !value.empty() && value != "max") {
+            try {
+                size_t limit = static_cast<size_t>(std::stoull(value));
+                if (limit > 0) memory = std::min(memory, limit);
+            } catch (...) {
+            }
+            break;
+        }
+    }
+    return memory;
+#endif
+}
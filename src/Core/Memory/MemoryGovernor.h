@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+// Process-wide heap budget shared by caches, history and layers.
+// Subsystems register as consumers with a priority, a usage callback and a
+// reclaim callback. When the summed usage goes over the budget, Check()
+// asks consumers to give memory back, lowest priority (cheapest to rebuild)
+// first, until usage is under RECLAIM_TARGET of the budget.
+//
+// Reclaim callbacks run on the thread that calls Check(), outside the
+// governor's lock. Callers must not hold a lock their own callback takes.
+class MemoryGovernor {
+public:
+    using ConsumerId = uint32_t;
+    using UsageCallback = std::function<size_t()>;
+    using ReclaimCallback = std::function<size_t(size_t bytes)>; // returns bytes freed
+
+    // Reclaim order: lower values go first
+    static constexpr int PRIORITY_ALLOCATOR_CACHE = 0;
+    static constexpr int PRIORITY_STACK_CACHE = 5;
+    static constexpr int PRIORITY_TILE_CACHE = 10;
+    static constexpr int PRIORITY_HISTORY = 20;
+    static constexpr int PRIORITY_LAYERS = 30;
+
+    static constexpr float RECLAIM_TARGET = 0.9f;
+
+    struct ConsumerUsage {
+        std::string name;
+        int priority = 0;
+        size_t bytes = 0;
+        size_t reclaimedBytes = 0; // total freed on request so far
+    };
+
+    static MemoryGovernor& GetInstance();
+
+    ConsumerId Register(const std::string& name, int priority,
+                        UsageCallback usage, ReclaimCallback reclaim);
+    void Unregister(ConsumerId id);
+
+    // Budget in bytes. Defaults to Config "MemoryBudgetMB", or 75% of the
+    // memory available to the process (cgroup/job limit or physical RAM).
+    size_t GetBudget() const { return budget_.load(std::memory_order_relaxed); }
+    void SetBudget(size_t bytes);
+
+    // Reclaims if usage is over budget; returns the bytes freed
+    size_t Check();
+
+    // Frees at least the given bytes if consumers can; returns the bytes freed
+    size_t Reclaim(size_t bytes);
+
+    size_t GetTotalUsage() const;
+    std::vector<ConsumerUsage> GetUsage() const;
+
+    // Memory available to the process (limit of the container/job, or RAM)
+    static size_t DetectSystemMemory();
+
+private:
+    MemoryGovernor();
+    ~MemoryGovernor() = default;
+    MemoryGovernor(const MemoryGovernor&) = delete;
+    MemoryGovernor& operator=(const MemoryGovernor&) = delete;
+
+    struct Consumer {
+        ConsumerId id = 0;
+        std::string name;
+        int priority = 0;
+        UsageCallback usage;
+        ReclaimCallback reclaim;
+        size_t reclaimedBytes = 0;
+        bool active = true;
+        std::mutex callMutex; // held while a callback runs; Unregister waits on it
+    };
+
+    std::vector<std::shared_ptr<Consumer>> Snapshot() const;
+    static size_t QueryUsage(Consumer& consumer);
+
+    std::vector<std::shared_ptr<Consumer>> consumers_; // sorted by priority
+    ConsumerId nextId_ = 1;
+    std::atomic<size_t> budget_{0};
+    std::atomic<bool> reclaiming_{false};
+    mutable std::mutex mutex_;
+};
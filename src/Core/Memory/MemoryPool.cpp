@@ -1,42 +1,291 @@
 #include "MemoryPool.h"
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
 
-MemoryPool::MemoryPool(size_t blockSize, size_t numBlocks)
-    : blockSize_(blockSize), pool_(blockSize * numBlocks), used_(numBlocks, false) {
+// Blocks a thread keeps per pool; half a magazine moves per refill or drain
+static constexpr size_t MAGAZINE_SIZE = 32;
+static constexpr uint8_t POISON_BYTE = 0xDD;
+
+#ifdef _DEBUG
+static constexpr bool DEFAULT_DEBUG_CHECKS = true;
+#else
+static constexpr bool DEFAULT_DEBUG_CHECKS = false;
+#endif
+
+struct MemoryPoolState {
+    struct Slab {
+        uint8_t* data = nullptr;
+        std::vector<uint8_t> allocated; // per-block state, debug checks only
+    };
+
+    size_t stride;
+    size_t blocksPerSlab;
+    size_t alignment;
+    size_t maxSlabs;
+
+    mutable std::mutex mutex;
+    void* freeList = nullptr;
+    size_t freeCount = 0;     // blocks on freeList
+    std::vector<Slab> slabs;  // sorted by address
+    size_t invalidFrees = 0;
+    std::atomic<size_t> outstanding{0}; // blocks handed out, updated without the lock
+    std::atomic<bool> debug{DEFAULT_DEBUG_CHECKS};
+    std::atomic<bool> alive{true};
+
+    MemoryPoolState(size_t stride, size_t blocksPerSlab, size_t alignment, size_t maxSlabs)
+        : stride(stride), blocksPerSlab(blocksPerSlab), alignment(alignment), maxSlabs(maxSlabs) {}
+
+    ~MemoryPoolState() {
+        for (Slab& slab : slabs) {
+            ::operator delete(slab.data, std::align_val_t(alignment));
+        }
+    }
+
+    static void* NextOf(void* block) {
+        void* next;
+        std::memcpy(&next, block, sizeof(next));
+        return next;
+    }
+
+    void Push(void* block) {
+        std::memcpy(block, &freeList, sizeof(freeList));
+        freeList = block;
+        freeCount++;
+    }
+
+    void* Pop() {
+        if (!freeList && !Grow()) return nullptr;
+        void* block = freeList;
+        freeList = NextOf(block);
+        freeCount--;
+        return block;
+    }
+
+    // Caller holds the lock
+    bool Grow() {
+        if (maxSlabs != 0 && slabs.size() >= maxSlabs) return false;
+
+        Slab slab;
+        slab.data = static_cast<uint8_t*>(::operator new(stride * blocksPerSlab, std::align_val_t(alignment)));
+        slab.allocated.assign(blocksPerSlab, 0);
+
+        // Link in reverse so blocks are handed out in address order
+        for (size_t i = blocksPerSlab; i-- > 0;) {
+            Push(slab.data + i * stride);
+        }
+
+        auto pos = std::lower_bound(slabs.begin(), slabs.end(), slab.data,
+            [](const Slab& s, const uint8_t* data) { return s.data < data; });
+        slabs.insert(pos, std::move(slab));
+        return true;
+    }
+
+    // Slab and block index for ptr, or nullptr if ptr is not a block start.
+    // Caller holds the lock.
+    Slab* Find(const void* ptr, size_t& index) {
+        const uint8_t* p = static_cast<const uint8_t*>(ptr);
+        auto it = std::upper_bound(slabs.begin(), slabs.end(), p,
+            [](const uint8_t* value, const Slab& s) { return value < s.data; });
+        if (it == slabs.begin()) return nullptr;
+        --it;
+
+        size_t offset = static_cast<size_t>(p - it->data);
+        if (offset >= stride * blocksPerSlab || offset % stride != 0) return nullptr;
+        index = offset / stride;
+        return &*it;
+    }
+};
+
+// --- Thread magazines ---
+
+struct PoolMagazine {
+    std::shared_ptr<MemoryPoolState> state;
+    void* blocks[MAGAZINE_SIZE];
+    size_t count = 0;
+};
+
+static void Refill(PoolMagazine& magazine) {
+    MemoryPoolState& state = *magazine.state;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    while (magazine.count < MAGAZINE_SIZE / 2) {
+        void* block = state.Pop();
+        if (!block) break;
+        magazine.blocks[magazine.count++] = block;
+    }
+}
+
+static void Drain(PoolMagazine& magazine, size_t count) {
+    MemoryPoolState& state = *magazine.state;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for (size_t i = 0; i < count; i++) {
+        state.Push(magazine.blocks[--magazine.count]);
+    }
+}
+
+// Set once this thread's magazines are destroyed (thread or process exit)
+static thread_local bool magazinesGone = false;
+
+struct ThreadMagazines {
+    std::vector<PoolMagazine> magazines;
+
+    ~ThreadMagazines() {
+        for (PoolMagazine& magazine : magazines) {
+            Drain(magazine, magazine.count);
+        }
+        magazinesGone = true;
+    }
+
+    PoolMagazine& Get(const std::shared_ptr<MemoryPoolState>& state) {
+        for (PoolMagazine& magazine : magazines) {
+            if (magazine.state == state) return magazine;
+        }
+
+        // Let go of pools destroyed since the last lookup
+        for (auto it = magazines.begin(); it != magazines.end();) {
+            if (!it->state->alive.load(std::memory_order_relaxed)) {
+                Drain(*it, it->count);
+                it = magazines.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        magazines.emplace_back();
+        magazines.back().state = state;
+        return magazines.back();
+    }
+
+    void Release(const std::shared_ptr<MemoryPoolState>& state) {
+        for (auto it = magazines.begin(); it != magazines.end(); ++it) {
+            if (it->state == state) {
+                Drain(*it, it->count);
+                magazines.erase(it);
+                return;
+            }
+        }
+    }
+};
+
+static ThreadMagazines* GetMagazines() {
+    if (magazinesGone) return nullptr;
+    static thread_local ThreadMagazines magazines;
+    return &magazines;
+}
+
+// --- MemoryPool ---
+
+MemoryPool::MemoryPool(size_t blockSize, size_t blocksPerSlab, size_t alignment, size_t maxSlabs)
+    : blockSize_(blockSize), alignment_(std::max(alignment, alignof(void*))) {
+    // Alignment must be a power of two; every block can hold the free-list link
+    if ((alignment_ & (alignment_ - 1)) != 0) {
+        alignment_ = alignof(std::max_align_t);
+    }
+    size_t stride = std::max(blockSize_, sizeof(void*));
+    stride = (stride + alignment_ - 1) & ~(alignment_ - 1);
+    state_ = std::make_shared<MemoryPoolState>(stride, std::max<size_t>(blocksPerSlab, 1), alignment_, maxSlabs);
 }
 
 MemoryPool::~MemoryPool() {
+    // Other threads return their magazines on their next pool lookup or at exit
+    state_->alive = false;
+    if (ThreadMagazines* magazines = GetMagazines()) {
+        magazines->Release(state_);
+    }
 }
 
 void* MemoryPool::Allocate() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    for (size_t i = 0; i < used_.size(); i++) {
-        if (!used_[i]) {
-            used_[i] = true;
-            return pool_.data() + i * blockSize_;
+    void* block = nullptr;
+    if (ThreadMagazines* magazines = GetMagazines()) {
+        PoolMagazine& magazine = magazines->Get(state_);
+        if (magazine.count == 0) {
+            Refill(magazine);
         }
+        if (magazine.count == 0) return nullptr;
+        block = magazine.blocks[--magazine.count];
+    } else {
+        // Thread is shutting down: use the shared list directly
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        block = state_->Pop();
+        if (!block) return nullptr;
+    }
+
+    if (state_->debug.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        size_t index;
+        state_->Find(block, index)->allocated[index] = 1;
     }
-    
-    return nullptr; // Pool exhausted
+    state_->outstanding.fetch_add(1, std::memory_order_relaxed);
+    return block;
 }
 
 void MemoryPool::Deallocate(void* ptr) {
     if (!ptr) return;
-    
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    uint8_t* bytePtr = static_cast<uint8_t*>(ptr);
-    if (bytePtr >= pool_.data() && bytePtr < pool_.data() + pool_.size()) {
-        size_t index = (bytePtr - pool_.data()) / blockSize_;
-        if (index < used_.size()) {
-            used_[index] = false;
+
+    if (state_->debug.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        size_t index;
+        MemoryPoolState::Slab* slab = state_->Find(ptr, index);
+        if (!slab || !slab->allocated[index]) {
+            state_->invalidFrees++; // foreign pointer or double free
+            return;
         }
+        slab->allocated[index] = 0;
+        std::memset(ptr, POISON_BYTE, state_->stride);
     }
+    state_->outstanding.fetch_sub(1, std::memory_order_relaxed);
+
+    if (ThreadMagazines* magazines = GetMagazines()) {
+        PoolMagazine& magazine = magazines->Get(state_);
+        if (magazine.count == MAGAZINE_SIZE) {
+            Drain(magazine, MAGAZINE_SIZE / 2);
+        }
+        magazine.blocks[magazine.count++] = ptr;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->Push(ptr);
 }
 
 size_t MemoryPool::GetAvailableBlocks() const {
-    std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(mutex_));
-    return std::count(used_.begin(), used_.end(), false);
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->slabs.size() * state_->blocksPerSlab - state_->outstanding.load(std::memory_order_relaxed);
+}
+
+size_t MemoryPool::GetCapacity() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->slabs.size() * state_->blocksPerSlab;
+}
+
+size_t MemoryPool::GetSlabCount() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->slabs.size();
 }
 
+bool MemoryPool::Owns(const void* ptr) const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    size_t index;
+    return state_->Find(ptr, index) != nullptr;
+}
+
+void MemoryPool::SetDebugChecks(bool enabled) {
+    // Block states are only tracked while checks are on, so switching is
+    // allowed only while no block is handed out
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->outstanding.load(std::memory_order_relaxed) == 0) {
+        state_->debug = enabled;
+    }
+}
+
+bool MemoryPool::GetDebugChecks() const {
+    return state_->debug.load(std::memory_order_relaxed);
+}
+
+size_t MemoryPool::GetInvalidFreeCount() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->invalidFrees;
+}
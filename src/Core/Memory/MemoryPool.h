@@ -1,25 +1,53 @@
 #pragma once
 #include <cstdint>
-#include <vector>
+#include <cstddef>
 #include <memory>
-#include <mutex>
 
-// Fixed-size memory pool for efficient allocation
+struct MemoryPoolState;
+
+// Fixed-size block pool.
+// Free blocks form an intrusive singly-linked list, so Allocate/Deallocate
+// are O(1). Each thread keeps a small magazine of blocks per pool and only
+// takes the pool lock to refill or drain it in batches. The pool grows by
+// whole slabs of blocksPerSlab blocks, up to maxSlabs (0 = unlimited).
+//
+// Debug checks (on by default in _DEBUG builds) reject double frees and
+// pointers that do not belong to the pool, and poison freed blocks.
+//
+// Nothing allocates from a pool yet. Tile pixels come from BufferAllocator
+// and scratch memory from ScratchArena chunks, because slabs are never
+// returned to the system and the memory governor could not trim them.
+// The pool suits fixed-size objects whose population stays steady.
 class MemoryPool {
 public:
-    MemoryPool(size_t blockSize, size_t numBlocks);
+    MemoryPool(size_t blockSize, size_t blocksPerSlab,
+               size_t alignment = alignof(std::max_align_t), size_t maxSlabs = 0);
     ~MemoryPool();
 
+    MemoryPool(const MemoryPool&) = delete;
+    MemoryPool& operator=(const MemoryPool&) = delete;
+
+    // Returns nullptr only when maxSlabs is reached
     void* Allocate();
     void Deallocate(void* ptr);
 
     size_t GetBlockSize() const { return blockSize_; }
+    size_t GetAlignment() const { return alignment_; }
+
+    // Blocks not handed out, including those parked in thread magazines
     size_t GetAvailableBlocks() const;
+    size_t GetCapacity() const;
+    size_t GetSlabCount() const;
+
+    // Whether ptr points at a block of this pool (takes the pool lock)
+    bool Owns(const void* ptr) const;
+
+    void SetDebugChecks(bool enabled);
+    bool GetDebugChecks() const;
+    size_t GetInvalidFreeCount() const;
 
 private:
     size_t blockSize_;
-    std::vector<uint8_t> pool_;
-    std::vector<bool> used_;
-    std::mutex mutex_;
+    size_t alignment_;
+    std::shared_ptr<MemoryPoolState> state_;
 };
-
@@ -0,0 +1,70 @@
+#include "PixelFormat.h"
+#include "../Math/PixelOps.h"
+#include <cstring>
+
+static uint32_t FloatBits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float BitsToFloat(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+Half HalfFloat::FromFloat(float value) {
+    // Round-to-nearest-even conversion, handles denormals, infinities and NaN.
+    // NaN keeps the top of its payload and comes out quiet, as with F16C.
+    const uint32_t f32Infinity = 255u << 23;
+    const uint32_t f16Max = (127u + 16u) << 23;
+    const uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t f = FloatBits(value);
+    uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+
+    uint16_t out;
+    if (f >= f16Max) {
+        out = (f > f32Infinity) ? static_cast<uint16_t>(0x7E00 | ((f >> 13) & 0x3FF)) : 0x7C00;
+    } else if (f < (113u << 23)) {
+        out = static_cast<uint16_t>(FloatBits(BitsToFloat(f) + BitsToFloat(denormMagic)) - denormMagic);
+    } else {
+        uint32_t mantissaOdd = (f >> 13) & 1;
+        f += 0xC8000000u + 0xFFFu; // rebias exponent (15 - 127) and round
+        f += mantissaOdd;
+        out = static_cast<uint16_t>(f >> 13);
+    }
+
+    Half half;
+    half.bits = static_cast<uint16_t>(out | (sign >> 16));
+    return half;
+}
+
+float HalfFloat::ToFloat(Half value) {
+    const uint32_t shiftedExponent = 0x7C00u << 13;
+
+    uint32_t out = (value.bits & 0x7FFFu) << 13;
+    uint32_t exponent = shiftedExponent & out;
+    out += (127u - 15u) << 23;
+
+    if (exponent == shiftedExponent) {
+        out += (128u - 16u) << 23; // Inf/NaN
+        if (value.bits & 0x3FFu) out |= 1u << 22; // NaN comes out quiet, as with F16C
+    } else if (exponent == 0) {
+        out += 1u << 23; // Denormal: renormalize
+        out = FloatBits(BitsToFloat(out) - BitsToFloat(113u << 23));
+    }
+
+    out |= static_cast<uint32_t>(value.bits & 0x8000u) << 16;
+    return BitsToFloat(out);
+}
+
+void HalfFloat::FromFloat(const float* src, Half* dst, size_t count) {
+    PixelOps::ConvertF32ToF16(dst, src, count);
+}
+
+void HalfFloat::ToFloat(const Half* src, float* dst, size_t count) {
+    PixelOps::ConvertF16ToF32(dst, src, count);
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Storage formats for pixel buffers. All formats hold straight (non-premultiplied) RGBA.
+enum class PixelFormat {
+    RGBA8,   // 8-bit unsigned normalized
+    RGBA16,  // 16-bit unsigned normalized
+    RGBA16F, // IEEE half float
+    RGBA32F  // IEEE single float
+};
+
+// IEEE 754 binary16 storage type
+struct Half {
+    uint16_t bits = 0;
+};
+
+class HalfFloat {
+public:
+    static Half FromFloat(float value);
+    static float ToFloat(Half value);
+
+    // Bulk conversions (F16C when the CPU supports it, see PixelOps)
+    static void FromFloat(const float* src, Half* dst, size_t count);
+    static void ToFloat(const Half* src, float* dst, size_t count);
+};
+
+// Compile-time description of a pixel format
+template<PixelFormat Format>
+struct PixelFormatTraits;
+
+template<>
+struct PixelFormatTraits<PixelFormat::RGBA8> {
+    using Channel = uint8_t;
+    static constexpr PixelFormat FORMAT = PixelFormat::RGBA8;
+    static constexpr uint32_t CHANNELS = 4;
+    static constexpr uint32_t BITS_PER_CHANNEL = 8;
+    static constexpr size_t BYTES_PER_PIXEL = sizeof(Channel) * CHANNELS;
+    static constexpr bool IS_FLOAT = false;
+    static constexpr bool PREMULTIPLIED = false;
+
+    static float ToFloat(Channel c) { return c * (1.0f / 255.0f); }
+    static Channel FromFloat(float v) {
+        v = v * 255.0f + 0.5f;
+        return static_cast<Channel>(v <= 0.0f ? 0.0f : (v >= 255.0f ? 255.0f : v));
+    }
+};
+
+template<>
+struct PixelFormatTraits<PixelFormat::RGBA16> {
+    using Channel = uint16_t;
+    static constexpr PixelFormat FORMAT = PixelFormat::RGBA16;
+    static constexpr uint32_t CHANNELS = 4;
+    static constexpr uint32_t BITS_PER_CHANNEL = 16;
+    static constexpr size_t BYTES_PER_PIXEL = sizeof(Channel) * CHANNELS;
+    static constexpr bool IS_FLOAT = false;
+    static constexpr bool PREMULTIPLIED = false;
+
+    static float ToFloat(Channel c) { return c * (1.0f / 65535.0f); }
+    static Channel FromFloat(float v) {
+        v = v * 65535.0f + 0.5f;
+        return static_cast<Channel>(v <= 0.0f ? 0.0f : (v >= 65535.0f ? 65535.0f : v));
+    }
+};
+
+template<>
+struct PixelFormatTraits<PixelFormat::RGBA16F> {
+    using Channel = Half;
+    static constexpr PixelFormat FORMAT = PixelFormat::RGBA16F;
+    static constexpr uint32_t CHANNELS = 4;
+    static constexpr uint32_t BITS_PER_CHANNEL = 16;
+    static constexpr size_t BYTES_PER_PIXEL = sizeof(Channel) * CHANNELS;
+    static constexpr bool IS_FLOAT = true;
+    static constexpr bool PREMULTIPLIED = false;
+
+    static float ToFloat(Channel c) { return HalfFloat::ToFloat(c); }
+    static Channel FromFloat(float v) { return HalfFloat::FromFloat(v); }
+};
+
+template<>
+struct PixelFormatTraits<PixelFormat::RGBA32F> {
+    using Channel = float;
+    static constexpr PixelFormat FORMAT = PixelFormat::RGBA32F;
+    static constexpr uint32_t CHANNELS = 4;
+    static constexpr uint32_t BITS_PER_CHANNEL = 32;
+    static constexpr size_t BYTES_PER_PIXEL = sizeof(Channel) * CHANNELS;
+    static constexpr bool IS_FLOAT = true;
+    static constexpr bool PREMULTIPLIED = false;
+
+    static float ToFloat(Channel c) { return c; }
+    static Channel FromFloat(float v) { return v; }
+};
+
+// Calls fn(PixelFormatTraits<format>{}) so runtime formats reach templated code
+template<typename Fn>
+decltype(auto) DispatchPixelFormat(PixelFormat format, Fn&& fn) {
+    switch (format) {
+        case PixelFormat::RGBA16:  return fn(PixelFormatTraits<PixelFormat::RGBA16>{});
+        case PixelFormat::RGBA16F: return fn(PixelFormatTraits<PixelFormat::RGBA16F>{});
+        case PixelFormat::RGBA32F: return fn(PixelFormatTraits<PixelFormat::RGBA32F>{});
+        case PixelFormat::RGBA8:
+        default:                   return fn(PixelFormatTraits<PixelFormat::RGBA8>{});
+    }
+}
+
+inline size_t BytesPerPixel(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::RGBA16:
+        case PixelFormat::RGBA16F: return 8;
+        case PixelFormat::RGBA32F: return 16;
+        case PixelFormat::RGBA8:
+        default:                   return 4;
+    }
+}
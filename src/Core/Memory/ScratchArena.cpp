@@ -0,0 +1,120 @@
+#include "ScratchArena.h"
+#include "BufferAllocator.h"
+#include <algorithm>
+#include <atomic>
+
+static std::atomic<size_t> totalReserved{0};
+
+static uint8_t* AlignUp(uint8_t* ptr, size_t alignment) {
+    uintptr_t value = reinterpret_cast<uintptr_t>(ptr);
+    return reinterpret_cast<uint8_t*>((value + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1));
+}
+
+ScratchArena& ScratchArena::ForThread() {
+    static thread_local ScratchArena arena;
+    return arena;
+}
+
+ScratchArena::~ScratchArena() {
+    for (const Chunk& chunk : chunks_) {
+        BufferAllocator::Free(chunk.data, chunk.size);
+    }
+    totalReserved.fetch_sub(reserved_, std::memory_order_relaxed);
+}
+
+void* ScratchArena::Allocate(size_t size, size_t alignment) {
+    if (current_ < chunks_.size()) {
+        Chunk& chunk = chunks_[current_];
+        uint8_t* ptr = AlignUp(chunk.data + offset_, alignment);
+        if (ptr + size <= chunk.data + chunk.size) {
+            offset_ = static_cast<size_t>(ptr - chunk.data) + size;
+            peak_ = std::max(peak_, passed_ + offset_);
+            return ptr;
+        }
+    }
+    return AllocateSlow(size, alignment);
+}
+
+void* ScratchArena::AllocateSlow(size_t size, size_t alignment) {
+    size_t needed = size + alignment;
+
+    // Move on to the next chunk, dropping kept chunks that are too small
+    size_t next = chunks_.empty() ? 0 : current_ + 1;
+    while (next < chunks_.size() && chunks_[next].size < needed) {
+        BufferAllocator::Free(chunks_[next].data, chunks_[next].size);
+        reserved_ -= chunks_[next].size;
+        totalReserved.fetch_sub(chunks_[next].size, std::memory_order_relaxed);
+        chunks_.erase(chunks_.begin() + next);
+    }
+    if (next == chunks_.size()) {
+        Chunk chunk;
+        chunk.size = BufferAllocator::SizeClass(std::max(CHUNK_SIZE, needed));
+        chunk.data = static_cast<uint8_t*>(BufferAllocator::Allocate(chunk.size));
+        chunks_.push_back(chunk);
+        reserved_ += chunk.size;
+        totalReserved.fetch_add(chunk.size, std::memory_order_relaxed);
+    }
+    if (next != current_) {
+        passed_ += chunks_[current_].size;
+        current_ = next;
+    }
+
+    Chunk& chunk = chunks_[current_];
+    uint8_t* ptr = AlignUp(chunk.data, alignment);
+    offset_ = static_cast<size_t>(ptr - chunk.data) + size;
+    peak_ = std::max(peak_, passed_ + offset_);
+    return ptr;
+}
+
+BufferManager::BufferView ScratchArena::AllocateView(uint32_t width, uint32_t height, PixelFormat format) {
+    size_t stride = BufferManager::AlignedStride(width, format);
+    uint8_t* data = static_cast<uint8_t*>(Allocate(stride * height, BufferManager::ROW_ALIGNMENT));
+    return BufferManager::BufferView(data, width, height, stride, format);
+}
+
+void ScratchArena::Rewind(const Marker& marker) {
+    current_ = marker.chunk;
+    offset_ = marker.offset;
+    passed_ = 0;
+    for (size_t i = 0; i < current_ && i < chunks_.size(); i++) {
+        passed_ += chunks_[i].size;
+    }
+
+    // Outermost scope closed: keep a few chunks for the next operation
+    if (current_ == 0 && offset_ == 0) {
+        TrimUnused();
+    }
+}
+
+void ScratchArena::TrimUnused() {
+    size_t kept = 0;
+    size_t count = 0;
+    while (count < chunks_.size() && kept + chunks_[count].size <= RETAIN_BYTES) {
+        kept += chunks_[count++].size;
+    }
+    for (size_t i = count; i < chunks_.size(); i++) {
+        BufferAllocator::Free(chunks_[i].data, chunks_[i].size);
+    }
+    chunks_.resize(count);
+    totalReserved.fetch_sub(reserved_ - kept, std::memory_order_relaxed);
+    reserved_ = kept;
+}
+
+void ScratchArena::Release() {
+    if (GetUsedBytes() != 0) return;
+
+    for (const Chunk& chunk : chunks_) {
+        BufferAllocator::Free(chunk.data, chunk.size);
+    }
+    chunks_.clear();
+    totalReserved.fetch_sub(reserved_, std::memory_order_relaxed);
+    reserved_ = 0;
+}
+
+size_t ScratchArena::GetUsedBytes() const {
+    return passed_ + offset_;
+}
+
+size_t ScratchArena::GetTotalReservedBytes() {
+    return totalReserved.load(std::memory_order_relaxed);
+}
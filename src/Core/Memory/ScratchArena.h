@@ -0,0 +1,106 @@
+#pragma once
+#include "BufferManager.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <type_traits>
+
+// Bump-pointer arena for per-operation temporaries (row buffers, kernel
+// tables, halos). Each thread has its own arena, so allocation is a pointer
+// bump with no locking. Memory is not freed piecemeal: a ScratchScope rewinds
+// the arena to where it was when the scope opened, releasing everything the
+// operation took in one step. Scopes nest.
+//
+// Chunks come from BufferAllocator; whatever is left over after the
+// outermost scope closes is kept up to RETAIN_BYTES for the next operation.
+class ScratchArena {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+    // Above BufferAllocator's thread-cache sizes, so chunks never touch a
+    // thread cache that may already be gone when this thread exits
+    static constexpr size_t CHUNK_SIZE = 2 * 1024 * 1024;
+    static constexpr size_t RETAIN_BYTES = 8 * 1024 * 1024;
+
+    struct Marker {
+        size_t chunk = 0;
+        size_t offset = 0;
+    };
+
+    // The calling thread's arena
+    static ScratchArena& ForThread();
+
+    ~ScratchArena();
+
+    // Uninitialized memory, valid until the enclosing scope closes
+    void* Allocate(size_t size, size_t alignment = ALIGNMENT);
+
+    template<typename T>
+    T* AllocateArray(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "scratch memory is never destructed");
+        return static_cast<T*>(Allocate(count * sizeof(T), alignof(T) > ALIGNMENT ? alignof(T) : ALIGNMENT));
+    }
+
+    // Pixel rows with the same alignment and stride as BufferManager buffers
+    BufferManager::BufferView AllocateView(uint32_t width, uint32_t height, PixelFormat format = PixelFormat::RGBA8);
+
+    Marker GetMarker() const { return {current_, offset_}; }
+    void Rewind(const Marker& marker);
+
+    // Return every chunk to the allocator (only while no scope is open)
+    void Release();
+
+    // Statistics for this thread's arena
+    size_t GetUsedBytes() const;
+    size_t GetReservedBytes() const { return reserved_; }
+    size_t GetPeakBytes() const { return peak_; }
+    void ResetPeak() { peak_ = GetUsedBytes(); }
+
+    // Chunk bytes held by the arenas of all threads
+    static size_t GetTotalReservedBytes();
+
+private:
+    ScratchArena() = default;
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    struct Chunk {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    void* AllocateSlow(size_t size, size_t alignment);
+    void TrimUnused();
+
+    std::vector<Chunk> chunks_;
+    size_t current_ = 0; // chunk being bumped
+    size_t offset_ = 0;  // next free byte in that chunk
+    size_t passed_ = 0;  // bytes of the chunks before current_
+    size_t reserved_ = 0;
+    size_t peak_ = 0;
+};
+
+// Opens an allocation scope on the calling thread's arena; everything
+// allocated through it (or the arena) while it is open is released when it
+// closes
+class ScratchScope {
+public:
+    ScratchScope() : arena_(ScratchArena::ForThread()), marker_(arena_.GetMarker()) {}
+    ~ScratchScope() { arena_.Rewind(marker_); }
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope& operator=(const ScratchScope&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = ScratchArena::ALIGNMENT) { return arena_.Allocate(size, alignment); }
+
+    template<typename T>
+    T* AllocateArray(size_t count) { return arena_.AllocateArray<T>(count); }
+
+    BufferManager::BufferView AllocateView(uint32_t width, uint32_t height, PixelFormat format = PixelFormat::RGBA8) {
+        return arena_.AllocateView(width, height, format);
+    }
+
+    ScratchArena& GetArena() { return arena_; }
+
+private:
+    ScratchArena& arena_;
+    ScratchArena::Marker marker_;
+};
@@ -1,10 +1,15 @@
 #include "TileCache.h"
 #include <algorithm>
+#include <vector>
 
 TileCache::TileCache(size_t maxTiles) : maxTiles_(maxTiles) {
+    governorId_ = MemoryGovernor::GetInstance().Register("Tile cache", MemoryGovernor::PRIORITY_TILE_CACHE,
+        [this] { return GetMemoryUsage(); },
+        [this](size_t bytes) { return Reclaim(bytes); });
 }
 
 TileCache::~TileCache() {
+    MemoryGovernor::GetInstance().Unregister(governorId_);
     Clear();
 }
 
@@ -21,25 +26,42 @@ TileCache::Tile* TileCache::GetTile(uint32_t layerId, uint32_t tileX, uint32_t t
 }
 
 TileCache::Tile* TileCache::GetOrCreateTile(uint32_t layerId, uint32_t tileX, uint32_t tileY) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        TileKey key{tileX, tileY, layerId};
+        auto it = tiles_.find(key);
+
+        if (it != tiles_.end()) {
+            it->second.lastAccess = ++accessCounter_;
+            return &it->second;
+        }
+
+        // Create new tile
+        if (tiles_.size() >= maxTiles_) {
+            EvictLRU();
+        }
+    }
+
+    // Make room under the global budget before allocating (reclaim may
+    // call back into this cache, so the lock must not be held)
+    MemoryGovernor::GetInstance().Check();
+
     std::lock_guard<std::mutex> lock(mutex_);
-    
+
+    // Another thread may have created the tile meanwhile
     TileKey key{tileX, tileY, layerId};
     auto it = tiles_.find(key);
-    
     if (it != tiles_.end()) {
         it->second.lastAccess = ++accessCounter_;
         return &it->second;
     }
-    
-    // Create new tile
-    if (tiles_.size() >= maxTiles_) {
-        EvictLRU();
-    }
-    
+
     Tile tile;
     tile.buffer = BufferManager::Create(TILE_SIZE, TILE_SIZE);
     tile.lastAccess = ++accessCounter_;
-    
+    bytes_ += tile.buffer.size;
+
     auto result = tiles_.emplace(key, std::move(tile));
     return &result.first->second;
 }
@@ -60,6 +82,7 @@ void TileCache::ClearLayer(uint32_t layerId) {
     auto it = tiles_.begin();
     while (it != tiles_.end()) {
         if (it->first.layerId == layerId) {
+            bytes_ -= it->second.buffer.size;
             BufferManager::Destroy(it->second.buffer);
             it = tiles_.erase(it);
         } else {
@@ -75,6 +98,7 @@ void TileCache::Clear() {
         BufferManager::Destroy(pair.second.buffer);
     }
     tiles_.clear();
+    bytes_ = 0;
 }
 
 size_t TileCache::GetTileCount() const {
@@ -82,6 +106,34 @@ size_t TileCache::GetTileCount() const {
     return tiles_.size();
 }
 
+size_t TileCache::GetMemoryUsage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+size_t TileCache::Reclaim(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::pair<uint64_t, TileKey>> order;
+    order.reserve(tiles_.size());
+    for (const auto& pair : tiles_) {
+        order.emplace_back(pair.second.lastAccess, pair.first);
+    }
+    std::sort(order.begin(), order.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    size_t freed = 0;
+    for (const auto& entry : order) {
+        if (freed >= bytes) break;
+        auto it = tiles_.find(entry.second);
+        freed += it->second.buffer.size;
+        bytes_ -= it->second.buffer.size;
+        BufferManager::Destroy(it->second.buffer);
+        tiles_.erase(it);
+    }
+    return freed;
+}
+
 void TileCache::EvictLRU() {
     if (tiles_.empty()) return;
     
@@ -92,6 +144,7 @@ void TileCache::EvictLRU() {
         }
     }
     
+    bytes_ -= oldest->second.buffer.size;
     BufferManager::Destroy(oldest->second.buffer);
     tiles_.erase(oldest);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "BufferManager.h"
+#include "MemoryGovernor.h"
 #include <cstdint>
 #include <unordered_map>
 #include <mutex>
@@ -39,6 +40,10 @@ public:
     size_t GetTileCount() const;
     size_t GetMaxTiles() const { return maxTiles_; }
 
+    // Memory governor hooks: bytes held, and LRU eviction of at least bytes
+    size_t GetMemoryUsage() const;
+    size_t Reclaim(size_t bytes);
+
 private:
     struct TileKeyHash {
         size_t operator()(const TileKey& key) const {
@@ -54,5 +59,7 @@ private:
     size_t maxTiles_;
     mutable std::mutex mutex_;
     uint64_t accessCounter_ = 0;
+    size_t bytes_ = 0; // pixel bytes of all tiles
+    MemoryGovernor::ConsumerId governorId_ = 0;
 };
 
@@ -0,0 +1,369 @@
+#include "TiledImage.h"
+#include "ScratchArena.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+uint64_t TiledImage::NextGeneration() {
+    static std::atomic<uint64_t> next{EMPTY_GENERATION + 1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+TiledImage::TiledImage(uint32_t width, uint32_t height, PixelFormat format, BufferManager::Storage storage)
+    : width_(width), height_(height),
+      tilesX_((width + TILE_SIZE - 1) / TILE_SIZE),
+      tilesY_((height + TILE_SIZE - 1) / TILE_SIZE),
+      format_(format), storage_(storage) {
+    // Every tile starts Empty; buffers are allocated on first write
+    tiles_.resize(static_cast<size_t>(tilesX_) * tilesY_);
+}
+
+uint32_t TiledImage::TileWidth(uint32_t tileX) const {
+    return std::min(TILE_SIZE, width_ - tileX * TILE_SIZE);
+}
+
+uint32_t TiledImage::TileHeight(uint32_t tileY) const {
+    return std::min(TILE_SIZE, height_ - tileY * TILE_SIZE);
+}
+
+TiledImage::TileKind TiledImage::GetTileKind(uint32_t tileX, uint32_t tileY) const {
+    const auto& tile = tiles_[TileIndex(tileX, tileY)];
+    if (!tile) return TileKind::Empty;
+    return tile->buffer.data ? TileKind::Pixels : TileKind::Uniform;
+}
+
+const BufferManager::Buffer* TiledImage::GetTile(uint32_t tileX, uint32_t tileY) const {
+    const auto& tile = tiles_[TileIndex(tileX, tileY)];
+    return tile && tile->buffer.data ? &tile->buffer : nullptr;
+}
+
+const uint8_t* TiledImage::GetTileValue(uint32_t tileX, uint32_t tileY) const {
+    const auto& tile = tiles_[TileIndex(tileX, tileY)];
+    return tile && !tile->buffer.data ? tile->value : nullptr;
+}
+
+BufferManager::Buffer& TiledImage::GetTileForWrite(uint32_t tileX, uint32_t tileY) {
+    return Detach(tileX, tileY, true);
+}
+
+bool TiledImage::IsTileShared(uint32_t tileX, uint32_t tileY) const {
+    return tiles_[TileIndex(tileX, tileY)].use_count() > 1;
+}
+
+uint64_t TiledImage::GetTileGeneration(uint32_t tileX, uint32_t tileY) const {
+    const auto& tile = tiles_[TileIndex(tileX, tileY)];
+    return tile ? tile->generation : EMPTY_GENERATION;
+}
+
+static TiledImage::Coverage ClassifyAlpha(const BufferManager::ConstBufferView& view) {
+    return DispatchPixelFormat(view.format, [&](auto traits) {
+        using Traits = decltype(traits);
+        using Channel = typename Traits::Channel;
+        bool visible = false;
+        bool opaque = true;
+        for (uint32_t y = 0; y < view.height; y++) {
+            const Channel* pixel = reinterpret_cast<const Channel*>(view.Row(y));
+            for (uint32_t x = 0; x < view.width; x++) {
+                float alpha = Traits::ToFloat(pixel[x * 4 + 3]);
+                visible |= alpha > 0.0f;
+                opaque &= alpha >= 1.0f;
+            }
+            if (visible && !opaque) return TiledImage::Coverage::Mixed;
+        }
+        return opaque ? TiledImage::Coverage::Opaque :
+               visible ? TiledImage::Coverage::Mixed : TiledImage::Coverage::Transparent;
+    });
+}
+
+TiledImage::Coverage TiledImage::GetTileCoverage(uint32_t tileX, uint32_t tileY) const {
+    const auto& tile = tiles_[TileIndex(tileX, tileY)];
+    if (!tile) return Coverage::Transparent;
+
+    // Racing threads compute the same value
+    uint8_t known = tile->coverage.load(std::memory_order_relaxed);
+    if (known != COVERAGE_UNKNOWN) return static_cast<Coverage>(known);
+
+    Coverage coverage = tile->buffer.data ?
+        ClassifyAlpha(BufferManager::GetView(tile->buffer)) :
+        ClassifyAlpha(BufferManager::ConstBufferView(tile->value, 1, 1, MAX_PIXEL_BYTES, format_));
+    tile->coverage.store(static_cast<uint8_t>(coverage), std::memory_order_relaxed);
+    return coverage;
+}
+
+Rect TiledImage::GetOccupiedBounds() const {
+    Rect bounds;
+    for (uint32_t ty = 0; ty < tilesY_; ty++) {
+        for (uint32_t tx = 0; tx < tilesX_; tx++) {
+            if (tiles_[TileIndex(tx, ty)]) {
+                bounds = bounds.Union(Rect(static_cast<int>(tx * TILE_SIZE), static_cast<int>(ty * TILE_SIZE),
+                                           static_cast<int>(TileWidth(tx)), static_cast<int>(TileHeight(ty))));
+            }
+        }
+    }
+    return bounds;
+}
+
+// Fills a view with one pixel value
+static void FillView(const BufferManager::BufferView& view, const uint8_t* pixel) {
+    for (uint32_t x = 0; x < view.width; x++) {
+        std::memcpy(view.Row(0) + x * view.bytesPerPixel, pixel, view.bytesPerPixel);
+    }
+    for (uint32_t y = 1; y < view.height; y++) {
+        std::memcpy(view.Row(y), view.Row(0), static_cast<size_t>(view.width) * view.bytesPerPixel);
+    }
+}
+
+// Pixel contents of an Empty (null) or Uniform tile
+static void FillView(const BufferManager::BufferView& view, const uint8_t* value, bool empty) {
+    if (empty) {
+        for (uint32_t y = 0; y < view.height; y++) {
+            std::memset(view.Row(y), 0, static_cast<size_t>(view.width) * view.bytesPerPixel);
+        }
+    } else {
+        FillView(view, value);
+    }
+}
+
+BufferManager::Buffer& TiledImage::Detach(uint32_t tileX, uint32_t tileY, bool preserveContents) {
+    auto& tile = tiles_[TileIndex(tileX, tileY)];
+    if (!tile || !tile->buffer.data) {
+        // Materialize an Empty or Uniform tile
+        auto pixels = std::make_shared<TileData>(TileWidth(tileX), TileHeight(tileY), format_, storage_);
+        if (preserveContents) {
+            FillView(BufferManager::GetView(pixels->buffer), tile ? tile->value : nullptr, !tile);
+        }
+        tile = std::move(pixels);
+    } else if (tile.use_count() > 1) {
+        auto copy = std::make_shared<TileData>(tile->buffer.width, tile->buffer.height, format_, storage_);
+        if (preserveContents) {
+            BufferManager::Copy(tile->buffer, copy->buffer);
+        }
+        tile = std::move(copy);
+    } else {
+        // Every caller is about to write
+        tile->generation = NextGeneration();
+        tile->coverage.store(COVERAGE_UNKNOWN, std::memory_order_relaxed);
+    }
+    return tile->buffer;
+}
+
+bool TiledImage::StoreSparse(uint32_t tileX, uint32_t tileY, const BufferManager::ConstBufferView& pixels) {
+    const uint8_t* first = pixels.Row(0);
+    size_t bytesPerPixel = pixels.bytesPerPixel;
+    size_t rowBytes = static_cast<size_t>(pixels.width) * bytesPerPixel;
+
+    // Uniform when row 0 repeats its first pixel and every row repeats row 0
+    for (size_t offset = bytesPerPixel; offset < rowBytes; offset += bytesPerPixel) {
+        if (std::memcmp(first + offset, first, bytesPerPixel) != 0) return false;
+    }
+    for (uint32_t y = 1; y < pixels.height; y++) {
+        if (std::memcmp(pixels.Row(y), first, rowBytes) != 0) return false;
+    }
+
+    bool transparent = std::all_of(first, first + bytesPerPixel, [](uint8_t b) { return b == 0; });
+    auto& tile = tiles_[TileIndex(tileX, tileY)];
+    if (transparent) {
+        tile.reset();
+    } else if (!tile || tile->buffer.data || std::memcmp(tile->value, first, bytesPerPixel) != 0) {
+        tile = std::make_shared<TileData>(first, bytesPerPixel);
+    }
+    return true;
+}
+
+void TiledImage::Read(int x, int y, const BufferManager::BufferView& dst) const {
+    if (dst.IsEmpty() || tiles_.empty()) return;
+
+    // Destination pixels outside the image are left untouched
+    int x0 = std::max(x, 0);
+    int y0 = std::max(y, 0);
+    int x1 = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(x) + dst.width, width_));
+    int y1 = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(y) + dst.height, height_));
+    if (x1 <= x0 || y1 <= y0) return;
+
+    for (uint32_t ty = y0 / TILE_SIZE; ty <= (y1 - 1) / TILE_SIZE; ty++) {
+        for (uint32_t tx = x0 / TILE_SIZE; tx <= (x1 - 1) / TILE_SIZE; tx++) {
+            int tileX0 = static_cast<int>(tx * TILE_SIZE);
+            int tileY0 = static_cast<int>(ty * TILE_SIZE);
+            int cx0 = std::max(x0, tileX0);
+            int cy0 = std::max(y0, tileY0);
+            int cx1 = std::min(x1, tileX0 + static_cast<int>(TILE_SIZE));
+            int cy1 = std::min(y1, tileY0 + static_cast<int>(TILE_SIZE));
+
+            BufferManager::BufferView to = BufferManager::GetSubView(dst, cx0 - x, cy0 - y, cx1 - cx0, cy1 - cy0);
+            const BufferManager::Buffer* tile = GetTile(tx, ty);
+            if (tile) {
+                BufferManager::Copy(BufferManager::GetView(*tile, cx0 - tileX0, cy0 - tileY0, cx1 - cx0, cy1 - cy0), to);
+            } else {
+                FillView(to, GetTileValue(tx, ty), GetTileKind(tx, ty) == TileKind::Empty);
+            }
+        }
+    }
+}
+
+void TiledImage::Write(int x, int y, const BufferManager::ConstBufferView& src) {
+    if (src.IsEmpty() || tiles_.empty()) return;
+
+    int x0 = std::max(x, 0);
+    int y0 = std::max(y, 0);
+    int x1 = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(x) + src.width, width_));
+    int y1 = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(y) + src.height, height_));
+    if (x1 <= x0 || y1 <= y0) return;
+
+    for (uint32_t ty = y0 / TILE_SIZE; ty <= (y1 - 1) / TILE_SIZE; ty++) {
+        for (uint32_t tx = x0 / TILE_SIZE; tx <= (x1 - 1) / TILE_SIZE; tx++) {
+            int tileX0 = static_cast<int>(tx * TILE_SIZE);
+            int tileY0 = static_cast<int>(ty * TILE_SIZE);
+            int cx0 = std::max(x0, tileX0);
+            int cy0 = std::max(y0, tileY0);
+            int cx1 = std::min(x1, tileX0 + static_cast<int>(TileWidth(tx)));
+            int cy1 = std::min(y1, tileY0 + static_cast<int>(TileHeight(ty)));
+
+            // A fully overwritten tile does not need its old contents copied
+            bool covers = cx0 == tileX0 && cy0 == tileY0 &&
+                          cx1 - cx0 == static_cast<int>(TileWidth(tx)) &&
+                          cy1 - cy0 == static_cast<int>(TileHeight(ty));
+            BufferManager::Buffer& tile = Detach(tx, ty, !covers);
+
+            BufferManager::ConstBufferView from(src.Pixel(cx0 - x, cy0 - y), cx1 - cx0, cy1 - cy0, src.stride, src.format);
+            BufferManager::Copy(from, BufferManager::GetView(tile, cx0 - tileX0, cy0 - tileY0, cx1 - cx0, cy1 - cy0));
+        }
+    }
+}
+
+void TiledImage::Clear(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    if (tiles_.empty()) return;
+
+    // One Uniform tile shared by the whole grid (or no tiles at all)
+    uint8_t pixel[MAX_PIXEL_BYTES] = {};
+    BufferManager::Clear(BufferManager::BufferView(pixel, 1, 1, sizeof(pixel), format_), r, g, b, a);
+    size_t bytesPerPixel = BytesPerPixel(format_);
+    bool transparent = std::all_of(pixel, pixel + bytesPerPixel, [](uint8_t v) { return v == 0; });
+
+    std::shared_ptr<TileData> uniform = transparent ? nullptr : std::make_shared<TileData>(pixel, bytesPerPixel);
+    std::fill(tiles_.begin(), tiles_.end(), uniform);
+}
+
+BufferManager::Buffer TiledImage::Flatten() const {
+    BufferManager::Buffer result = BufferManager::Create(width_, height_, format_, storage_);
+    Read(0, 0, BufferManager::GetView(result));
+    return result;
+}
+
+TiledImage TiledImage::Convert(PixelFormat format, bool dither) const {
+    TiledImage result(width_, height_, format, storage_);
+    if (format == format_) {
+        result.tiles_ = tiles_;
+        return result;
+    }
+
+    size_t bytesPerPixel = BytesPerPixel(format);
+    for (uint32_t ty = 0; ty < tilesY_; ty++) {
+        for (uint32_t tx = 0; tx < tilesX_; tx++) {
+            const auto& tile = tiles_[TileIndex(tx, ty)];
+            if (!tile) continue;
+
+            if (tile->buffer.data) {
+                BufferManager::Buffer& to = result.Detach(tx, ty, false);
+                BufferManager::Convert(tile->buffer, to, dither);
+                // Pixels can collapse, e.g. faint alpha rounding to 0
+                result.StoreSparse(tx, ty, BufferManager::GetView(to));
+                continue;
+            }
+            uint8_t pixel[MAX_PIXEL_BYTES] = {};
+            BufferManager::Convert(BufferManager::ConstBufferView(tile->value, 1, 1, MAX_PIXEL_BYTES, format_),
+                                   BufferManager::BufferView(pixel, 1, 1, MAX_PIXEL_BYTES, format));
+            if (!std::all_of(pixel, pixel + bytesPerPixel, [](uint8_t v) { return v == 0; })) {
+                result.tiles_[TileIndex(tx, ty)] = std::make_shared<TileData>(pixel, bytesPerPixel);
+            }
+        }
+    }
+    return result;
+}
+
+void TiledImage::Advise(AccessHint hint) const {
+    for (const auto& tile : tiles_) {
+        if (tile) BufferManager::Advise(tile->buffer, hint);
+    }
+}
+
+void TiledImage::Assign(const BufferManager::Buffer& source) {
+    if (!source.data || source.width != width_ || source.height != height_ || source.format != format_) return;
+    Assign(0, 0, BufferManager::GetView(source));
+}
+
+void TiledImage::Assign(int x, int y, const BufferManager::ConstBufferView& source) {
+    if (source.IsEmpty() || source.format != format_ || tiles_.empty()) return;
+
+    int x0 = std::max(x, 0);
+    int y0 = std::max(y, 0);
+    int x1 = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(x) + source.width, width_));
+    int y1 = static_cast<int>(std::min<int64_t>(static_cast<int64_t>(y) + source.height, height_));
+    if (x1 <= x0 || y1 <= y0) return;
+
+    ScratchScope scratch;
+    BufferManager::BufferView current = scratch.AllocateView(TILE_SIZE, TILE_SIZE, format_);
+    for (uint32_t ty = y0 / TILE_SIZE; ty <= (y1 - 1) / TILE_SIZE; ty++) {
+        for (uint32_t tx = x0 / TILE_SIZE; tx <= (x1 - 1) / TILE_SIZE; tx++) {
+            int tileX0 = static_cast<int>(tx * TILE_SIZE);
+            int tileY0 = static_cast<int>(ty * TILE_SIZE);
+            int cx0 = std::max(x0, tileX0);
+            int cy0 = std::max(y0, tileY0);
+            int cx1 = std::min(x1, tileX0 + static_cast<int>(TileWidth(tx)));
+            int cy1 = std::min(y1, tileY0 + static_cast<int>(TileHeight(ty)));
+            uint32_t w = static_cast<uint32_t>(cx1 - cx0);
+            uint32_t h = static_cast<uint32_t>(cy1 - cy0);
+
+            BufferManager::ConstBufferView src(source.Pixel(cx0 - x, cy0 - y), w, h, source.stride, format_);
+            bool covers = w == TileWidth(tx) && h == TileHeight(ty);
+            if (covers && StoreSparse(tx, ty, src)) continue;
+
+            // Leave unchanged tiles alone so they stay shared (a sparse tile
+            // cannot equal pixels that failed StoreSparse)
+            bool changed = covers && GetTileKind(tx, ty) != TileKind::Pixels;
+            if (!changed) {
+                BufferManager::BufferView old = BufferManager::GetSubView(current, 0, 0, w, h);
+                Read(cx0, cy0, old);
+                size_t rowBytes = static_cast<size_t>(w) * old.bytesPerPixel;
+                for (uint32_t row = 0; row < h && !changed; row++) {
+                    changed = std::memcmp(src.Row(row), old.Row(row), rowBytes) != 0;
+                }
+            }
+
+            if (changed) {
+                BufferManager::Buffer& tile = Detach(tx, ty, !covers);
+                BufferManager::Copy(src, BufferManager::GetView(tile, cx0 - tileX0, cy0 - tileY0, w, h));
+            }
+        }
+    }
+}
+
+size_t TiledImage::GetPixelTileCount() const {
+    return std::count_if(tiles_.begin(), tiles_.end(),
+        [](const std::shared_ptr<TileData>& tile) { return tile && tile->buffer.data; });
+}
+
+size_t TiledImage::GetSharedTileCount() const {
+    return std::count_if(tiles_.begin(), tiles_.end(),
+        [](const std::shared_ptr<TileData>& tile) { return tile.use_count() > 1; });
+}
+
+size_t TiledImage::GetUniqueBytes() const {
+    size_t bytes = 0;
+    for (const auto& tile : tiles_) {
+        if (tile.use_count() == 1) {
+            bytes += tile->buffer.size;
+        }
+    }
+    return bytes;
+}
+
+size_t TiledImage::GetResidentBytes() const {
+    size_t bytes = 0;
+    for (const auto& tile : tiles_) {
+        // Mapped tiles are paged by the OS (falling back to heap is per tile)
+        if (tile && tile->buffer.storage == BufferManager::Storage::Heap) {
+            bytes += tile->buffer.size / static_cast<size_t>(tile.use_count());
+        }
+    }
+    return bytes;
+}
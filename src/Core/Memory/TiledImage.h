@@ -0,0 +1,142 @@
+#pragma once
+#include "BufferManager.h"
+#include "TileCache.h"
+#include "../Math/Rect.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <memory>
+
+// Tile-granular, copy-on-write, sparse pixel storage.
+// Copying a TiledImage shares every tile; a tile is duplicated only when it is
+// written to while another image still references it. Tiles that were never
+// written or are fully transparent (all bytes zero) hold no memory, and
+// single-color tiles hold one pixel; a buffer is allocated on first write.
+class TiledImage {
+public:
+    static constexpr uint32_t TILE_SIZE = TileCache::TILE_SIZE;
+
+    enum class TileKind {
+        Empty,   // Transparent, no storage
+        Uniform, // Every pixel equals GetTileValue
+        Pixels   // Backed by a buffer (GetTile)
+    };
+
+    // Alpha of a whole tile
+    enum class Coverage {
+        Transparent, // Every alpha is 0 (always so for Empty tiles)
+        Opaque,      // Every alpha is 1
+        Mixed
+    };
+
+    TiledImage() = default;
+    TiledImage(uint32_t width, uint32_t height, PixelFormat format = PixelFormat::RGBA8,
+               BufferManager::Storage storage = BufferManager::Storage::Heap);
+
+    uint32_t GetWidth() const { return width_; }
+    uint32_t GetHeight() const { return height_; }
+    uint32_t GetTilesX() const { return tilesX_; }
+    uint32_t GetTilesY() const { return tilesY_; }
+    PixelFormat GetFormat() const { return format_; }
+    BufferManager::Storage GetStorage() const { return storage_; }
+    bool IsEmpty() const { return tiles_.empty(); }
+
+    // Tile access. GetTile returns the buffer of a Pixels tile (null for the
+    // other kinds) and may share it with other images; GetTileForWrite
+    // materializes and detaches it first.
+    TileKind GetTileKind(uint32_t tileX, uint32_t tileY) const;
+    const BufferManager::Buffer* GetTile(uint32_t tileX, uint32_t tileY) const;
+    const uint8_t* GetTileValue(uint32_t tileX, uint32_t tileY) const; // Uniform tiles only
+    BufferManager::Buffer& GetTileForWrite(uint32_t tileX, uint32_t tileY);
+    bool IsTileShared(uint32_t tileX, uint32_t tileY) const;
+
+    // Version stamp of a tile's pixels, unique across all images. Every write
+    // path (including GetTileForWrite, so call it again for each batch of
+    // writes) moves it on; tiles with equal generations hold equal pixels.
+    // Empty tiles are always EMPTY_GENERATION.
+    static constexpr uint64_t EMPTY_GENERATION = 0;
+    uint64_t GetTileGeneration(uint32_t tileX, uint32_t tileY) const;
+
+    // Alpha classification of a tile. Computed on first use after each write
+    // (same rule as generations) and kept with the tile; safe to call from
+    // several threads.
+    Coverage GetTileCoverage(uint32_t tileX, uint32_t tileY) const;
+
+    // Bounds of the tiles that are not Empty, in image coordinates
+    Rect GetOccupiedBounds() const;
+
+    // Region IO in image coordinates (clamped to the image)
+    void Read(int x, int y, const BufferManager::BufferView& dst) const;
+    void Write(int x, int y, const BufferManager::ConstBufferView& src);
+    void Clear(uint8_t r = 0, uint8_t g = 0, uint8_t b = 0, uint8_t a = 0);
+
+    // Contiguous copy of the whole image in the same storage (caller owns it)
+    BufferManager::Buffer Flatten() const;
+
+    // Copy in another format, tile by tile (as BufferManager::Convert, with
+    // dither applied to Pixels tiles only). Empty tiles stay Empty and
+    // Uniform ones Uniform; the same format shares every tile.
+    TiledImage Convert(PixelFormat format, bool dither = false) const;
+
+    // Paging hint for every tile
+    void Advise(AccessHint hint) const;
+
+    // Replace the contents with a same-sized buffer, or a region with a view.
+    // Tiles whose pixels did not change stay shared; fully covered tiles that
+    // come out transparent or single-color are stored sparsely.
+    void Assign(const BufferManager::Buffer& source);
+    void Assign(int x, int y, const BufferManager::ConstBufferView& source);
+
+    // Statistics
+    size_t GetTileCount() const { return tiles_.size(); }
+    size_t GetPixelTileCount() const;
+    size_t GetSharedTileCount() const;
+    size_t GetUniqueBytes() const;
+    // Heap bytes charged to this image; a shared tile is split between its
+    // owners. Tiles in the scratch file are not counted.
+    size_t GetResidentBytes() const;
+
+private:
+    // Largest pixel (RGBA32F)
+    static constexpr size_t MAX_PIXEL_BYTES = 16;
+    // TileData::coverage before the tile has been classified
+    static constexpr uint8_t COVERAGE_UNKNOWN = 0xFF;
+
+    // A Pixels tile owns a buffer; a Uniform tile has only value. Empty tiles
+    // are null pointers.
+    struct TileData {
+        BufferManager::Buffer buffer;
+        uint8_t value[MAX_PIXEL_BYTES] = {};
+        uint64_t generation;
+        mutable std::atomic<uint8_t> coverage{COVERAGE_UNKNOWN}; // Coverage, reset on write
+
+        TileData(uint32_t width, uint32_t height, PixelFormat format, BufferManager::Storage storage)
+            : buffer(BufferManager::Create(width, height, format, storage)), generation(NextGeneration()) {}
+        TileData(const uint8_t* pixel, size_t bytesPerPixel) : generation(NextGeneration()) {
+            std::memcpy(value, pixel, bytesPerPixel);
+        }
+        ~TileData() { BufferManager::Destroy(buffer); }
+        TileData(const TileData&) = delete;
+        TileData& operator=(const TileData&) = delete;
+    };
+
+    static uint64_t NextGeneration();
+
+    size_t TileIndex(uint32_t tileX, uint32_t tileY) const { return static_cast<size_t>(tileY) * tilesX_ + tileX; }
+    uint32_t TileWidth(uint32_t tileX) const;
+    uint32_t TileHeight(uint32_t tileY) const;
+    BufferManager::Buffer& Detach(uint32_t tileX, uint32_t tileY, bool preserveContents);
+    // Stores a tile's worth of pixels as an Empty or Uniform tile if they
+    // allow it (an identical sparse tile is left alone); false if they need
+    // a buffer
+    bool StoreSparse(uint32_t tileX, uint32_t tileY, const BufferManager::ConstBufferView& pixels);
+
+    std::vector<std::shared_ptr<TileData>> tiles_;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    uint32_t tilesX_ = 0;
+    uint32_t tilesY_ = 0;
+    PixelFormat format_ = PixelFormat::RGBA8;
+    BufferManager::Storage storage_ = BufferManager::Storage::Heap;
+};
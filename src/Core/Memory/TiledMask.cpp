@@ -0,0 +1,125 @@
+#include "TiledMask.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+// Generations of mixed tiles start past the single values (0-255)
+uint64_t TiledMask::NextGeneration() {
+    static std::atomic<uint64_t> next{256};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+TiledMask::TiledMask(uint32_t width, uint32_t height, uint8_t value)
+    : width_(width), height_(height),
+      tilesX_((width + TILE_SIZE - 1) / TILE_SIZE),
+      tilesY_((height + TILE_SIZE - 1) / TILE_SIZE) {
+    tiles_.resize(static_cast<size_t>(tilesX_) * tilesY_);
+    uniformValues_.assign(tiles_.size(), value);
+}
+
+uint32_t TiledMask::TileWidth(uint32_t tileX) const {
+    return std::min(TILE_SIZE, width_ - tileX * TILE_SIZE);
+}
+
+uint32_t TiledMask::TileHeight(uint32_t tileY) const {
+    return std::min(TILE_SIZE, height_ - tileY * TILE_SIZE);
+}
+
+const uint8_t* TiledMask::GetTile(uint32_t tileX, uint32_t tileY) const {
+    const auto& tile = tiles_[TileIndex(tileX, tileY)];
+    return tile ? tile->values.data() : nullptr;
+}
+
+uint64_t TiledMask::GetTileGeneration(uint32_t tileX, uint32_t tileY) const {
+    size_t index = TileIndex(tileX, tileY);
+    return tiles_[index] ? tiles_[index]->generation : uniformValues_[index];
+}
+
+uint8_t* TiledMask::Detach(uint32_t tileX, uint32_t tileY) {
+    size_t index = TileIndex(tileX, tileY);
+    auto& tile = tiles_[index];
+    if (!tile) {
+        tile = std::make_shared<TileData>();
+        tile->values.assign(static_cast<size_t>(TILE_SIZE) * TILE_SIZE, uniformValues_[index]);
+    } else if (tile.use_count() > 1) {
+        tile = std::make_shared<TileData>(TileData{tile->values, 0});
+    }
+    tile->generation = NextGeneration();
+    return tile->values.data();
+}
+
+void TiledMask::Collapse(uint32_t tileX, uint32_t tileY) {
+    size_t index = TileIndex(tileX, tileY);
+    const uint8_t* values = tiles_[index]->values.data();
+    uint32_t width = TileWidth(tileX);
+    for (uint32_t y = 0; y < TileHeight(tileY); y++) {
+        const uint8_t* row = values + static_cast<size_t>(y) * TILE_SIZE;
+        // Each row equals itself shifted by one and starts with the first value
+        if (row[0] != values[0] || std::memcmp(row, row + 1, width - 1) != 0) return;
+    }
+    uniformValues_[index] = values[0];
+    tiles_[index].reset();
+}
+
+void TiledMask::Read(int x, int y, uint32_t width, uint32_t height, uint8_t* dst, size_t stride) const {
+    Rect region = Rect(x, y, static_cast<int>(width), static_cast<int>(height))
+        .Intersect(Rect(0, 0, static_cast<int>(width_), static_cast<int>(height_)));
+    if (region.IsEmpty()) return;
+    dst += static_cast<size_t>(region.y - y) * stride + (region.x - x);
+
+    for (uint32_t ty = region.y / TILE_SIZE; ty <= (region.Bottom() - 1) / TILE_SIZE; ty++) {
+        for (uint32_t tx = region.x / TILE_SIZE; tx <= (region.Right() - 1) / TILE_SIZE; tx++) {
+            Rect tileRect(static_cast<int>(tx * TILE_SIZE), static_cast<int>(ty * TILE_SIZE),
+                          static_cast<int>(TileWidth(tx)), static_cast<int>(TileHeight(ty)));
+            Rect part = region.Intersect(tileRect);
+            const uint8_t* values = GetTile(tx, ty);
+            for (int row = part.y; row < part.Bottom(); row++) {
+                uint8_t* out = dst + static_cast<size_t>(row - region.y) * stride + (part.x - region.x);
+                if (values) {
+                    std::memcpy(out, values + static_cast<size_t>(row - tileRect.y) * TILE_SIZE + (part.x - tileRect.x),
+                                part.width);
+                } else {
+                    std::memset(out, GetTileValue(tx, ty), part.width);
+                }
+            }
+        }
+    }
+}
+
+void TiledMask::Write(int x, int y, uint32_t width, uint32_t height, const uint8_t* src, size_t stride) {
+    Rect region = Rect(x, y, static_cast<int>(width), static_cast<int>(height))
+        .Intersect(Rect(0, 0, static_cast<int>(width_), static_cast<int>(height_)));
+    if (region.IsEmpty()) return;
+    src += static_cast<size_t>(region.y - y) * stride + (region.x - x);
+
+    for (uint32_t ty = region.y / TILE_SIZE; ty <= (region.Bottom() - 1) / TILE_SIZE; ty++) {
+        for (uint32_t tx = region.x / TILE_SIZE; tx <= (region.Right() - 1) / TILE_SIZE; tx++) {
+            Rect tileRect(static_cast<int>(tx * TILE_SIZE), static_cast<int>(ty * TILE_SIZE),
+                          static_cast<int>(TileWidth(tx)), static_cast<int>(TileHeight(ty)));
+            Rect part = region.Intersect(tileRect);
+            uint8_t* values = Detach(tx, ty);
+            for (int row = part.y; row < part.Bottom(); row++) {
+                std::memcpy(values + static_cast<size_t>(row - tileRect.y) * TILE_SIZE + (part.x - tileRect.x),
+                            src + static_cast<size_t>(row - region.y) * stride + (part.x - region.x), part.width);
+            }
+            Collapse(tx, ty);
+        }
+    }
+}
+
+void TiledMask::Fill(uint8_t value) {
+    for (auto& tile : tiles_) {
+        tile.reset();
+    }
+    std::fill(uniformValues_.begin(), uniformValues_.end(), value);
+}
+
+size_t TiledMask::GetResidentBytes() const {
+    size_t bytes = 0;
+    for (const auto& tile : tiles_) {
+        if (tile) {
+            bytes += tile->values.size() / static_cast<size_t>(tile.use_count());
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "TiledImage.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Tile-granular, copy-on-write, sparse 8-bit coverage for layer masks
+// (255 shows the layer, 0 hides it), on the TiledImage tile grid. Tiles of a
+// single value, all white and all black in particular, hold no memory; a
+// tile gets values of its own when a write leaves it mixed, and goes back to
+// a single value when a write evens it out again.
+class TiledMask {
+public:
+    static constexpr uint32_t TILE_SIZE = TiledImage::TILE_SIZE;
+
+    TiledMask() = default;
+    TiledMask(uint32_t width, uint32_t height, uint8_t value = 255);
+
+    uint32_t GetWidth() const { return width_; }
+    uint32_t GetHeight() const { return height_; }
+    uint32_t GetTilesX() const { return tilesX_; }
+    uint32_t GetTilesY() const { return tilesY_; }
+    bool IsEmpty() const { return tiles_.empty(); }
+
+    // Values of a mixed tile, rows TILE_SIZE apart (may be shared with other
+    // masks), or null for a single-value tile
+    const uint8_t* GetTile(uint32_t tileX, uint32_t tileY) const;
+    // Value of a single-value tile
+    uint8_t GetTileValue(uint32_t tileX, uint32_t tileY) const { return uniformValues_[TileIndex(tileX, tileY)]; }
+
+    // Version stamp of a tile's values; tiles with equal generations hold
+    // equal values. A single-value tile's generation is its value, so
+    // rewriting a tile with what it already holds leaves it unchanged.
+    uint64_t GetTileGeneration(uint32_t tileX, uint32_t tileY) const;
+
+    // Region IO in mask coordinates (clamped to the mask)
+    void Read(int x, int y, uint32_t width, uint32_t height, uint8_t* dst, size_t stride) const;
+    void Write(int x, int y, uint32_t width, uint32_t height, const uint8_t* src, size_t stride);
+    void Fill(uint8_t value);
+
+    // Heap bytes charged to this mask; a shared tile is split between its
+    // owners
+    size_t GetResidentBytes() const;
+
+private:
+    struct TileData {
+        std::vector<uint8_t> values; // TILE_SIZE x TILE_SIZE
+        uint64_t generation;
+    };
+
+    static uint64_t NextGeneration();
+
+    size_t TileIndex(uint32_t tileX, uint32_t tileY) const { return static_cast<size_t>(tileY) * tilesX_ + tileX; }
+    uint32_t TileWidth(uint32_t tileX) const;
+    uint32_t TileHeight(uint32_t tileY) const;
+    // Unshares a tile (giving a single-value tile values of its own) and
+    // moves its generation on
+    uint8_t* Detach(uint32_t tileX, uint32_t tileY);
+    // Turns a mixed tile whose values are all equal back into a single value
+    void Collapse(uint32_t tileX, uint32_t tileY);
+
+    // Per tile: the values of a mixed tile, or null and uniformValues_
+    std::vector<std::shared_ptr<TileData>> tiles_;
+    std::vector<uint8_t> uniformValues_;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    uint32_t tilesX_ = 0;
+    uint32_t tilesY_ = 0;
+};
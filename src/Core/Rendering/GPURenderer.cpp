@@ -1,4 +1,5 @@
 #include "GPURenderer.h"
+#include "../Memory/ScratchArena.h"
 #include <d3dcompiler.h>
 #include <cstring>
 
@@ -298,13 +299,22 @@ void GPURenderer::UpdateTexture(const BufferManager::Buffer& buffer) {
         if (FAILED(hr)) return;
     }
 
+    // Higher bit depths are dithered down to the RGBA8 texture
+    ScratchScope scratch;
+    BufferManager::ConstBufferView upload = BufferManager::GetView(buffer);
+    if (buffer.format != PixelFormat::RGBA8) {
+        BufferManager::BufferView converted = scratch.AllocateView(buffer.width, buffer.height);
+        BufferManager::Convert(upload, converted, true);
+        upload = converted;
+    }
+
     // Update texture data
     context_->UpdateSubresource(
         texture_.Get(),
         0,
         nullptr,
-        buffer.data,
-        buffer.width * 4,
+        upload.data,
+        static_cast<UINT>(upload.stride),
         0);
 }
 
@@ -0,0 +1,124 @@
+#include "GaussianBlur.h"
+#include "../../Core/Memory/ScratchArena.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Columns per vertical pass: the rows of the kernel window stay in L2
+static constexpr uint32_t COLUMN_STRIP = 1024;
+
+GaussianBlur::GaussianBlur(float radius) : PlanarFilter("Gaussian Blur") {
+    SetRadius(radius);
+}
+
+// Normalized weights for offsets -half..half
+static float* BuildKernel(ScratchScope& scratch, float radius, int& half) {
+    half = std::max(1, static_cast<int>(std::ceil(radius * 3.0f)));
+    float* weights = scratch.AllocateArray<float>(2 * half + 1);
+    float sum = 0.0f;
+    for (int i = -half; i <= half; i++) {
+        float w = std::exp(-(i * i) / (2.0f * radius * radius));
+        weights[i + half] = w;
+        sum += w;
+    }
+    for (int i = 0; i <= 2 * half; i++) {
+        weights[i] /= sum;
+    }
+    return weights;
+}
+
+int GaussianBlur::GetFootprint() const {
+    return radius_ > 0.0f ? std::max(1, static_cast<int>(std::ceil(radius_ * 3.0f))) : 0;
+}
+
+void GaussianBlur::BlurPlane(float* plane, size_t stride, uint32_t width, uint32_t height, float radius) {
+    if (radius <= 0.0f || width == 0 || height == 0) return;
+
+    ScratchScope scratch;
+    int half;
+    const float* weights = BuildKernel(scratch, radius, half);
+    const int taps = 2 * half + 1;
+
+    // Horizontal: copy the row with clamped halos, then accumulate one tap at
+    // a time over the whole row so the inner loop vectorizes
+    float* padded = scratch.AllocateArray<float>(width + 2 * half);
+    for (uint32_t y = 0; y < height; y++) {
+        float* row = plane + y * stride;
+        std::fill(padded, padded + half, row[0]);
+        std::memcpy(padded + half, row, width * sizeof(float));
+        std::fill(padded + half + width, padded + 2 * half + width, row[width - 1]);
+
+        for (uint32_t x = 0; x < width; x++) {
+            row[x] = weights[0] * padded[x];
+        }
+        for (int k = 1; k < taps; k++) {
+            const float w = weights[k];
+            const float* src = padded + k;
+            for (uint32_t x = 0; x < width; x++) {
+                row[x] += w * src[x];
+            }
+        }
+    }
+
+    // Vertical: out row y sums rows y - half .. y + half (clamped), in column
+    // strips so the kernel window stays cache-resident. Source rows go into a
+    // ring of taps rows (row r in slot r % taps) before the output overwrites
+    // them; the clamped rows of one window are distinct mod taps.
+    const uint32_t stripColumns = std::min(COLUMN_STRIP, width);
+    float* ring = scratch.AllocateArray<float>(static_cast<size_t>(taps) * stripColumns);
+    const int lastRow = static_cast<int>(height) - 1;
+    for (uint32_t x0 = 0; x0 < width; x0 += COLUMN_STRIP) {
+        uint32_t columns = std::min(COLUMN_STRIP, width - x0);
+        auto load = [&](int row) {
+            std::memcpy(ring + (row % taps) * stripColumns, plane + row * stride + x0, columns * sizeof(float));
+        };
+        for (int row = 0; row < half && row <= lastRow; row++) {
+            load(row);
+        }
+        for (uint32_t y = 0; y < height; y++) {
+            int next = static_cast<int>(y) + half;
+            if (next <= lastRow) load(next);
+
+            float* out = plane + y * stride + x0;
+            for (int k = 0; k < taps; k++) {
+                int sy = std::clamp(static_cast<int>(y) + k - half, 0, lastRow);
+                const float w = weights[k];
+                const float* src = ring + (sy % taps) * stripColumns;
+                if (k == 0) {
+                    for (uint32_t x = 0; x < columns; x++) out[x] = w * src[x];
+                } else {
+                    for (uint32_t x = 0; x < columns; x++) out[x] += w * src[x];
+                }
+            }
+        }
+    }
+}
+
+bool GaussianBlur::ApplyPlanar(BufferManager::PlanarBuffer& planes) {
+    if (radius_ <= 0.0f) return true;
+
+    // Premultiply and unpremultiply the image rows only, not the stride padding
+    const uint32_t width = planes.width;
+    for (uint32_t y = 0; y < planes.height; y++) {
+        const float* alpha = planes.Plane(3) + y * planes.stride;
+        for (int c = 0; c < 3; c++) {
+            float* color = planes.Plane(c) + y * planes.stride;
+            for (uint32_t x = 0; x < width; x++) color[x] *= alpha[x];
+        }
+    }
+
+    for (int c = 0; c < 4; c++) {
+        BlurPlane(planes.Plane(c), planes.stride, planes.width, planes.height, radius_);
+    }
+
+    for (uint32_t y = 0; y < planes.height; y++) {
+        const float* alpha = planes.Plane(3) + y * planes.stride;
+        for (int c = 0; c < 3; c++) {
+            float* color = planes.Plane(c) + y * planes.stride;
+            for (uint32_t x = 0; x < width; x++) {
+                color[x] = alpha[x] > 0.0f ? color[x] / alpha[x] : 0.0f;
+            }
+        }
+    }
+    return true;
+}
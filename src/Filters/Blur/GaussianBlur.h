@@ -0,0 +1,22 @@
+#pragma once
+#include "../FilterBase.h"
+
+// Separable Gaussian blur. Runs on planar floats with premultiplied color so
+// transparent pixels do not bleed their color into the edges.
+class GaussianBlur : public PlanarFilter {
+public:
+    explicit GaussianBlur(float radius = 2.0f);
+
+    // Standard deviation in pixels; the kernel reaches 3 * radius each way
+    float GetRadius() const { return radius_; }
+    void SetRadius(float radius) { radius_ = radius < 0.0f ? 0.0f : radius; }
+
+    bool ApplyPlanar(BufferManager::PlanarBuffer& planes) override;
+    int GetFootprint() const override;
+
+    // Blur one plane in place (edges are clamped)
+    static void BlurPlane(float* plane, size_t stride, uint32_t width, uint32_t height, float radius);
+
+private:
+    float radius_;
+};
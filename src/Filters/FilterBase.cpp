@@ -10,6 +10,17 @@ BufferManager::Buffer FilterBase::ApplyCopy(const BufferManager::Buffer& source)
 }
 
 bool FilterBase::CanApply(const BufferManager::Buffer& buffer) const {
-    return buffer.data != nullptr && buffer.width > 0 && buffer.height > 0;
+    return buffer.data != nullptr && buffer.width > 0 && buffer.height > 0 &&
+           SupportsFormat(buffer.format);
 }
 
+bool PlanarFilter::Apply(BufferManager::Buffer& buffer) {
+    BufferManager::PlanarBuffer planes = BufferManager::CreatePlanar(buffer.width, buffer.height);
+    BufferManager::ToPlanar(BufferManager::GetView(buffer), planes);
+    bool applied = ApplyPlanar(planes);
+    if (applied) {
+        BufferManager::FromPlanar(planes, BufferManager::GetView(buffer));
+    }
+    BufferManager::Destroy(planes);
+    return applied;
+}
@@ -10,7 +10,8 @@ public:
 
     const std::string& GetName() const { return name_; }
 
-    // Apply filter to buffer (modifies buffer in-place)
+    // Apply filter to buffer (modifies buffer in-place). Temporaries (row
+    // buffers, kernel tables, halos) should come from a ScratchScope.
     virtual bool Apply(BufferManager::Buffer& buffer) = 0;
     
     // Apply filter creating new buffer (doesn't modify source)
@@ -19,7 +20,45 @@ public:
     // Check if filter can be applied
     virtual bool CanApply(const BufferManager::Buffer& buffer) const;
 
+    // Storage formats this filter can process
+    virtual bool SupportsFormat(PixelFormat format) const { return format == PixelFormat::RGBA8; }
+
+    // How far (in pixels) an output pixel reads around itself, for filters
+    // that leave transparent areas transparent; -1 means the filter must see
+    // the whole buffer. Lets callers skip the empty parts of sparse layers.
+    virtual int GetFootprint() const { return -1; }
+
 protected:
     std::string name_;
 };
 
+// Base for filters written once against PixelFormatTraits. Derived classes
+// implement: template<typename Traits> bool ApplyTyped(BufferManager::Buffer& buffer);
+template<typename Derived>
+class TypedFilter : public FilterBase {
+public:
+    using FilterBase::FilterBase;
+
+    bool Apply(BufferManager::Buffer& buffer) override {
+        return DispatchPixelFormat(buffer.format, [&](auto traits) {
+            return static_cast<Derived*>(this)->template ApplyTyped<decltype(traits)>(buffer);
+        });
+    }
+
+    bool SupportsFormat(PixelFormat) const override { return true; }
+};
+
+// Base for filters that work one channel at a time (convolutions). Apply
+// transposes the buffer to planar floats, runs ApplyPlanar and transposes
+// back; FilterEngine keeps the planes between consecutive planar filters so
+// the transpose is paid once per run of filters, not once per filter.
+class PlanarFilter : public FilterBase {
+public:
+    using FilterBase::FilterBase;
+
+    bool Apply(BufferManager::Buffer& buffer) override;
+    virtual bool ApplyPlanar(BufferManager::PlanarBuffer& planes) = 0;
+
+    bool SupportsFormat(PixelFormat) const override { return true; }
+};
+
@@ -1,7 +1,9 @@
 #define NOMINMAX
 #include "DXCanvas.h"
+#include "../../Core/Math/PixelOps.h"
 #include <d3dcompiler.h>
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 
 #pragma comment(lib, "d3d11.lib")
@@ -153,14 +155,8 @@ height_ = (UINT)(h > 0 ? h : 1);
 
 bool DXCanvas::InitCanvasBuffer(UINT w, UINT h) {
     width_ = w; height_ = h;
-    cpuBuffer_.assign(w * h * 4, 0);
-
-    for (UINT i = 0; i < w * h; i++) {
-        cpuBuffer_[4 * i + 0] = 40;
-        cpuBuffer_[4 * i + 1] = 40;
-        cpuBuffer_[4 * i + 2] = 40;
-        cpuBuffer_[4 * i + 3] = 255;
-    }
+    cpuBuffer_.resize(static_cast<size_t>(w) * h * 4);
+    PixelOps::Fill(cpuBuffer_.data(), static_cast<size_t>(w) * h, 40, 40, 40, 255);
 
     D3D11_TEXTURE2D_DESC td = {};
     td.Width = w;
@@ -230,20 +226,22 @@ void DXCanvas::DrawCircleToCPU(int cx, int cy, int radius,
     int y0 = std::max(0, cy - radius);
     int y1 = std::min<int>(height_ - 1, cy + radius);
 
+    // Fill one horizontal span per row (the canvas is stored as BGRA)
     for (int y = y0; y <= y1; y++)
-        for (int x = x0; x <= x1; x++)
-        {
-            int dx = x - cx;
-            int dy = y - cy;
-            if (dx * dx + dy * dy > r2) continue;
-
-            size_t idx = (y * width_ + x) * 4;
-
-            cpuBuffer_[idx + 2] = r;
-            cpuBuffer_[idx + 1] = g;
-            cpuBuffer_[idx + 0] = b;
-            cpuBuffer_[idx + 3] = a;
-        }
+    {
+        int dy = y - cy;
+        int rem = r2 - dy * dy;
+        int half = static_cast<int>(std::sqrt(static_cast<float>(rem)));
+        while (half * half > rem) half--;
+        while ((half + 1) * (half + 1) <= rem) half++;
+
+        int sx0 = std::max(x0, cx - half);
+        int sx1 = std::min(x1, cx + half);
+        if (sx1 < sx0) continue;
+
+        size_t idx = (static_cast<size_t>(y) * width_ + sx0) * 4;
+        PixelOps::Fill(cpuBuffer_.data() + idx, sx1 - sx0 + 1, b, g, r, a);
+    }
 
     UploadCanvasRegion(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
 }
@@ -1,4 +1,5 @@
 #include "Threading.h"
+#include <algorithm>
 
 ThreadPool::ThreadPool(size_t numThreads) {
     for (size_t i = 0; i < numThreads; ++i) {
@@ -24,6 +25,68 @@ ThreadPool::~ThreadPool() {
     Shutdown();
 }
 
+ThreadPool& ThreadPool::GetInstance() {
+    static ThreadPool instance;
+    return instance;
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    // Helpers can start after the loop is over, so the shared state outlives
+    // this call; they only touch fn while indices remain
+    struct Job {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        size_t count = 0;
+        const std::function<void(size_t)>* fn = nullptr;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+    };
+
+    size_t helpers = count > 0 ? std::min(workers_.size(), count - 1) : 0;
+    if (helpers == 0) {
+        for (size_t i = 0; i < count; i++) fn(i);
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->count = count;
+    job->fn = &fn;
+
+    auto work = [job] {
+        for (;;) {
+            size_t index = job->next.fetch_add(1);
+            if (index >= job->count) return;
+
+            try {
+                (*job->fn)(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                if (!job->error) job->error = std::current_exception();
+            }
+
+            if (job->done.fetch_add(1) + 1 == job->count) {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->finished.notify_all();
+            }
+        }
+    };
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!stop_) {
+            for (size_t i = 0; i < helpers; i++) tasks_.emplace(work);
+        }
+    }
+    condition_.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&] { return job->done.load() == job->count; });
+    if (job->error) std::rethrow_exception(job->error);
+}
+
 void ThreadPool::Shutdown() {
     {
         std::unique_lock<std::mutex> lock(mutex_);
@@ -31,7 +94,7 @@ void ThreadPool::Shutdown() {
     }
     condition_.notify_all();
     for (std::thread& worker : workers_) {
-        worker.join();
+        if (worker.joinable()) worker.join();
     }
 }
 
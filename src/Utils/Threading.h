@@ -1,5 +1,7 @@
 #pragma once
 #include <functional>
+#include <atomic>
+#include <exception>
 #include <type_traits>
 #include <vector>
 #include <thread>
@@ -15,9 +17,20 @@ public:
     ThreadPool(size_t numThreads = std::thread::hardware_concurrency());
     ~ThreadPool();
 
+    // Process-wide pool with one worker per hardware thread
+    static ThreadPool& GetInstance();
+
     template<typename F, typename... Args>
     auto Enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type>;
 
+    // Runs fn(i) for every i in [0, count) on the workers and the calling
+    // thread, returning once all calls have finished. Indices are handed out
+    // one at a time, so uneven items balance out; the first exception thrown
+    // by fn is rethrown here. Safe to call from inside a pool task.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+    size_t GetThreadCount() const { return workers_.size(); }
+
     void Shutdown();
 
 private:
@@ -0,0 +1,414 @@
+// LayerManager compositing (CompositeTile and the row kernels under it) at
+// every PixelOps dispatch level: bit-identical to the Scalar level, RGBA8
+// Normal bit-exact against an integer reference, and every blend mode,
+// format and blend space close to a double-precision reference.
+#include "TestCheck.h"
+#include "Core/Engine/LayerManager.h"
+#include "Core/Math/PixelOps.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static const uint32_t CANVAS_WIDTH = 700;
+static const uint32_t CANVAS_HEIGHT = 530;
+
+static const BlendMode ALL_MODES[] = {
+    BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen, BlendMode::Overlay,
+    BlendMode::SoftLight, BlendMode::HardLight, BlendMode::ColorDodge, BlendMode::ColorBurn,
+    BlendMode::Darken, BlendMode::Lighten, BlendMode::Difference, BlendMode::Exclusion};
+
+static const char* FormatName(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::RGBA16:  return "RGBA16";
+        case PixelFormat::RGBA16F: return "RGBA16F";
+        case PixelFormat::RGBA32F: return "RGBA32F";
+        case PixelFormat::RGBA8:
+        default:                   return "RGBA8";
+    }
+}
+
+// Random RGBA8 content: mostly noise, with opaque and transparent patches
+// so tiles of every coverage come up
+static BufferManager::Buffer RandomPixels(uint32_t width, uint32_t height, std::mt19937& rng) {
+    BufferManager::Buffer buffer = BufferManager::Create(width, height);
+    uint32_t patch = rng() % 3;
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t* row = BufferManager::GetRow(buffer, y);
+        for (uint32_t x = 0; x < width * 4; x++) row[x] = static_cast<uint8_t>(rng());
+        for (uint32_t x = 0; x < width; x++) {
+            bool inPatch = x < width / 2 && y < height / 2;
+            if (inPatch && patch == 1) row[x * 4 + 3] = 255;
+            if (inPatch && patch == 2) row[x * 4 + 3] = 0;
+        }
+    }
+    return buffer;
+}
+
+// Adds count layers with random bounds (some past the canvas edges),
+// opacity, blend mode from modes, and masks on some of them. The bottom
+// layer covers the canvas.
+static void AddRandomLayers(LayerManager& layers, PixelFormat format, const std::vector<BlendMode>& modes,
+                            size_t count, std::mt19937& rng) {
+    layers.SetPixelFormat(format);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t width = i == 0 ? CANVAS_WIDTH : 40 + rng() % (CANVAS_WIDTH + 100);
+        uint32_t height = i == 0 ? CANVAS_HEIGHT : 40 + rng() % (CANVAS_HEIGHT + 100);
+        Layer* layer = layers.CreateLayer(width, height);
+        if (i > 0) layer->SetPosition(static_cast<int>(rng() % (CANVAS_WIDTH + 100)) - 100,
+                                      static_cast<int>(rng() % (CANVAS_HEIGHT + 100)) - 100);
+
+        if (i % 4 == 3) {
+            layer->GetPixels().Clear(static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()),
+                                     static_cast<uint8_t>(rng()), 170); // Uniform tiles
+        } else {
+            BufferManager::Buffer pixels = RandomPixels(width, height, rng);
+            BufferManager::Buffer converted = BufferManager::Create(width, height, format);
+            BufferManager::Convert(pixels, converted);
+            layer->GetPixels().Assign(converted);
+            BufferManager::Destroy(converted);
+            BufferManager::Destroy(pixels);
+        }
+
+        layer->SetOpacity(i == 0 || rng() % 3 == 0 ? 1.0f : static_cast<float>(rng() % 1000) / 1000.0f);
+        layer->SetBlendMode(i == 0 ? BlendMode::Normal : modes[rng() % modes.size()]);
+        if (i > 0 && rng() % 2 == 0) {
+            // Mixed values over part of the layer, black and white elsewhere
+            layer->AddMask(rng() % 2 ? 255 : 0);
+            std::vector<uint8_t> values(static_cast<size_t>(width) * height);
+            for (uint8_t& v : values) v = static_cast<uint8_t>(rng());
+            layer->GetMask().Write(0, 0, width, height / 2, values.data(), width);
+        }
+    }
+    layers.SetActiveLayer(nullptr); // No stack caches: they round in another order
+}
+
+// Straight-alpha RGBA pixels of a layer in document space, as doubles 0..1,
+// and its mask as 0..1 (1 without one); pixels outside the layer are 0
+struct LayerSamples {
+    const Layer* layer;
+    std::vector<double> pixels;
+    std::vector<double> mask;
+    std::vector<uint8_t> pixels8; // RGBA8 documents only
+    std::vector<uint8_t> mask8;
+};
+
+static LayerSamples SampleLayer(const Layer& layer) {
+    LayerSamples samples{&layer, {}, {}, {}, {}};
+    uint32_t width = layer.GetWidth(), height = layer.GetHeight();
+    BufferManager::Buffer flat = layer.GetPixels().Flatten();
+    BufferManager::Buffer floats = BufferManager::Create(width, height, PixelFormat::RGBA32F);
+    BufferManager::Convert(flat, floats);
+    std::vector<uint8_t> mask(static_cast<size_t>(width) * height, 255);
+    if (layer.HasMask()) layer.GetMask().Read(0, 0, width, height, mask.data(), width);
+
+    size_t pixels = static_cast<size_t>(CANVAS_WIDTH) * CANVAS_HEIGHT;
+    samples.pixels.assign(pixels * 4, 0.0);
+    samples.mask.assign(pixels, 0.0);
+    samples.pixels8.assign(pixels * 4, 0);
+    samples.mask8.assign(pixels, 0);
+    for (uint32_t y = 0; y < CANVAS_HEIGHT; y++) {
+        for (uint32_t x = 0; x < CANVAS_WIDTH; x++) {
+            int lx = static_cast<int>(x) - layer.GetX(), ly = static_cast<int>(y) - layer.GetY();
+            if (lx < 0 || ly < 0 || lx >= static_cast<int>(width) || ly >= static_cast<int>(height)) continue;
+            size_t index = static_cast<size_t>(y) * CANVAS_WIDTH + x;
+            const float* f = reinterpret_cast<const float*>(BufferManager::GetPixel(floats, lx, ly));
+            for (int c = 0; c < 4; c++) samples.pixels[index * 4 + c] = f[c];
+            if (flat.format == PixelFormat::RGBA8) {
+                std::memcpy(&samples.pixels8[index * 4], BufferManager::GetPixel(flat, lx, ly), 4);
+            }
+            samples.mask8[index] = mask[static_cast<size_t>(ly) * width + lx];
+            samples.mask[index] = samples.mask8[index] / 255.0;
+        }
+    }
+    BufferManager::Destroy(floats);
+    BufferManager::Destroy(flat);
+    return samples;
+}
+
+static std::vector<LayerSamples> SampleLayers(LayerManager& layers) {
+    std::vector<LayerSamples> samples;
+    for (size_t i = 0; i < layers.GetLayerCount(); i++) samples.push_back(SampleLayer(*layers.GetLayer(i)));
+    return samples;
+}
+
+static uint32_t Div255(uint32_t x) {
+    return static_cast<uint32_t>(std::floor(x / 255.0 + 0.5));
+}
+
+// The RGBA8 Normal composite by its definition: a premultiplied 8-bit
+// accumulator, each layer blended with AlphaOverStraight rounding (alpha
+// scaled by the 8-bit opacity and mask), unpremultiplied at the end
+static std::vector<uint8_t> ReferenceNormal8(const std::vector<LayerSamples>& layers) {
+    size_t pixels = static_cast<size_t>(CANVAS_WIDTH) * CANVAS_HEIGHT;
+    std::vector<uint8_t> result(pixels * 4);
+    for (size_t i = 0; i < pixels; i++) {
+        uint32_t acc[4] = {0, 0, 0, 0};
+        for (const LayerSamples& layer : layers) {
+            if (!layer.layer->IsVisible()) continue;
+            uint32_t opacity = static_cast<uint32_t>(layer.layer->GetOpacity() * 255.0f + 0.5f);
+            const uint8_t* s = &layer.pixels8[i * 4];
+            uint32_t a = Div255(s[3] * Div255(layer.mask8[i] * opacity));
+            for (int c = 0; c < 3; c++) acc[c] = Div255(s[c] * a) + Div255(acc[c] * (255 - a));
+            acc[3] = a + Div255(acc[3] * (255 - a));
+        }
+        for (int c = 0; c < 3; c++) {
+            float v = acc[3] ? static_cast<float>(acc[c]) * 255.0f / static_cast<float>(acc[3]) + 0.5f : 0.0f;
+            result[i * 4 + c] = static_cast<uint8_t>(std::min(v, 255.0f));
+        }
+        result[i * 4 + 3] = static_cast<uint8_t>(acc[3]);
+    }
+    return result;
+}
+
+static double BlendReference(BlendMode mode, double cb, double cs) {
+    switch (mode) {
+        case BlendMode::Multiply:   return cb * cs;
+        case BlendMode::Screen:     return cb + cs - cb * cs;
+        case BlendMode::Overlay:    return BlendReference(BlendMode::HardLight, cs, cb);
+        case BlendMode::HardLight:  return cs <= 0.5 ? cb * 2.0 * cs : BlendReference(BlendMode::Screen, cb, 2.0 * cs - 1.0);
+        case BlendMode::SoftLight: {
+            if (cs <= 0.5) return cb - (1.0 - 2.0 * cs) * cb * (1.0 - cb);
+            double d = cb <= 0.25 ? ((16.0 * cb - 12.0) * cb + 4.0) * cb : std::sqrt(cb);
+            return cb + (2.0 * cs - 1.0) * (d - cb);
+        }
+        case BlendMode::ColorDodge: return cb == 0.0 ? 0.0 : cs >= 1.0 ? 1.0 : std::min(1.0, cb / (1.0 - cs));
+        case BlendMode::ColorBurn:  return cb >= 1.0 ? 1.0 : cs <= 0.0 ? 0.0 : 1.0 - std::min(1.0, (1.0 - cb) / cs);
+        case BlendMode::Darken:     return std::min(cb, cs);
+        case BlendMode::Lighten:    return std::max(cb, cs);
+        case BlendMode::Difference: return std::fabs(cb - cs);
+        case BlendMode::Exclusion:  return cb + cs - 2.0 * cb * cs;
+        case BlendMode::Normal:
+        default:                    return cs;
+    }
+}
+
+static double DecodeSRGB(double v) {
+    return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+}
+
+static double EncodeSRGB(double v) {
+    return v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+}
+
+// Any document by the separable blend model (see BlendKernels.h) in double
+// precision, straight alpha, as 0..1 values. With quantize8 set the
+// premultiplied backdrop is rounded to 8 bits after every layer, as the RGBA8
+// accumulator is: modes like ColorBurn magnify that rounding far past a
+// fixed tolerance, so it has to be part of the reference.
+static std::vector<double> ReferenceComposite(const std::vector<LayerSamples>& layers, BlendSpace space,
+                                              bool quantize8) {
+    size_t pixels = static_cast<size_t>(CANVAS_WIDTH) * CANVAS_HEIGHT;
+    std::vector<double> result(pixels * 4);
+    bool linear = space == BlendSpace::Linear;
+    for (size_t i = 0; i < pixels; i++) {
+        double color[3] = {0.0, 0.0, 0.0}, ab = 0.0;
+        for (const LayerSamples& layer : layers) {
+            if (!layer.layer->IsVisible()) continue;
+            const double* s = &layer.pixels[i * 4];
+            double as = s[3] * layer.layer->GetOpacity() * layer.mask[i];
+            if (as <= 0.0) continue;
+            double ao = as + ab * (1.0 - as);
+            for (int c = 0; c < 3; c++) {
+                double cs = linear ? DecodeSRGB(s[c]) : s[c];
+                double cb = color[c];
+                double co = (1.0 - ab) * as * cs + as * ab * BlendReference(layer.layer->GetBlendMode(), cb, cs) +
+                            (1.0 - as) * ab * cb;
+                color[c] = co / ao;
+            }
+            ab = ao;
+            if (quantize8) {
+                ab = std::floor(ab * 255.0 + 0.5) / 255.0;
+                for (int c = 0; c < 3; c++) {
+                    double premultiplied = std::floor(color[c] * ao * 255.0 + 0.5) / 255.0;
+                    color[c] = ab > 0.0 ? premultiplied / ab : 0.0;
+                }
+            }
+        }
+        for (int c = 0; c < 3; c++) result[i * 4 + c] = linear ? EncodeSRGB(color[c]) : color[c];
+        result[i * 4 + 3] = ab;
+    }
+    return result;
+}
+
+// The composite as 0..1 doubles
+static std::vector<double> ToDoubles(const BufferManager::Buffer& composite) {
+    BufferManager::Buffer floats = BufferManager::Create(composite.width, composite.height, PixelFormat::RGBA32F);
+    BufferManager::Convert(composite, floats);
+    std::vector<double> values(static_cast<size_t>(composite.width) * composite.height * 4);
+    for (uint32_t y = 0; y < composite.height; y++) {
+        const float* row = reinterpret_cast<const float*>(BufferManager::GetRow(floats, y));
+        for (uint32_t x = 0; x < composite.width * 4; x++) values[static_cast<size_t>(y) * composite.width * 4 + x] = row[x];
+    }
+    BufferManager::Destroy(floats);
+    return values;
+}
+
+static bool SameBytes(const BufferManager::Buffer& a, const BufferManager::Buffer& b) {
+    if (a.width != b.width || a.height != b.height || a.format != b.format) return false;
+    size_t rowBytes = a.width * BytesPerPixel(a.format);
+    for (uint32_t y = 0; y < a.height; y++) {
+        if (std::memcmp(BufferManager::GetRow(a, y), BufferManager::GetRow(b, y), rowBytes) != 0) return false;
+    }
+    return true;
+}
+
+// A fresh composite (nothing cached) at the given level
+static BufferManager::Buffer CompositeAt(LayerManager& layers, SimdLevel level) {
+    PixelOps::SetLevel(level);
+    layers.InvalidateComposite();
+    return layers.CompositeLayers(CANVAS_WIDTH, CANVAS_HEIGHT);
+}
+
+// Composites at every level above Scalar match the Scalar one exactly
+static void CheckLevels(LayerManager& layers, const BufferManager::Buffer& scalar, const char* what) {
+    for (int level = static_cast<int>(SimdLevel::SSE2); level <= static_cast<int>(PixelOps::GetSupportedLevel()); level++) {
+        BufferManager::Buffer composite = CompositeAt(layers, static_cast<SimdLevel>(level));
+        CHECK_CONTEXT(SameBytes(composite, scalar), "%s at %s", what, PixelOps::GetLevelName(static_cast<SimdLevel>(level)));
+        BufferManager::Destroy(composite);
+    }
+    PixelOps::SetLevel(PixelOps::GetSupportedLevel());
+}
+
+static void TestNormal8Exact() {
+    std::mt19937 rng(11);
+    for (int document = 0; document < 3; document++) {
+        LayerManager layers;
+        AddRandomLayers(layers, PixelFormat::RGBA8, {BlendMode::Normal}, 6, rng);
+        if (document == 2) layers.GetLayer(2)->SetVisible(false);
+        std::vector<uint8_t> reference = ReferenceNormal8(SampleLayers(layers));
+
+        BufferManager::Buffer scalar = CompositeAt(layers, SimdLevel::Scalar);
+        size_t mismatches = 0;
+        for (uint32_t y = 0; y < CANVAS_HEIGHT; y++) {
+            const uint8_t* row = BufferManager::GetRow(scalar, y);
+            mismatches += std::memcmp(row, &reference[static_cast<size_t>(y) * CANVAS_WIDTH * 4], CANVAS_WIDTH * 4) != 0;
+        }
+        CHECK_CONTEXT(mismatches == 0, "RGBA8 Normal document %d: %zu rows differ from the reference", document, mismatches);
+        CheckLevels(layers, scalar, "RGBA8 Normal");
+        BufferManager::Destroy(scalar);
+    }
+}
+
+// Largest difference from the reference in premultiplied color and alpha:
+// straight color is ill-conditioned under thin alpha, where any rounding in
+// the accumulator is scaled up by 1 / alpha
+static double MaxError(const std::vector<double>& composite, const std::vector<double>& reference) {
+    double worst = 0.0;
+    for (size_t i = 0; i < composite.size(); i += 4) {
+        worst = std::max(worst, std::fabs(composite[i + 3] - reference[i + 3]));
+        for (int c = 0; c < 3; c++) {
+            worst = std::max(worst, std::fabs(composite[i + c] * composite[i + 3] - reference[i + c] * reference[i + 3]));
+        }
+    }
+    return worst;
+}
+
+struct ModeCase {
+    PixelFormat format;
+    BlendSpace space;
+    double tolerance; // In 0..1 units of premultiplied color
+};
+
+static void TestModes() {
+    // RGBA8 rounds its accumulator to 8 bits per layer (four layers here);
+    // linear light accumulates in 16 bits (float for the deeper formats)
+    // and encodes through a table of 0.8-code steps
+    const ModeCase cases[] = {
+        {PixelFormat::RGBA8, BlendSpace::SRGB, 3.0 / 255.0},
+        {PixelFormat::RGBA16, BlendSpace::SRGB, 0.5 / 255.0},
+        {PixelFormat::RGBA16F, BlendSpace::SRGB, 0.5 / 255.0},
+        {PixelFormat::RGBA32F, BlendSpace::SRGB, 0.5 / 255.0},
+        {PixelFormat::RGBA8, BlendSpace::Linear, 1.5 / 255.0},
+        {PixelFormat::RGBA16, BlendSpace::Linear, 0.5 / 255.0},
+        {PixelFormat::RGBA32F, BlendSpace::Linear, 0.5 / 255.0},
+    };
+    std::mt19937 rng(12);
+    for (const ModeCase& test : cases) {
+        for (BlendMode mode : ALL_MODES) {
+            LayerManager layers;
+            layers.SetBlendSpace(test.space);
+            AddRandomLayers(layers, test.format, {BlendMode::Normal, mode}, 4, rng);
+            char what[96];
+            std::snprintf(what, sizeof(what), "%s %s, mode %d", FormatName(test.format),
+                          test.space == BlendSpace::Linear ? "linear" : "sRGB", static_cast<int>(mode));
+
+            BufferManager::Buffer scalar = CompositeAt(layers, SimdLevel::Scalar);
+            bool quantize8 = test.format == PixelFormat::RGBA8 && test.space == BlendSpace::SRGB;
+            double error = MaxError(ToDoubles(scalar), ReferenceComposite(SampleLayers(layers), test.space, quantize8));
+            CHECK_CONTEXT(error <= test.tolerance, "%s: off the reference by %.2f/255", what, error * 255.0);
+            CheckLevels(layers, scalar, what);
+            BufferManager::Destroy(scalar);
+        }
+    }
+}
+
+// Redoing only the dirty tiles gives what compositing from scratch gives
+static void TestIncremental() {
+    std::mt19937 rng(13);
+    for (PixelFormat format : {PixelFormat::RGBA8, PixelFormat::RGBA16F}) {
+        LayerManager layers;
+        AddRandomLayers(layers, format, std::vector<BlendMode>(std::begin(ALL_MODES), std::end(ALL_MODES)), 5, rng);
+        BufferManager::Buffer first = layers.CompositeLayers(CANVAS_WIDTH, CANVAS_HEIGHT);
+
+        BufferManager::Buffer patch = RandomPixels(90, 60, rng);
+        BufferManager::Buffer converted = BufferManager::Create(90, 60, format);
+        BufferManager::Convert(patch, converted);
+        layers.GetLayer(1)->GetPixels().Write(10, 20, BufferManager::GetView(converted));
+        layers.GetLayer(2)->SetOpacity(0.3f);
+        layers.GetLayer(3)->Move(37, -12);
+        BufferManager::Buffer updated = layers.CompositeLayers(CANVAS_WIDTH, CANVAS_HEIGHT);
+        BufferManager::Buffer fresh = layers.Publish(CANVAS_WIDTH, CANVAS_HEIGHT)->Composite();
+        CHECK_CONTEXT(SameBytes(updated, fresh), "%s", FormatName(format));
+        CHECK_CONTEXT(!SameBytes(updated, first), "%s", FormatName(format));
+
+        for (BufferManager::Buffer* buffer : {&first, &patch, &converted, &updated, &fresh}) BufferManager::Destroy(*buffer);
+    }
+}
+
+// Every layer, group children included, follows SetPixelFormat; a round
+// trip through RGBA16 gives back the RGBA8 composite exactly
+static void TestSetPixelFormat() {
+    std::mt19937 rng(14);
+    LayerManager layers;
+    AddRandomLayers(layers, PixelFormat::RGBA8, {BlendMode::Normal, BlendMode::Multiply}, 5, rng);
+    Layer* group = layers.CreateGroup();
+    layers.MoveToGroup(layers.GetLayer(2), group);
+    layers.MoveToGroup(layers.GetLayer(2), group);
+    BufferManager::Buffer original = layers.CompositeLayers(CANVAS_WIDTH, CANVAS_HEIGHT);
+
+    auto checkFormats = [&](PixelFormat format) {
+        for (size_t i = 0; i < layers.GetLayerCount(); i++) {
+            const Layer* layer = layers.GetLayer(i);
+            for (size_t c = 0; c < layer->GetChildCount(); c++) {
+                CHECK_CONTEXT(layer->GetChild(c)->GetFormat() == format, "%s child %zu", FormatName(format), c);
+            }
+            CHECK_CONTEXT(layer->IsGroup() || layer->GetFormat() == format, "%s layer %zu", FormatName(format), i);
+        }
+    };
+
+    layers.SetPixelFormat(PixelFormat::RGBA16);
+    checkFormats(PixelFormat::RGBA16);
+    BufferManager::Buffer deep = layers.CompositeLayers(CANVAS_WIDTH, CANVAS_HEIGHT);
+    CHECK(deep.format == PixelFormat::RGBA16);
+    // RGBA8 rounds each layer it blends; RGBA16 does not
+    double error = MaxError(ToDoubles(deep), ToDoubles(original));
+    CHECK_CONTEXT(error <= 3.0 / 255.0, "RGBA16 off the RGBA8 composite by %.2f/255", error * 255.0);
+
+    layers.SetPixelFormat(PixelFormat::RGBA8);
+    checkFormats(PixelFormat::RGBA8);
+    BufferManager::Buffer back = layers.CompositeLayers(CANVAS_WIDTH, CANVAS_HEIGHT);
+    CHECK(SameBytes(back, original));
+    for (BufferManager::Buffer* buffer : {&original, &deep, &back}) BufferManager::Destroy(*buffer);
+}
+
+int main() {
+    std::printf("Testing up to %s\n", PixelOps::GetLevelName(PixelOps::GetSupportedLevel()));
+    TestNormal8Exact();
+    TestModes();
+    TestIncremental();
+    TestSetPixelFormat();
+    std::printf("%s: %d failed checks\n", TestFailures() ? "FAILED" : "passed", TestFailures());
+    return TestFailures();
+}
@@ -0,0 +1,366 @@
+// PixelOps: the scalar kernels against their definitions, and every SIMD
+// level the CPU supports against the scalar kernels, bit for bit.
+#include "TestCheck.h"
+#include "Core/Math/PixelOps.h"
+#include "Core/Memory/PixelFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <vector>
+
+static uint32_t FloatBits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float BitsToFloat(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Compares floats and halves by their bits, so NaNs compare too
+template<typename T>
+static bool SameBits(const std::vector<T>& a, const std::vector<T>& b) {
+    return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+static uint32_t RoundDiv255(uint32_t x) {
+    return static_cast<uint32_t>(std::floor(x / 255.0 + 0.5));
+}
+
+// Inputs for one run of every primitive
+struct Inputs {
+    size_t pixels = 0;
+    std::vector<uint8_t> straight;      // Any RGBA8
+    std::vector<uint8_t> premultiplied; // Color <= alpha
+    std::vector<uint8_t> backdrop;      // Premultiplied, for the alpha-over kernels
+    std::vector<uint8_t> mask;
+    std::vector<float> unit;            // Around 0..1, with NaN, infinities and denormals
+    std::vector<float> wide;            // Past the half range, with NaN payloads
+    std::vector<Half> halves;           // Every kind of half, NaN included
+    std::vector<float> lookupTable;     // 256 entries for LookupRGBA8ToF32
+    std::vector<float> curve;           // 256 + 2 samples for InterpolateF32
+    std::vector<uint16_t> straight16;   // Any RGBA16
+    std::vector<uint16_t> backdrop16;   // Premultiplied RGBA16
+    std::vector<uint16_t> wideTable;    // 256 entries for LookupRGBA8ToU16
+    std::vector<uint8_t> encodeTable;   // 1024 steps (+ 3 padding) for EncodeLinear16
+};
+
+static std::vector<uint8_t> RandomPremultiplied(size_t pixels, std::mt19937& rng) {
+    std::vector<uint8_t> values(pixels * 4);
+    for (size_t i = 0; i < pixels; i++) {
+        uint32_t a = rng() % 4 == 0 ? (rng() % 2) * 255 : rng() % 256;
+        for (int c = 0; c < 3; c++) values[i * 4 + c] = static_cast<uint8_t>(rng() % (a + 1));
+        values[i * 4 + 3] = static_cast<uint8_t>(a);
+    }
+    return values;
+}
+
+static Inputs MakeInputs(size_t pixels, std::mt19937& rng) {
+    Inputs in;
+    in.pixels = pixels;
+    size_t values = pixels * 4;
+    in.straight.resize(values);
+    for (uint8_t& v : in.straight) v = static_cast<uint8_t>(rng());
+    in.premultiplied = RandomPremultiplied(pixels, rng);
+    in.backdrop = RandomPremultiplied(pixels, rng);
+    in.mask.resize(pixels);
+    for (uint8_t& v : in.mask) v = static_cast<uint8_t>(rng() % 3 == 0 ? (rng() % 2) * 255 : rng() % 256);
+
+    std::uniform_real_distribution<float> unit(-0.25f, 1.25f);
+    std::uniform_real_distribution<float> wide(-80000.0f, 80000.0f);
+    const float specials[] = {std::numeric_limits<float>::quiet_NaN(), BitsToFloat(0xFFC00001u),
+                              BitsToFloat(0x7F800001u), BitsToFloat(0x7FBFE000u),
+                              std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+                              std::numeric_limits<float>::denorm_min(), -0.0f, 65504.0f, 65520.0f, 6.1e-5f, 3e-8f};
+    in.unit.resize(values);
+    in.wide.resize(values);
+    for (size_t i = 0; i < values; i++) {
+        in.unit[i] = unit(rng);
+        in.wide[i] = rng() % 3 == 0 ? wide(rng) * 1e-9f : wide(rng);
+        if (rng() % 8 == 0) {
+            in.unit[i] = specials[rng() % std::size(specials)];
+            in.wide[i] = specials[rng() % std::size(specials)];
+        }
+    }
+    in.halves.resize(values);
+    for (Half& h : in.halves) h.bits = static_cast<uint16_t>(rng());
+
+    in.lookupTable.resize(256);
+    for (size_t i = 0; i < 256; i++) in.lookupTable[i] = std::pow(static_cast<float>(i) / 255.0f, 2.2f);
+    in.curve.resize(258);
+    for (size_t i = 0; i <= 256; i++) in.curve[i] = std::sqrt(static_cast<float>(i) / 256.0f);
+    in.curve[257] = in.curve[256];
+
+    in.straight16.resize(values);
+    for (uint16_t& v : in.straight16) v = static_cast<uint16_t>(rng() % 4 == 0 ? (rng() % 2) * 65535 : rng());
+    in.backdrop16.resize(values);
+    for (size_t i = 0; i < pixels; i++) {
+        uint32_t a = rng() % 4 == 0 ? (rng() % 2) * 65535 : rng() % 65536;
+        for (int c = 0; c < 3; c++) in.backdrop16[i * 4 + c] = static_cast<uint16_t>(rng() % (a + 1));
+        in.backdrop16[i * 4 + 3] = static_cast<uint16_t>(a);
+    }
+    in.wideTable.resize(256);
+    for (size_t i = 0; i < 256; i++) in.wideTable[i] = static_cast<uint16_t>(65535.0 * std::pow(i / 255.0, 2.2) + 0.5);
+    in.encodeTable.resize(1024 + 3);
+    for (size_t i = 0; i < 1024; i++) in.encodeTable[i] = static_cast<uint8_t>(255.0 * std::sqrt((i + 0.5) / 1024));
+    return in;
+}
+
+// Output of every primitive on one set of inputs
+struct Results {
+    std::vector<uint8_t> fill, swizzle, swizzleInPlace, premultiply, premultiplyInPlace, unpremultiply,
+        unpremultiplyInPlace, over, overStraight, overStraightMasked, f32ToU8;
+    std::vector<float> u8ToF32, u16ToF32, f16ToF32, deinterleaved, interleaved, lookup, interpolated;
+    std::vector<Half> f32ToF16;
+    std::vector<uint16_t> overStraight16, lookup16, f32ToU16;
+    std::vector<uint8_t> encoded16;
+    bool interpolateInside = false;
+};
+
+static constexpr uint8_t TEST_OPACITY = 201;
+static constexpr uint16_t TEST_OPACITY16 = 51657;
+
+static Results RunAll(const Inputs& in) {
+    size_t n = in.pixels;
+    size_t values = n * 4;
+    Results r;
+    r.fill.assign(values, 0);
+    PixelOps::Fill(r.fill.data(), n, 1, 2, 3, 4);
+
+    r.swizzle.resize(values);
+    PixelOps::SwizzleRB(r.swizzle.data(), in.straight.data(), n);
+    r.swizzleInPlace = in.straight;
+    PixelOps::SwizzleRB(r.swizzleInPlace.data(), r.swizzleInPlace.data(), n);
+
+    r.premultiply.resize(values);
+    PixelOps::Premultiply(r.premultiply.data(), in.straight.data(), n);
+    r.premultiplyInPlace = in.straight;
+    PixelOps::Premultiply(r.premultiplyInPlace.data(), r.premultiplyInPlace.data(), n);
+
+    r.unpremultiply.resize(values);
+    PixelOps::Unpremultiply(r.unpremultiply.data(), in.premultiplied.data(), n);
+    r.unpremultiplyInPlace = in.premultiplied;
+    PixelOps::Unpremultiply(r.unpremultiplyInPlace.data(), r.unpremultiplyInPlace.data(), n);
+
+    r.over = in.backdrop;
+    PixelOps::AlphaOver(r.over.data(), in.premultiplied.data(), n);
+    r.overStraight = in.backdrop;
+    PixelOps::AlphaOverStraight(r.overStraight.data(), in.straight.data(), n, TEST_OPACITY);
+    r.overStraightMasked = in.backdrop;
+    PixelOps::AlphaOverStraightMasked(r.overStraightMasked.data(), in.straight.data(), in.mask.data(), n,
+                                      TEST_OPACITY);
+    r.overStraight16 = in.backdrop16;
+    PixelOps::AlphaOverStraight16(r.overStraight16.data(), in.straight16.data(), n, TEST_OPACITY16);
+    r.encoded16.resize(values);
+    PixelOps::EncodeLinear16(r.encoded16.data(), in.backdrop16.data(), n, in.encodeTable.data(), 1024);
+
+    r.u8ToF32.resize(values);
+    PixelOps::ConvertU8ToF32(r.u8ToF32.data(), in.straight.data(), values);
+    r.f32ToU8.resize(values);
+    PixelOps::ConvertF32ToU8(r.f32ToU8.data(), in.unit.data(), values);
+    r.u16ToF32.resize(values);
+    PixelOps::ConvertU16ToF32(r.u16ToF32.data(), in.straight16.data(), values);
+    r.f32ToU16.resize(values);
+    PixelOps::ConvertF32ToU16(r.f32ToU16.data(), in.unit.data(), values);
+    r.f32ToF16.resize(values);
+    PixelOps::ConvertF32ToF16(r.f32ToF16.data(), in.wide.data(), values);
+    r.f16ToF32.resize(values);
+    PixelOps::ConvertF16ToF32(r.f16ToF32.data(), in.halves.data(), values);
+
+    r.deinterleaved.resize(values);
+    float* const planes[4] = {r.deinterleaved.data(), r.deinterleaved.data() + n, r.deinterleaved.data() + n * 2,
+                              r.deinterleaved.data() + n * 3};
+    PixelOps::Deinterleave(planes, in.unit.data(), n);
+    r.interleaved.resize(values);
+    const float* const constPlanes[4] = {planes[0], planes[1], planes[2], planes[3]};
+    PixelOps::Interleave(r.interleaved.data(), constPlanes, n);
+
+    r.lookup.resize(values);
+    PixelOps::LookupRGBA8ToF32(r.lookup.data(), in.straight.data(), n, in.lookupTable.data());
+    r.lookup16.resize(values);
+    PixelOps::LookupRGBA8ToU16(r.lookup16.data(), in.straight.data(), n, in.wideTable.data());
+    r.interpolated.resize(values);
+    r.interpolateInside = PixelOps::InterpolateF32(r.interpolated.data(), in.unit.data(), values, in.curve.data(), 256);
+    return r;
+}
+
+// The scalar kernels against the formulas in PixelOps.h
+static void TestScalarDefinitions(const Inputs& in, const Results& r) {
+    for (size_t i = 0; i < in.pixels; i++) {
+        const uint8_t* s = &in.straight[i * 4];
+        const uint8_t* p = &in.premultiplied[i * 4];
+        const uint8_t* d = &in.backdrop[i * 4];
+        CHECK(r.fill[i * 4] == 1 && r.fill[i * 4 + 1] == 2 && r.fill[i * 4 + 2] == 3 && r.fill[i * 4 + 3] == 4);
+        CHECK(r.swizzle[i * 4] == s[2] && r.swizzle[i * 4 + 1] == s[1] && r.swizzle[i * 4 + 2] == s[0] &&
+              r.swizzle[i * 4 + 3] == s[3]);
+
+        uint32_t a = RoundDiv255(s[3] * TEST_OPACITY);
+        uint32_t maskedA = RoundDiv255(s[3] * RoundDiv255(in.mask[i] * TEST_OPACITY));
+        for (int c = 0; c < 4; c++) {
+            uint32_t premultiplied = c == 3 ? s[3] : RoundDiv255(s[c] * s[3]);
+            CHECK_CONTEXT(r.premultiply[i * 4 + c] == premultiplied, "pixel %zu", i);
+
+            if (p[3] == 0) {
+                CHECK(r.unpremultiply[i * 4 + c] == 0);
+            } else if (c < 3) {
+                double v = std::min(std::floor(p[c] * 255.0 / p[3] + 0.5), 255.0);
+                CHECK_CONTEXT(r.unpremultiply[i * 4 + c] == v, "pixel %zu", i);
+            } else {
+                CHECK(r.unpremultiply[i * 4 + c] == p[3]);
+            }
+
+            CHECK(r.over[i * 4 + c] == std::min<uint32_t>(p[c] + RoundDiv255(d[c] * (255u - p[3])), 255));
+
+            uint32_t source = c == 3 ? a : RoundDiv255(s[c] * a);
+            CHECK(r.overStraight[i * 4 + c] == source + RoundDiv255(d[c] * (255 - a)));
+            uint32_t maskedSource = c == 3 ? maskedA : RoundDiv255(s[c] * maskedA);
+            CHECK(r.overStraightMasked[i * 4 + c] == maskedSource + RoundDiv255(d[c] * (255 - maskedA)));
+
+            CHECK(r.lookup[i * 4 + c] == (c == 3 ? s[3] * (1.0f / 255.0f) : in.lookupTable[s[c]]));
+            CHECK(r.lookup16[i * 4 + c] == (c == 3 ? s[3] * 257 : in.wideTable[s[c]]));
+            CHECK(r.deinterleaved[c * in.pixels + i] == in.unit[i * 4 + c] ||
+                  (std::isnan(in.unit[i * 4 + c]) && std::isnan(r.deinterleaved[c * in.pixels + i])));
+        }
+
+        const uint16_t* s16 = &in.straight16[i * 4];
+        const uint16_t* d16 = &in.backdrop16[i * 4];
+        double a16 = std::floor(s16[3] * static_cast<double>(TEST_OPACITY16) / 65535.0 + 0.5);
+        for (int c = 0; c < 4; c++) {
+            double source = c == 3 ? 65535.0 : s16[c];
+            double v = std::floor((source * a16 + d16[c] * (65535.0 - a16)) / 65535.0 + 0.5);
+            CHECK_CONTEXT(r.overStraight16[i * 4 + c] == v, "pixel %zu", i);
+        }
+        // The encode is defined in float; its index is checked to within one
+        // step of the exact quotient, the alpha exactly
+        for (int c = 0; c < 3; c++) {
+            double index = d16[3] == 0 ? 0.0 : std::min(d16[c] * 1024.0 / d16[3], 1023.0);
+            size_t lo = static_cast<size_t>(std::max(index - 0.01, 0.0)), hi = static_cast<size_t>(index + 0.01);
+            uint8_t e = r.encoded16[i * 4 + c];
+            CHECK_CONTEXT(e == in.encodeTable[lo] || e == in.encodeTable[std::min<size_t>(hi, 1023)], "pixel %zu", i);
+        }
+        CHECK(r.encoded16[i * 4 + 3] == std::floor(d16[3] * 255.0 / 65535.0 + 0.5));
+    }
+    CHECK(r.swizzleInPlace == r.swizzle);
+    CHECK(r.premultiplyInPlace == r.premultiply);
+    CHECK(r.unpremultiplyInPlace == r.unpremultiply);
+    CHECK(SameBits(r.interleaved, in.unit));
+
+    bool inside = true;
+    for (size_t i = 0; i < in.unit.size(); i++) {
+        float v = in.unit[i];
+        CHECK(r.u8ToF32[i] == in.straight[i] * (1.0f / 255.0f));
+        uint8_t quantized = std::isnan(v) ? 0 : static_cast<uint8_t>(std::clamp(v * 255.0f + 0.5f, 0.0f, 255.0f));
+        CHECK_CONTEXT(r.f32ToU8[i] == quantized, "value %g", v);
+        CHECK(r.u16ToF32[i] == in.straight16[i] * (1.0f / 65535.0f));
+        uint16_t quantized16 =
+            std::isnan(v) ? 0 : static_cast<uint16_t>(std::clamp(v * 65535.0f + 0.5f, 0.0f, 65535.0f));
+        CHECK_CONTEXT(r.f32ToU16[i] == quantized16, "value %g", v);
+        CHECK(SameBits(std::vector<Half>{r.f32ToF16[i]}, std::vector<Half>{HalfFloat::FromFloat(in.wide[i])}));
+        inside &= v >= 0.0f && v <= 1.0f;
+    }
+    CHECK(r.interpolateInside == inside);
+}
+
+// Every half converts to float and back to itself; NaNs come back quiet
+static void TestHalfRoundTrip() {
+    for (uint32_t bits = 0; bits <= 0xFFFF; bits++) {
+        Half half;
+        half.bits = static_cast<uint16_t>(bits);
+        float value = HalfFloat::ToFloat(half);
+        bool nan = (bits & 0x7C00) == 0x7C00 && (bits & 0x3FF) != 0;
+        CHECK_CONTEXT(std::isnan(value) == nan, "half %04x", bits);
+        uint16_t expected = static_cast<uint16_t>(nan ? bits | 0x200 : bits);
+        CHECK_CONTEXT(HalfFloat::FromFloat(value).bits == expected, "half %04x", bits);
+        if (nan) {
+            CHECK_CONTEXT((FloatBits(value) & 0x1FFF) == 0 && (FloatBits(value) & 0x400000) != 0, "half %04x", bits);
+        }
+    }
+
+    // Rounding to nearest even and the edges of the range
+    CHECK(HalfFloat::FromFloat(1.0f).bits == 0x3C00);
+    CHECK(HalfFloat::FromFloat(1.0f + 1.0f / 2048.0f).bits == 0x3C00);
+    CHECK(HalfFloat::FromFloat(1.0f + 3.0f / 2048.0f).bits == 0x3C02);
+    CHECK(HalfFloat::FromFloat(65504.0f).bits == 0x7BFF);
+    CHECK(HalfFloat::FromFloat(65520.0f).bits == 0x7C00);
+    CHECK(HalfFloat::FromFloat(-std::numeric_limits<float>::infinity()).bits == 0xFC00);
+    CHECK(HalfFloat::FromFloat(5.9604645e-8f).bits == 0x0001);
+    CHECK(HalfFloat::FromFloat(BitsToFloat(0x7F802000u)).bits == 0x7E01);
+    CHECK(HalfFloat::FromFloat(BitsToFloat(0xFFA00000u)).bits == 0xFF00);
+}
+
+static void TestDiv255() {
+    for (uint32_t x = 0; x <= 255 * 255; x++) {
+        CHECK_CONTEXT(PixelOps::Div255(x) == RoundDiv255(x), "x %u", x);
+    }
+    // Div65535 over its whole range would take too long; products of two
+    // channels in strides, and the ends
+    for (uint32_t a = 0; a <= 65535; a += 7) {
+        for (uint32_t b = 0; b <= 65535; b += 251) {
+            uint32_t x = a * b;
+            CHECK_CONTEXT(PixelOps::Div65535(x) == static_cast<uint32_t>(std::floor(x / 65535.0 + 0.5)), "x %u", x);
+        }
+    }
+    CHECK(PixelOps::Div65535(65535u * 65535u) == 65535);
+    CHECK(PixelOps::Div65535(32767) == 0 && PixelOps::Div65535(32768) == 1);
+}
+
+// Every level against the scalar one, over lengths that exercise the
+// vector bodies and every tail
+static void TestLevels() {
+    const size_t sizes[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 255, 1000};
+    std::mt19937 rng(20240611);
+    SimdLevel supported = PixelOps::GetSupportedLevel();
+    std::printf("Testing up to %s\n", PixelOps::GetLevelName(supported));
+
+    for (size_t pixels : sizes) {
+        Inputs in = MakeInputs(pixels, rng);
+        PixelOps::SetLevel(SimdLevel::Scalar);
+        Results reference = RunAll(in);
+        TestScalarDefinitions(in, reference);
+
+        for (int level = static_cast<int>(SimdLevel::SSE2); level <= static_cast<int>(supported); level++) {
+            PixelOps::SetLevel(static_cast<SimdLevel>(level));
+            Results r = RunAll(in);
+            const char* name = PixelOps::GetLevelName(static_cast<SimdLevel>(level));
+            CHECK_CONTEXT(r.fill == reference.fill, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.swizzle == reference.swizzle, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.swizzleInPlace == reference.swizzleInPlace, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.premultiply == reference.premultiply, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.premultiplyInPlace == reference.premultiplyInPlace, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.unpremultiply == reference.unpremultiply, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.unpremultiplyInPlace == reference.unpremultiplyInPlace, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.over == reference.over, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.overStraight == reference.overStraight, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.overStraightMasked == reference.overStraightMasked, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.overStraight16 == reference.overStraight16, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.encoded16 == reference.encoded16, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.lookup16 == reference.lookup16, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.f32ToU8 == reference.f32ToU8, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.f32ToU16 == reference.f32ToU16, "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(SameBits(r.u8ToF32, reference.u8ToF32), "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(SameBits(r.u16ToF32, reference.u16ToF32), "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(SameBits(r.f32ToF16, reference.f32ToF16), "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(SameBits(r.f16ToF32, reference.f16ToF32), "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(SameBits(r.deinterleaved, reference.deinterleaved), "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(SameBits(r.interleaved, reference.interleaved), "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(SameBits(r.lookup, reference.lookup), "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(SameBits(r.interpolated, reference.interpolated), "%s, %zu pixels", name, pixels);
+            CHECK_CONTEXT(r.interpolateInside == reference.interpolateInside, "%s, %zu pixels", name, pixels);
+        }
+    }
+    PixelOps::SetLevel(supported);
+}
+
+int main() {
+    TestDiv255();
+    TestHalfRoundTrip();
+    TestLevels();
+    std::printf("%s: %d failed checks\n", TestFailures() ? "FAILED" : "passed", TestFailures());
+    return TestFailures();
+}
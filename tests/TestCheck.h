@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdio>
+
+// Minimal checks for the test programs: a failed CHECK prints where it
+// failed and counts, and main returns TestFailures() so ctest sees it.
+inline int& TestFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition) CHECK_CONTEXT(condition, "%s", "")
+
+// CHECK that also prints what was being tested (printf-style)
+#define CHECK_CONTEXT(condition, ...)                                                 \
+    do {                                                                              \
+        if (!(condition)) {                                                           \
+            std::printf("%s:%d: CHECK failed: %s ", __FILE__, __LINE__, #condition); \
+            std::printf(__VA_ARGS__);                                                 \
+            std::printf("\n");                                                        \
+            TestFailures()++;                                                         \
+        }                                                                             \
+    } while (0)